@@ -0,0 +1,486 @@
+/*
+
+  Bit reader benchmark
+  --------------------
+
+  Checks and measures the RBSP unescape implementations and the 64 bit cache
+  bit reader in H264_BitReader.cpp.
+
+  First we compare them with scalar references on random data: the SSE2, AVX2
+  and dispatched unescape and h264_rbsp() with h264_unescape_rbsp_c() on
+  buffers with many `00 00 03` sequences, and H264_BitReader with the bit by
+  bit reader below on random sequences of reads. Every value, the error flag
+  and the position must be the same up to the first error; on the first
+  difference we print the seed and exit with EXIT_FAILURE.
+
+  Then we measure the unescape throughput (GB/s) on the NALs of a file (or on
+  random data when you don't pass one) and the number of ue(v) codes per
+  second both readers decode.
+
+  Usage: ./bitreader [file.h264] [iterations]
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <H264_Decoder.h>
+#include <H264_AnnexB.h>
+#include <H264_BitReader.h>
+
+#define FUZZ_ROUNDS 20000
+#define UE_COUNT (1024 * 1024)
+
+/* the bit by bit reader we used before the 64 bit cache */
+struct RefBitReader {
+  RefBitReader(const uint8_t* d, size_t n):data(d),size(n),pos(0),error(false) {}
+  uint32_t readBit();
+  uint32_t readBits(int n);
+  uint32_t readUe();
+  int32_t readSe();
+  void skipBits(size_t n);
+  size_t bitsLeft() { return (pos < size * 8) ? size * 8 - pos : 0; }
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+  bool error;
+};
+
+/* xorshift, so a seed always gives the same data */
+struct Random {
+  Random(uint64_t seed):state(seed * 2654435761ull + 1) {}
+  uint32_t next() { state ^= state << 13; state ^= state >> 7; state ^= state << 17; return (uint32_t)state; }
+  uint32_t below(uint32_t n) { return next() % n; }
+  uint64_t state;
+};
+
+static bool read_file(const char* filepath, std::vector<uint8_t>& result);
+static void fill_escaped(Random& rnd, uint8_t* data, size_t size);
+static bool fuzz_unescape(uint64_t seed);
+static bool fuzz_bitreader(uint64_t seed);
+static size_t write_ue_codes(Random& rnd, std::vector<uint8_t>& result, size_t count);
+static void print_result(const char* name, uint64_t count, uint64_t duration, size_t nbytes);
+
+int main(int argc, char** argv) {
+
+  int iterations = (argc > 2) ? atoi(argv[2]) : 10;
+  std::vector<uint8_t> file;
+
+  printf("Dispatch: %s\n", h264_unescape_rbsp_name());
+
+  /* equivalence */
+  for(uint64_t seed = 1; seed <= FUZZ_ROUNDS; ++seed) {
+    if(!fuzz_unescape(seed) || !fuzz_bitreader(seed)) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("Fuzz: %d rounds, unescape and bit reader match the references\n", FUZZ_ROUNDS);
+
+  /* unescape throughput */
+  if(argc > 1) {
+    if(!read_file(argv[1], file)) {
+      return EXIT_FAILURE;
+    }
+  }
+  else {
+    Random rnd(1);
+    file.resize(16 * 1024 * 1024);
+    fill_escaped(rnd, &file[0], file.size());
+  }
+
+  std::vector<H264_Nal> nals;
+  const uint8_t* p = &file[0];
+  const uint8_t* end = p + file.size();
+  H264_Nal nal;
+  size_t nal_bytes = 0;
+
+  while(h264_next_nal(p, end, nal)) {
+    nals.push_back(nal);
+    nal_bytes += nal.size;
+  }
+
+  if(nals.empty()) {
+    nal.data = &file[0];
+    nal.size = file.size();
+    nals.push_back(nal);
+    nal_bytes = nal.size;
+  }
+
+  printf("Data: %s, %zu NALs, %zu bytes, %d iterations\n", (argc > 1) ? argv[1] : "random", nals.size(), nal_bytes, iterations);
+
+  struct {
+    const char* name;
+    h264_unescape_rbsp_func func;
+  } unescapers[] = {
+    { "unescape c", h264_unescape_rbsp_c },
+    { "unescape sse2", h264_unescape_rbsp_sse2 },
+    { "unescape avx2", h264_unescape_rbsp_avx2 },
+  };
+
+  std::vector<uint8_t> dest(file.size());
+
+  for(size_t i = 0; i < sizeof(unescapers) / sizeof(unescapers[0]); ++i) {
+    if(unescapers[i].func == h264_unescape_rbsp_avx2 && !h264_cpu_has_avx2()) {
+      continue;
+    }
+    uint64_t count = 0;
+    uint64_t start = rx_hrtime();
+    for(int j = 0; j < iterations; ++j) {
+      count = 0;
+      for(size_t k = 0; k < nals.size(); ++k) {
+        count += nals[k].size - unescapers[i].func(nals[k].data, nals[k].size, &dest[0]);
+      }
+    }
+    print_result(unescapers[i].name, count, rx_hrtime() - start, nal_bytes * iterations);
+  }
+
+  {
+    /* what H264_SliceParser does: only the start of every NAL */
+    std::vector<uint8_t> buffer;
+    uint64_t count = 0;
+    size_t nbytes = 0;
+    uint64_t start = rx_hrtime();
+    for(int j = 0; j < iterations; ++j) {
+      count = 0;
+      nbytes = 0;
+      for(size_t k = 0; k < nals.size(); ++k) {
+        size_t rbsp_size = 0;
+        size_t n = std::min(nals[k].size, (size_t)512);
+        count += (h264_rbsp(nals[k].data, n, buffer, rbsp_size) != nals[k].data);
+        nbytes += n;
+      }
+    }
+    print_result("h264_rbsp 512", count, rx_hrtime() - start, nbytes * iterations);
+  }
+
+  /* ue(v) decoding */
+  std::vector<uint8_t> codes;
+  Random rnd(2);
+  size_t ncodes = write_ue_codes(rnd, codes, UE_COUNT);
+
+  {
+    uint64_t sum = 0;
+    uint64_t start = rx_hrtime();
+    for(int j = 0; j < iterations; ++j) {
+      RefBitReader br(&codes[0], codes.size());
+      for(size_t k = 0; k < ncodes; ++k) {
+        sum += br.readUe();
+      }
+    }
+    uint64_t duration = rx_hrtime() - start;
+    printf("%-18s codes: %10llu, time: %10.2f ms, %8.2f Mcodes/s (sum %llu)\n", "readUe bit by bit",
+           (unsigned long long)ncodes, duration / 1000000.0, (ncodes * iterations) / (duration / 1000.0), (unsigned long long)sum);
+  }
+
+  {
+    uint64_t sum = 0;
+    uint64_t start = rx_hrtime();
+    for(int j = 0; j < iterations; ++j) {
+      H264_BitReader br(&codes[0], codes.size());
+      for(size_t k = 0; k < ncodes; ++k) {
+        sum += br.readUe();
+      }
+    }
+    uint64_t duration = rx_hrtime() - start;
+    printf("%-18s codes: %10llu, time: %10.2f ms, %8.2f Mcodes/s (sum %llu)\n", "readUe cached",
+           (unsigned long long)ncodes, duration / 1000000.0, (ncodes * iterations) / (duration / 1000.0), (unsigned long long)sum);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+uint32_t RefBitReader::readBit() {
+
+  if(pos >= size * 8) {
+    error = true;
+    return 0;
+  }
+
+  uint32_t bit = (data[pos >> 3] >> (7 - (pos & 7))) & 0x01;
+  pos++;
+
+  return bit;
+}
+
+uint32_t RefBitReader::readBits(int n) {
+
+  uint32_t result = 0;
+
+  for(int i = 0; i < n; ++i) {
+    result = (result << 1) | readBit();
+  }
+
+  return result;
+}
+
+uint32_t RefBitReader::readUe() {
+
+  int leading_zeros = 0;
+
+  while(readBit() == 0) {
+
+    if(error) {
+      return 0;
+    }
+
+    if(++leading_zeros > 31) {
+      error = true;
+      return 0;
+    }
+  }
+
+  if(leading_zeros == 0) {
+    return 0;
+  }
+
+  return (uint32_t)(((uint64_t)1 << leading_zeros) - 1 + readBits(leading_zeros));
+}
+
+int32_t RefBitReader::readSe() {
+
+  uint32_t k = readUe();
+
+  if(k & 0x01) {
+    return (int32_t)((k + 1) >> 1);
+  }
+
+  return -(int32_t)(k >> 1);
+}
+
+void RefBitReader::skipBits(size_t n) {
+
+  if(n > bitsLeft()) {
+    pos = size * 8;
+    error = true;
+    return;
+  }
+
+  pos += n;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+static bool read_file(const char* filepath, std::vector<uint8_t>& result) {
+
+  FILE* fp = fopen(filepath, "rb");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath);
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  if(size <= 0) {
+    printf("Error: empty file: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  result.resize(size);
+
+  if(fread(&result[0], 1, size, fp) != (size_t)size) {
+    printf("Error: cannot read: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  fclose(fp);
+  return true;
+}
+
+/* mostly random bytes with runs of zeros and `00 00 03` sequences */
+static void fill_escaped(Random& rnd, uint8_t* data, size_t size) {
+
+  size_t i = 0;
+
+  while(i < size) {
+
+    uint32_t kind = rnd.below(8);
+
+    if(kind == 0 && i + 3 <= size) {
+      data[i++] = 0x00;
+      data[i++] = 0x00;
+      data[i++] = 0x03;
+    }
+    else if(kind == 1) {
+      data[i++] = 0x00;
+    }
+    else if(kind == 2) {
+      data[i++] = (uint8_t)rnd.below(4);
+    }
+    else {
+      data[i++] = (uint8_t)rnd.next();
+    }
+  }
+}
+
+static bool fuzz_unescape(uint64_t seed) {
+
+  Random rnd(seed);
+  size_t size = rnd.below(200);
+  size_t offset = rnd.below(32);                                                           /* unaligned starts */
+  std::vector<uint8_t> src(offset + size + 1);
+  std::vector<uint8_t> expected(size + 1);
+  std::vector<uint8_t> dest(size + 1);
+  std::vector<uint8_t> buffer;
+
+  fill_escaped(rnd, &src[offset], size);
+
+  size_t expected_size = h264_unescape_rbsp_c(&src[offset], size, &expected[0]);
+
+  struct {
+    const char* name;
+    h264_unescape_rbsp_func func;
+  } unescapers[] = {
+    { "sse2", h264_unescape_rbsp_sse2 },
+    { "avx2", h264_unescape_rbsp_avx2 },
+    { "dispatch", h264_unescape_rbsp },
+  };
+
+  for(size_t i = 0; i < sizeof(unescapers) / sizeof(unescapers[0]); ++i) {
+    if(unescapers[i].func == h264_unescape_rbsp_avx2 && !h264_cpu_has_avx2()) {
+      continue;
+    }
+    size_t n = unescapers[i].func(&src[offset], size, &dest[0]);
+    if(n != expected_size || memcmp(&dest[0], &expected[0], n) != 0) {
+      printf("Error: unescape %s differs from the reference, seed: %llu, size: %zu\n", unescapers[i].name, (unsigned long long)seed, size);
+      return false;
+    }
+  }
+
+  size_t rbsp_size = 0;
+  const uint8_t* rbsp = h264_rbsp(&src[offset], size, buffer, rbsp_size);
+
+  if(rbsp_size != expected_size || (rbsp_size && memcmp(rbsp, &expected[0], rbsp_size) != 0)) {
+    printf("Error: h264_rbsp differs from the reference, seed: %llu, size: %zu\n", (unsigned long long)seed, size);
+    return false;
+  }
+
+  if(rbsp_size == size && rbsp != &src[offset]) {
+    printf("Error: h264_rbsp copied data without emulation prevention bytes, seed: %llu\n", (unsigned long long)seed);
+    return false;
+  }
+
+  return true;
+}
+
+static bool fuzz_bitreader(uint64_t seed) {
+
+  Random rnd(seed);
+  size_t size = rnd.below(64);
+  std::vector<uint8_t> data(size + 1);
+
+  /* many zero bytes so we get long (and too long) ue(v) codes */
+  for(size_t i = 0; i < size; ++i) {
+    data[i] = (rnd.below(3) == 0) ? 0x00 : (uint8_t)(rnd.next() >> (rnd.below(8)));
+  }
+
+  RefBitReader ref(&data[0], size);
+  H264_BitReader br(&data[0], size);
+
+  for(int op_index = 0; op_index < 64; ++op_index) {
+
+    uint32_t op = rnd.below(6);
+    int64_t a = 0;
+    int64_t b = 0;
+
+    switch(op) {
+      case 0: {
+        int n = (int)rnd.below(33);
+        a = ref.readBits(n);
+        b = br.readBits(n);
+        break;
+      }
+      case 1: {
+        a = ref.readBit();
+        b = br.readBit();
+        break;
+      }
+      case 2: {
+        a = ref.readUe();
+        b = br.readUe();
+        break;
+      }
+      case 3: {
+        a = ref.readSe();
+        b = br.readSe();
+        break;
+      }
+      case 4: {
+        size_t n = rnd.below(100);
+        ref.skipBits(n);
+        br.skipBits(n);
+        break;
+      }
+      default: {
+        a = ref.bitsLeft();
+        b = br.bitsLeft();
+        break;
+      }
+    }
+
+    if(a != b || ref.error != br.error || ref.pos != br.position()) {
+      printf("Error: bit reader differs from the reference, seed: %llu, op: %d (%u), value: %lld vs %lld, error: %d vs %d, position: %zu vs %zu\n",
+             (unsigned long long)seed, op_index, op, (long long)a, (long long)b, ref.error, br.error, ref.pos, br.position());
+      return false;
+    }
+
+    /* the values after an error don't matter; parsers check the error flag and stop */
+    if(ref.error) {
+      break;
+    }
+  }
+
+  return true;
+}
+
+/* ue(v) codes of values with 0..24 significant bits, most of them small like in real headers */
+static size_t write_ue_codes(Random& rnd, std::vector<uint8_t>& result, size_t count) {
+
+  uint64_t acc = 0;
+  int acc_bits = 0;
+
+  result.clear();
+
+  for(size_t i = 0; i < count; ++i) {
+
+    uint32_t bits = (rnd.below(4) == 0) ? rnd.below(25) : rnd.below(5);
+    uint64_t value = (bits == 0) ? 0 : (rnd.next() & ((1u << bits) - 1));
+    uint64_t x = value + 1;
+    int len = 64 - __builtin_clzll(x);
+
+    /* len - 1 zeros followed by x in len bits */
+    acc = (acc << (2 * len - 1)) | x;
+    acc_bits += 2 * len - 1;
+
+    while(acc_bits >= 8) {
+      result.push_back((uint8_t)(acc >> (acc_bits - 8)));
+      acc_bits -= 8;
+    }
+  }
+
+  /* the stop bit */
+  acc = (acc << 1) | 1;
+  acc_bits++;
+  result.push_back((uint8_t)(acc << (8 - acc_bits)));
+
+  return count;
+}
+
+static void print_result(const char* name, uint64_t count, uint64_t duration, size_t nbytes) {
+
+  double seconds = duration / 1000000000.0;
+  double gbps = (seconds > 0.0) ? (nbytes / seconds) / (1000.0 * 1000.0 * 1000.0) : 0.0;
+
+  printf("%-18s count: %10llu, time: %10.2f ms, %8.3f GB/s\n",
+         name,
+         (unsigned long long)count,
+         duration / 1000000.0,
+         gbps);
+}
@@ -0,0 +1,124 @@
+/*
+
+  GOP split benchmark
+  -------------------
+
+  Compares the decode throughput of one H264_Decoder with frame threading
+  against H264_GopDecoder, which decodes ranges of GOPs in parallel, for the
+  same number of threads. Use a long file with regular IDRs; the GOP split
+  can't use more workers than the file has ranges (see H264_GOP_RANGE_FRAMES).
+  For the GOP split we also print the time until the first frame and the
+  most decoded frames that were in memory at once; `max_frames` limits
+  those (by default room for one range per worker).
+
+  Usage: ./gopsplit sample.h264 [threads] [max_frames]
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <H264_Decoder.h>
+#include <H264_GopDecoder.h>
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+static bool bench_frame_threads(const char* filepath, int numThreads);
+static bool bench_gop_split(const char* filepath, int numThreads, size_t maxFrames);
+static void print_result(const char* name, int numThreads, uint64_t frames, uint64_t duration);
+
+int main(int argc, char** argv) {
+
+  if(argc < 2) {
+    printf("Usage: %s file.h264 [threads] [max_frames]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int num_threads = (argc > 2) ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+  if(num_threads <= 0) {
+    num_threads = 1;
+  }
+
+  size_t max_frames = (argc > 3) ? (size_t)atoi(argv[3]) : 0;
+
+  if(!bench_frame_threads(argv[1], num_threads)) {
+    return EXIT_FAILURE;
+  }
+
+  if(!bench_gop_split(argv[1], num_threads, max_frames)) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+  uint64_t* frames = (uint64_t*)user;
+  *frames = *frames + 1;
+}
+
+static bool bench_frame_threads(const char* filepath, int numThreads) {
+
+  uint64_t frames = 0;
+  H264_Decoder decoder(on_frame, &frames);
+  H264_DecoderSettings settings;
+  settings.fps = -1.0f;
+  settings.thread_count = numThreads;
+  settings.thread_type = H264_THREAD_FRAME;
+
+  uint64_t start = rx_hrtime();
+
+  if(!decoder.load(filepath, settings)) {
+    return false;
+  }
+
+  while(!decoder.eof && !decoder.error) {
+    decoder.readFrame();
+  }
+
+  print_result("frame threads", numThreads, frames, rx_hrtime() - start);
+
+  return true;
+}
+
+static bool bench_gop_split(const char* filepath, int numThreads, size_t maxFrames) {
+
+  uint64_t frames = 0;
+  H264_GopDecoder decoder(on_frame, &frames);
+  H264_DecoderSettings settings;
+
+  /* builds the index on the first run; run twice to measure without it */
+  uint64_t start = rx_hrtime();
+
+  if(!decoder.load(filepath, settings, numThreads, maxFrames)) {
+    return false;
+  }
+
+  uint64_t first_frame = 0;
+
+  while(decoder.readFrame()) {
+    if(first_frame == 0) {
+      first_frame = rx_hrtime() - start;
+    }
+  }
+
+  print_result("gop split", (int)decoder.workers.size(), frames, rx_hrtime() - start);
+
+  printf("%-14s first frame after: %.2f ms, max frames in memory: %llu (limit %llu)\n",
+         "",
+         first_frame / 1000000.0,
+         (unsigned long long)decoder.peak_buffered_frames,
+         (unsigned long long)decoder.max_frames);
+
+  return true;
+}
+
+static void print_result(const char* name, int numThreads, uint64_t frames, uint64_t duration) {
+
+  double seconds = duration / 1000000000.0;
+  double fps = (seconds > 0.0) ? frames / seconds : 0.0;
+
+  printf("%-14s threads: %3d, frames: %8llu, time: %10.2f ms, %10.1f fps\n",
+         name,
+         numThreads,
+         (unsigned long long)frames,
+         duration / 1000000.0,
+         fps);
+}
@@ -0,0 +1,213 @@
+/*
+
+  Latency benchmark
+  -----------------
+
+  Simulates a live source: a thread writes the access units of the file into
+  a pipe at the given framerate and the decoder reads the other end (see
+  H264_FdSource). We decode the stream with the default settings (libav
+  parser, frame threading) and with the low latency profile and print the
+  p50/p99 latency of every stage (see H264_Latency). The total is the time
+  from reading the last byte of a frame until the callback returned, which is
+  what we add to the glass to glass latency. The low latency profile waits
+  `low_latency_idle_ms` after the last byte of a frame before it decodes it,
+  so that time is part of its total.
+
+  Build with `make TRACEFLAGS=-DROXLU_USE_TRACE latency` to also write the
+  timeline of the reader, writer and decoder threads to latency_trace.json
+  (see tinylib_trace.h).
+
+  Usage: ./latency sample.h264 [fps] [threads]
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include <H264_Decoder.h>
+#include <H264_AnnexB.h>
+
+struct LiveWriter {
+  const std::vector<uint8_t>* data;                                                      /* the file */
+  int fd;                                                                                /* write end of the pipe */
+  double fps;                                                                            /* access units per second */
+};
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+static bool read_file(const char* filepath, std::vector<uint8_t>& result);
+static void write_live(LiveWriter writer);
+static bool bench_live(const char* name, const std::vector<uint8_t>& data, double fps, H264_DecoderSettings settings);
+
+int main(int argc, char** argv) {
+
+  if(argc < 2) {
+    printf("Usage: %s file.h264 [fps] [threads]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  double fps = (argc > 2) ? atof(argv[2]) : 25.0;
+  int threads = (argc > 3) ? atoi(argv[3]) : 4;
+  std::vector<uint8_t> data;
+
+  if(fps <= 0.0) {
+    printf("Error: invalid framerate: %f\n", fps);
+    return EXIT_FAILURE;
+  }
+
+  if(!read_file(argv[1], data)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("File: %s, %.2f fps, %d threads\n", argv[1], fps, threads);
+
+  H264_DecoderSettings default_settings;
+  default_settings.pacing = H264_PACING_NONE;
+  default_settings.thread_count = threads;
+  default_settings.track_latency = true;
+
+  H264_DecoderSettings low_latency_settings;
+  low_latency_settings.thread_count = threads;
+  low_latency_settings.low_latency = true;
+
+  if(!bench_live("default", data, fps, default_settings)) {
+    return EXIT_FAILURE;
+  }
+
+  if(!bench_live("low latency", data, fps, low_latency_settings)) {
+    return EXIT_FAILURE;
+  }
+
+  if(!RX_TRACE_FLUSH("latency_trace.json")) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+  uint64_t* frames = (uint64_t*)user;
+  *frames = *frames + 1;
+}
+
+static bool read_file(const char* filepath, std::vector<uint8_t>& result) {
+
+  FILE* fp = fopen(filepath, "rb");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath);
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  if(size <= 0) {
+    printf("Error: empty file: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  result.resize(size);
+
+  if(fread(&result[0], 1, size, fp) != (size_t)size) {
+    printf("Error: cannot read: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  fclose(fp);
+  return true;
+}
+
+/* writes one access unit per frame duration, like an encoder would */
+static void write_live(LiveWriter writer) {
+
+  RX_TRACE_THREAD_NAME("live writer");
+
+  const std::vector<uint8_t>& data = *writer.data;
+  uint64_t frame_duration = (uint64_t)(1000000000.0 / writer.fps);
+  uint64_t start = rx_hrtime();
+  uint64_t count = 0;
+  size_t offset = 0;
+  H264_AnnexB au;
+
+  while(offset < data.size()) {
+
+    size_t nbytes = au.findAccessUnit(&data[offset], data.size() - offset, true);
+    if(nbytes == 0) {
+      break;
+    }
+
+    uint64_t deadline = start + count * frame_duration;
+    uint64_t now = rx_hrtime();
+
+    if(deadline > now) {
+      usleep((useconds_t)((deadline - now) / 1000));
+    }
+
+    RX_TRACE_INSTANT("write access unit");
+
+    size_t written = 0;
+    while(written < nbytes) {
+      ssize_t r = write(writer.fd, &data[offset + written], nbytes - written);
+      if(r <= 0) {
+        close(writer.fd);
+        return;
+      }
+      written += r;
+    }
+
+    offset += nbytes;
+    count += (au.vcl_type != 0) ? 1 : 0;
+  }
+
+  close(writer.fd);
+}
+
+static bool bench_live(const char* name, const std::vector<uint8_t>& data, double fps, H264_DecoderSettings settings) {
+
+  int fds[2];
+
+  if(pipe(fds) != 0) {
+    printf("Error: cannot create a pipe.\n");
+    return false;
+  }
+
+  H264_FdSource* source = new H264_FdSource();
+
+  if(!source->openDescriptor(fds[0], true)) {
+    delete source;
+    close(fds[1]);
+    return false;
+  }
+
+  uint64_t frames = 0;
+  H264_Decoder decoder(on_frame, &frames);
+
+  if(!decoder.load(source, settings)) {
+    close(fds[1]);
+    return false;
+  }
+
+  LiveWriter writer;
+  writer.data = &data;
+  writer.fd = fds[1];
+  writer.fps = fps;
+
+  std::thread writer_thread(write_live, writer);
+
+  while(!decoder.eof && !decoder.error) {
+    if(!decoder.readFrame() && !decoder.eof && !decoder.error) {
+      decoder.waitForInput(10);
+    }
+  }
+
+  writer_thread.join();
+
+  printf("%s: %llu frames, ", name, (unsigned long long)frames);
+  decoder.latency.print(stdout);
+
+  return true;
+}
@@ -0,0 +1,274 @@
+/*
+
+  Probe benchmark
+  ---------------
+
+  Prints what h264_probe() finds in a file and compares the time it takes
+  with the time H264_Decoder needs to load the file and decode the first
+  frame, which is what we used to do to get the resolution of a stream.
+  Before that we check that h264_parse_sps() and h264_parse_pps() reject
+  parameter sets with out of range values (e.g. ids that don't fit in an
+  int or shifts wider than 16 bits) instead of returning them.
+
+  Usage: ./probe sample.h264 [iterations]
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <H264_Decoder.h>
+#include <H264_Probe.h>
+
+/* writes the fields of the parameter sets we craft below, msb first */
+struct BitWriter {
+  BitWriter():acc(0),acc_bits(0) {}
+  void bit(uint32_t value);
+  void bits(uint64_t value, int n) { for(int i = n - 1; i >= 0; --i) { bit((value >> i) & 0x01); } }
+  void ue(uint32_t value);
+  void finish() { bit(1); while(acc_bits) { bit(0); } }                                  /* rbsp_trailing_bits */
+  std::vector<uint8_t> data;
+  uint32_t acc;
+  int acc_bits;
+};
+
+/* the field of a parameter set we replace with an invalid value */
+enum {
+  FIELD_NONE,
+  FIELD_SPS_ID,
+  FIELD_CHROMA_FORMAT_IDC,
+  FIELD_BIT_DEPTH_LUMA,
+  FIELD_BIT_DEPTH_CHROMA,
+  FIELD_LOG2_MAX_FRAME_NUM,
+  FIELD_POC_TYPE,
+  FIELD_LOG2_MAX_POC_LSB,
+  FIELD_MAX_NUM_REF_FRAMES,
+  FIELD_WIDTH,
+  FIELD_PPS_ID,
+  FIELD_PPS_SPS_ID,
+  FIELD_NUM_SLICE_GROUPS,
+  FIELD_NUM_REF_IDX,
+};
+
+static void write_sps(BitWriter& bw, int field, uint32_t value);
+static void write_pps(BitWriter& bw, int field, uint32_t value);
+static bool check_malformed_parameter_sets();
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+static void print_result(const char* name, int iterations, uint64_t duration);
+
+int main(int argc, char** argv) {
+
+  if(argc < 2) {
+    printf("Usage: %s file.h264 [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int iterations = (argc > 2) ? atoi(argv[2]) : 1000;
+  H264_ProbeInfo info;
+
+  if(!check_malformed_parameter_sets()) {
+    return EXIT_FAILURE;
+  }
+
+  if(!h264_probe(argv[1], info)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("File: %s\n", argv[1]);
+  printf("  codec:      %s (profile %d, level %d)\n", info.codec, info.sps.profile_idc, info.sps.level_idc);
+  printf("  size:       %dx%d (coded %dx%d)\n", info.width, info.height, info.sps.pic_width_in_mbs * 16, info.sps.pic_height_in_map_units * 16 * (2 - info.sps.frame_mbs_only_flag));
+  printf("  chroma:     %d, bit depth: %d\n", info.sps.chroma_format_idc, info.sps.bit_depth_luma);
+  printf("  fps:        %.3f\n", info.fps);
+  printf("  entropy:    %s\n", (info.has_pps && info.pps.entropy_coding_mode_flag) ? "CABAC" : "CAVLC");
+
+  uint64_t start = rx_hrtime();
+
+  for(int i = 0; i < iterations; ++i) {
+    if(!h264_probe(argv[1], info)) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  print_result("h264_probe", iterations, rx_hrtime() - start);
+
+  /* the decoder is much slower; a tenth of the iterations is enough */
+  int decoder_iterations = (iterations / 10 > 0) ? iterations / 10 : 1;
+  H264_DecoderSettings settings;
+  settings.fps = -1.0f;
+  start = rx_hrtime();
+
+  for(int i = 0; i < decoder_iterations; ++i) {
+
+    uint64_t frames = 0;
+    H264_Decoder decoder(on_frame, &frames);
+
+    if(!decoder.load(argv[1], settings)) {
+      return EXIT_FAILURE;
+    }
+
+    while(frames == 0 && !decoder.eof && !decoder.error) {
+      decoder.readFrame();
+    }
+  }
+
+  print_result("first frame", decoder_iterations, rx_hrtime() - start);
+
+  return EXIT_SUCCESS;
+}
+
+/* a 1080p high profile SPS; `field` gets `value` instead of its valid value */
+static void write_sps(BitWriter& bw, int field, uint32_t value) {
+
+  bw.bits(100, 8);                                                                       /* profile_idc */
+  bw.bits(0, 8);                                                                         /* constraint flags */
+  bw.bits(40, 8);                                                                        /* level_idc */
+  bw.ue((field == FIELD_SPS_ID) ? value : 0);
+  bw.ue((field == FIELD_CHROMA_FORMAT_IDC) ? value : 1);
+  bw.ue((field == FIELD_BIT_DEPTH_LUMA) ? value : 0);
+  bw.ue((field == FIELD_BIT_DEPTH_CHROMA) ? value : 0);
+  bw.bit(0);                                                                             /* qpprime_y_zero_transform_bypass_flag */
+  bw.bit(0);                                                                             /* seq_scaling_matrix_present_flag */
+  bw.ue((field == FIELD_LOG2_MAX_FRAME_NUM) ? value : 0);
+  bw.ue((field == FIELD_POC_TYPE) ? value : 0);
+  bw.ue((field == FIELD_LOG2_MAX_POC_LSB) ? value : 2);
+  bw.ue((field == FIELD_MAX_NUM_REF_FRAMES) ? value : 4);
+  bw.bit(0);                                                                             /* gaps_in_frame_num_value_allowed_flag */
+  bw.ue((field == FIELD_WIDTH) ? value : 119);
+  bw.ue(67);                                                                             /* pic_height_in_map_units_minus1 */
+  bw.bit(1);                                                                             /* frame_mbs_only_flag */
+  bw.bit(1);                                                                             /* direct_8x8_inference_flag */
+  bw.bit(1);                                                                             /* frame_cropping_flag */
+  bw.ue(0);
+  bw.ue(0);
+  bw.ue(0);
+  bw.ue(4);                                                                              /* 1088 -> 1080 */
+  bw.bit(0);                                                                             /* vui_parameters_present_flag */
+  bw.finish();
+}
+
+static void write_pps(BitWriter& bw, int field, uint32_t value) {
+
+  bw.ue((field == FIELD_PPS_ID) ? value : 0);
+  bw.ue((field == FIELD_PPS_SPS_ID) ? value : 0);
+  bw.bit(1);                                                                             /* entropy_coding_mode_flag */
+  bw.bit(0);                                                                             /* bottom_field_pic_order_in_frame_present_flag */
+  bw.ue((field == FIELD_NUM_SLICE_GROUPS) ? value : 0);
+  bw.ue((field == FIELD_NUM_REF_IDX) ? value : 2);
+  bw.ue(0);                                                                              /* num_ref_idx_l1_default_active_minus1 */
+  bw.bit(0);                                                                             /* weighted_pred_flag */
+  bw.bits(0, 2);                                                                         /* weighted_bipred_idc */
+  bw.ue(0);                                                                              /* pic_init_qp_minus26 */
+  bw.ue(0);                                                                              /* pic_init_qs_minus26 */
+  bw.ue(0);                                                                              /* chroma_qp_index_offset */
+  bw.bit(1);                                                                             /* deblocking_filter_control_present_flag */
+  bw.bit(0);                                                                             /* constrained_intra_pred_flag */
+  bw.bit(0);                                                                             /* redundant_pic_cnt_present_flag */
+  bw.finish();
+}
+
+static bool check_malformed_parameter_sets() {
+
+  struct {
+    int field;
+    uint32_t value;
+    bool is_sps;
+  } cases[] = {
+    { FIELD_SPS_ID, 32, true },
+    { FIELD_SPS_ID, 0x80000000u, true },                                                 /* negative when stored in an int */
+    { FIELD_CHROMA_FORMAT_IDC, 4, true },
+    { FIELD_CHROMA_FORMAT_IDC, 0xFFFFFFFEu, true },
+    { FIELD_BIT_DEPTH_LUMA, 7, true },
+    { FIELD_BIT_DEPTH_CHROMA, 0x80000000u, true },
+    { FIELD_LOG2_MAX_FRAME_NUM, 13, true },                                              /* frame_num would be 17 bits */
+    { FIELD_LOG2_MAX_FRAME_NUM, 0xFFFFFFFCu, true },                                     /* 4 + value wraps to 0 */
+    { FIELD_POC_TYPE, 3, true },
+    { FIELD_POC_TYPE, 0x80000000u, true },
+    { FIELD_LOG2_MAX_POC_LSB, 13, true },
+    { FIELD_LOG2_MAX_POC_LSB, 0xFFFFFFFCu, true },
+    { FIELD_MAX_NUM_REF_FRAMES, 0x80000000u, true },
+    { FIELD_WIDTH, 0xFFFFFFFEu, true },
+    { FIELD_PPS_ID, 256, false },
+    { FIELD_PPS_ID, 0x80000000u, false },
+    { FIELD_PPS_SPS_ID, 0x80000000u, false },
+    { FIELD_NUM_SLICE_GROUPS, 0xFFFFFFFEu, false },
+    { FIELD_NUM_REF_IDX, 0x80000000u, false },
+  };
+
+  H264_Sps sps;
+  H264_Pps pps;
+
+  /* the valid sets must parse, otherwise the cases below prove nothing */
+  {
+    BitWriter sps_writer;
+    BitWriter pps_writer;
+    write_sps(sps_writer, FIELD_NONE, 0);
+    write_pps(pps_writer, FIELD_NONE, 0);
+    if(!h264_parse_sps(&sps_writer.data[0], sps_writer.data.size(), sps) || sps.width != 1920 || sps.height != 1080
+       || !h264_parse_pps(&pps_writer.data[0], pps_writer.data.size(), pps) || pps.num_ref_idx_l0_default_active != 3) {
+      printf("Error: the valid parameter sets of the malformed checks don't parse.\n");
+      return false;
+    }
+  }
+
+  size_t count = sizeof(cases) / sizeof(cases[0]);
+
+  for(size_t i = 0; i < count; ++i) {
+
+    BitWriter bw;
+    bool parsed = false;
+
+    if(cases[i].is_sps) {
+      write_sps(bw, cases[i].field, cases[i].value);
+      parsed = h264_parse_sps(&bw.data[0], bw.data.size(), sps);
+    }
+    else {
+      write_pps(bw, cases[i].field, cases[i].value);
+      parsed = h264_parse_pps(&bw.data[0], bw.data.size(), pps);
+    }
+
+    if(parsed) {
+      printf("Error: malformed parameter set %zu (value %u) was accepted.\n", i, cases[i].value);
+      return false;
+    }
+  }
+
+  printf("Malformed: %zu parameter sets rejected\n", count);
+
+  return true;
+}
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+  uint64_t* frames = (uint64_t*)user;
+  *frames = *frames + 1;
+}
+
+void BitWriter::bit(uint32_t value) {
+
+  acc = (acc << 1) | value;
+
+  if(++acc_bits == 8) {
+    data.push_back((uint8_t)acc);
+    acc = 0;
+    acc_bits = 0;
+  }
+}
+
+/* len - 1 zeros followed by value + 1 in len bits */
+void BitWriter::ue(uint32_t value) {
+
+  uint64_t x = (uint64_t)value + 1;
+  int len = 64 - __builtin_clzll(x);
+
+  bits(0, len - 1);
+  bits(x, len);
+}
+
+static void print_result(const char* name, int iterations, uint64_t duration) {
+
+  double per_file = (iterations) ? double(duration) / iterations : 0.0;
+
+  printf("%-14s iterations: %6d, time: %10.2f ms, %10.1f us/file\n",
+         name,
+         iterations,
+         duration / 1000000.0,
+         per_file / 1000.0);
+}
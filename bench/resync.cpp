@@ -0,0 +1,185 @@
+/*
+
+  Resync benchmark
+  ----------------
+
+  Damages a copy of the file (random bytes in the slice data of every Nth
+  access unit) and decodes it with and without
+  `H264_DecoderSettings::resilient`, for both framings. Prints the decode
+  time, the number of frames, decode errors and resyncs and what we dropped.
+  libav conceals many errors without reporting them, so not every damaged
+  access unit causes a resync.
+
+  Usage: ./resync sample.h264 [every_nth_access_unit]
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <H264_Decoder.h>
+#include <H264_AnnexB.h>
+
+#define DAMAGE_SIZE 64                                                                   /* number of bytes we overwrite in a damaged access unit */
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+static bool damage_file(const char* filepath, const char* outpath, int nth, int& damaged);
+static bool bench_decode(const char* name, const char* filepath, int framing, bool resilient);
+
+int main(int argc, char** argv) {
+
+  if(argc < 2) {
+    printf("Usage: %s file.h264 [every_nth_access_unit]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int nth = (argc > 2) ? atoi(argv[2]) : 50;
+  std::string damaged_path = std::string(argv[1]) + ".damaged";
+  int damaged = 0;
+
+  if(nth <= 0) {
+    printf("Error: invalid interval: %d\n", nth);
+    return EXIT_FAILURE;
+  }
+
+  if(!damage_file(argv[1], damaged_path.c_str(), nth, damaged)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("File: %s, damaged %d access units (1 in %d): %s\n", argv[1], damaged, nth, damaged_path.c_str());
+
+  bool ok = bench_decode("parser", damaged_path.c_str(), H264_FRAMING_PARSER, false)
+         && bench_decode("parser resilient", damaged_path.c_str(), H264_FRAMING_PARSER, true)
+         && bench_decode("annexb", damaged_path.c_str(), H264_FRAMING_ANNEXB, false)
+         && bench_decode("annexb resilient", damaged_path.c_str(), H264_FRAMING_ANNEXB, true);
+
+  remove(damaged_path.c_str());
+
+  return (ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+  uint64_t* frames = (uint64_t*)user;
+  *frames = *frames + 1;
+}
+
+static bool damage_file(const char* filepath, const char* outpath, int nth, int& damaged) {
+
+  FILE* fp = fopen(filepath, "rb");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath);
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  if(size <= 0) {
+    printf("Error: empty file: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  std::vector<uint8_t> data(size);
+
+  if(fread(&data[0], 1, size, fp) != (size_t)size) {
+    printf("Error: cannot read: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  fclose(fp);
+
+  H264_AnnexB au;
+  size_t offset = 0;
+  int count = 0;
+
+  srand(1);
+  damaged = 0;
+
+  while(offset < data.size()) {
+
+    size_t nbytes = au.findAccessUnit(&data[offset], data.size() - offset, true);
+    if(nbytes == 0) {
+      break;
+    }
+
+    /* we keep the IDRs intact, so there is something to resync to */
+    if(++count % nth == 0 && !au.is_idr && au.vcl_type != 0) {
+
+      const uint8_t* p = &data[offset];
+      const uint8_t* end = p + nbytes;
+      H264_Nal nal;
+
+      while(h264_next_nal(p, end, nal)) {
+
+        if(!h264_is_vcl(nal.type) || nal.size < DAMAGE_SIZE * 2) {
+          continue;
+        }
+
+        /* behind the slice header; no zeros, so we don't create start codes */
+        uint8_t* dest = (uint8_t*)nal.data + nal.size / 2;
+        for(int i = 0; i < DAMAGE_SIZE; ++i) {
+          dest[i] = (uint8_t)(1 + rand() % 255);
+        }
+
+        damaged++;
+        break;
+      }
+    }
+
+    offset += nbytes;
+  }
+
+  fp = fopen(outpath, "wb");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", outpath);
+    return false;
+  }
+
+  if(fwrite(&data[0], 1, data.size(), fp) != data.size()) {
+    printf("Error: cannot write: %s\n", outpath);
+    fclose(fp);
+    return false;
+  }
+
+  fclose(fp);
+
+  return true;
+}
+
+static bool bench_decode(const char* name, const char* filepath, int framing, bool resilient) {
+
+  uint64_t frames = 0;
+  H264_Decoder decoder(on_frame, &frames);
+  H264_DecoderSettings settings;
+
+  settings.fps = -1.0f;
+  settings.framing = framing;
+  settings.resilient = resilient;
+
+  uint64_t start = rx_hrtime();
+
+  if(!decoder.load(filepath, settings)) {
+    return false;
+  }
+
+  while(!decoder.eof && !decoder.error) {
+    decoder.readFrame();
+  }
+
+  uint64_t duration = rx_hrtime() - start;
+
+  printf("%-18s time: %8.2f ms, frames: %6llu, errors: %4llu, resyncs: %4llu, dropped: %6llu frames, %10llu bytes\n",
+         name,
+         duration / 1000000.0,
+         (unsigned long long)frames,
+         (unsigned long long)decoder.decode_errors,
+         (unsigned long long)decoder.resync_count,
+         (unsigned long long)decoder.error_dropped_frames,
+         (unsigned long long)decoder.error_dropped_bytes);
+
+  return true;
+}
@@ -0,0 +1,186 @@
+/*
+
+  Ring buffer benchmark
+  ---------------------
+
+  Compares the bitstream buffering that H264_Decoder used to do (append to a
+  std::vector and erase the parsed bytes from the front) with the in place
+  parsing using H264_RingBuffer and the H264_INPUT_MMAP mode. All paths parse 
+  and decode the whole file and we report the number of bytes that were 
+  moved/copied per decoded frame.
+
+  Usage: ./ringbuffer sample.h264
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <H264_Decoder.h>
+
+struct BenchResult {
+  uint64_t frames;
+  uint64_t bytes_moved;                                                                  /* bytes moved around inside the buffer (memmove) */
+  uint64_t bytes_copied;                                                                 /* bytes copied from the read chunk into the buffer */
+  uint64_t duration;                                                                     /* in ns */
+};
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+static bool bench_vector(const char* filepath, BenchResult& result);
+static bool bench_decoder(const char* filepath, int inputMode, BenchResult& result);
+static void print_result(const char* name, BenchResult& result);
+
+int main(int argc, char** argv) {
+
+  if(argc < 2) {
+    printf("Usage: %s file.h264\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  avcodec_register_all();
+
+  BenchResult vec_result = { 0 };
+  BenchResult ring_result = { 0 };
+  BenchResult mmap_result = { 0 };
+
+  if(!bench_vector(argv[1], vec_result)) {
+    return EXIT_FAILURE;
+  }
+
+  if(!bench_decoder(argv[1], H264_INPUT_STREAM, ring_result)) {
+    return EXIT_FAILURE;
+  }
+
+  if(!bench_decoder(argv[1], H264_INPUT_MMAP, mmap_result)) {
+    return EXIT_FAILURE;
+  }
+
+  print_result("vector+erase", vec_result);
+  print_result("ringbuffer", ring_result);
+  print_result("mmap", mmap_result);
+
+  return EXIT_SUCCESS;
+}
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+  uint64_t* frames = (uint64_t*)user;
+  *frames = *frames + 1;
+}
+
+/* the buffering strategy H264_Decoder used before the ring buffer */
+static bool bench_vector(const char* filepath, BenchResult& result) {
+
+  uint8_t inbuf[H264_INBUF_SIZE + FF_INPUT_BUFFER_PADDING_SIZE];
+  std::vector<uint8_t> buffer;
+  AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+  AVCodecContext* codec_context = avcodec_alloc_context3(codec);
+  AVCodecParserContext* parser = av_parser_init(AV_CODEC_ID_H264);
+  AVFrame* picture = av_frame_alloc();
+  AVPacket pkt;
+  int got_picture = 0;
+
+  if(avcodec_open2(codec_context, codec, NULL) < 0) {
+    printf("Error: could not open codec.\n");
+    return false;
+  }
+
+  FILE* fp = fopen(filepath, "rb");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath);
+    return false;
+  }
+
+  uint64_t start = rx_hrtime();
+
+  while(true) {
+
+    int bytes_read = (int)fread(inbuf, 1, H264_INBUF_SIZE, fp);
+    if(bytes_read == 0) {
+      break;
+    }
+
+    std::copy(inbuf, inbuf + bytes_read, std::back_inserter(buffer));
+    result.bytes_copied += bytes_read;
+
+    while(buffer.size()) {
+
+      uint8_t* data = NULL;
+      int size = 0;
+      buffer.reserve(buffer.size() + FF_INPUT_BUFFER_PADDING_SIZE);
+      int len = av_parser_parse2(parser, codec_context, &data, &size,
+                                 &buffer[0], buffer.size(), 0, 0, AV_NOPTS_VALUE);
+      if(len < 0) {
+        break;
+      }
+
+      if(size > 0) {
+        av_init_packet(&pkt);
+        pkt.data = data;
+        pkt.size = size;
+        avcodec_decode_video2(codec_context, picture, &got_picture, &pkt);
+        if(got_picture) {
+          result.frames++;
+        }
+      }
+
+      buffer.erase(buffer.begin(), buffer.begin() + len);
+      result.bytes_moved += buffer.size();
+    }
+  }
+
+  result.duration = rx_hrtime() - start;
+
+  fclose(fp);
+  av_parser_close(parser);
+  avcodec_close(codec_context);
+  av_free(codec_context);
+  av_frame_free(&picture);
+
+  return true;
+}
+
+static bool bench_decoder(const char* filepath, int inputMode, BenchResult& result) {
+
+  H264_Decoder decoder(on_frame, &result.frames);
+  H264_DecoderSettings settings;
+  settings.fps = -1.0f;
+  settings.input_mode = inputMode;
+
+  if(!decoder.load(filepath, settings)) {
+    return false;
+  }
+
+  uint64_t start = rx_hrtime();
+
+  while(!decoder.eof && !decoder.error) {
+    decoder.readFrame();
+  }
+
+  result.duration = rx_hrtime() - start;
+
+  /* 
+     we fread() directly into the ring buffer and never move parsed bytes; 
+     when using mmap we only copy the last bytes of the file 
+  */
+  result.bytes_moved = 0;
+  result.bytes_copied = (inputMode == H264_INPUT_MMAP) ? (decoder.map_size - decoder.map_tail_offset) : 0;
+
+  return true;
+}
+
+static void print_result(const char* name, BenchResult& result) {
+
+  double per_frame_moved = 0.0;
+  double per_frame_copied = 0.0;
+
+  if(result.frames) {
+    per_frame_moved = double(result.bytes_moved) / result.frames;
+    per_frame_copied = double(result.bytes_copied) / result.frames;
+  }
+
+  printf("%-14s frames: %8llu, moved: %12llu bytes (%10.1f/frame), copied: %12llu bytes (%10.1f/frame), time: %8.2f ms\n",
+         name,
+         (unsigned long long)result.frames,
+         (unsigned long long)result.bytes_moved, per_frame_moved,
+         (unsigned long long)result.bytes_copied, per_frame_copied,
+         result.duration / 1000000.0);
+}
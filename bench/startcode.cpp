@@ -0,0 +1,205 @@
+/*
+
+  Start code scanner benchmark
+  ----------------------------
+
+  Measures the throughput (GB/s) of the start code scanner implementations in
+  H264_AnnexB.cpp, of the access unit splitter and of the libav parser
+  (av_parser_parse2) that H264_Decoder uses by default. The whole file is read
+  into memory first so we only measure the scanning.
+
+  Usage: ./startcode sample.h264 [iterations]
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <H264_Decoder.h>
+#include <H264_AnnexB.h>
+
+static bool read_file(const char* filepath, std::vector<uint8_t>& result);
+static uint64_t count_startcodes(h264_find_startcode_func func, const uint8_t* data, size_t size);
+static uint64_t count_access_units(const uint8_t* data, size_t size);
+static uint64_t count_parser_packets(const uint8_t* data, size_t size);
+static void print_result(const char* name, uint64_t count, uint64_t duration, size_t nbytes);
+
+int main(int argc, char** argv) {
+
+  if(argc < 2) {
+    printf("Usage: %s file.h264 [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int iterations = (argc > 2) ? atoi(argv[2]) : 10;
+  std::vector<uint8_t> file;
+
+  if(!read_file(argv[1], file)) {
+    return EXIT_FAILURE;
+  }
+
+  avcodec_register_all();
+
+  const uint8_t* data = &file[0];
+  size_t size = file.size() - FF_INPUT_BUFFER_PADDING_SIZE;
+  size_t total = size * iterations;
+
+  struct {
+    const char* name;
+    h264_find_startcode_func func;
+  } scanners[] = {
+    { "startcode c", h264_find_startcode_c },
+    { "startcode sse2", h264_find_startcode_sse2 },
+    { "startcode avx2", h264_find_startcode_avx2 },
+  };
+
+  printf("File: %s, %zu bytes, %d iterations, dispatch: %s\n", argv[1], size, iterations, h264_find_startcode_name());
+
+  for(size_t i = 0; i < sizeof(scanners) / sizeof(scanners[0]); ++i) {
+    if(scanners[i].func == h264_find_startcode_avx2 && !h264_cpu_has_avx2()) {
+      continue;
+    }
+    uint64_t count = 0;
+    uint64_t start = rx_hrtime();
+    for(int j = 0; j < iterations; ++j) {
+      count = count_startcodes(scanners[i].func, data, size);
+    }
+    print_result(scanners[i].name, count, rx_hrtime() - start, total);
+  }
+
+  {
+    uint64_t count = 0;
+    uint64_t start = rx_hrtime();
+    for(int j = 0; j < iterations; ++j) {
+      count = count_access_units(data, size);
+    }
+    print_result("access units", count, rx_hrtime() - start, total);
+  }
+
+  {
+    uint64_t count = 0;
+    uint64_t start = rx_hrtime();
+    for(int j = 0; j < iterations; ++j) {
+      count = count_parser_packets(data, size);
+    }
+    print_result("av_parser_parse2", count, rx_hrtime() - start, total);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static bool read_file(const char* filepath, std::vector<uint8_t>& result) {
+
+  FILE* fp = fopen(filepath, "rb");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath);
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  if(size <= 0) {
+    printf("Error: empty file: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  result.assign(size + FF_INPUT_BUFFER_PADDING_SIZE, 0x00);
+
+  if(fread(&result[0], 1, size, fp) != (size_t)size) {
+    printf("Error: cannot read: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  fclose(fp);
+  return true;
+}
+
+static uint64_t count_startcodes(h264_find_startcode_func func, const uint8_t* data, size_t size) {
+
+  const uint8_t* end = data + size;
+  const uint8_t* p = data;
+  uint64_t count = 0;
+
+  while(true) {
+    p = func(p, end);
+    if(p == end) {
+      break;
+    }
+    count++;
+    p += 3;
+  }
+
+  return count;
+}
+
+static uint64_t count_access_units(const uint8_t* data, size_t size) {
+
+  H264_AnnexB au;
+  uint64_t count = 0;
+  size_t offset = 0;
+
+  while(offset < size) {
+    size_t nbytes = au.findAccessUnit(data + offset, size - offset, true);
+    if(nbytes == 0) {
+      break;
+    }
+    offset += nbytes;
+    count++;
+  }
+
+  return count;
+}
+
+static uint64_t count_parser_packets(const uint8_t* data, size_t size) {
+
+  AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+  AVCodecContext* codec_context = avcodec_alloc_context3(codec);
+  AVCodecParserContext* parser = av_parser_init(AV_CODEC_ID_H264);
+  uint64_t count = 0;
+  size_t offset = 0;
+
+  while(true) {
+
+    uint8_t* pkt_data = NULL;
+    int pkt_size = 0;
+    int nbytes = (int)std::min(size - offset, (size_t)H264_MMAP_CHUNK_SIZE);
+    int len = av_parser_parse2(parser, codec_context, &pkt_data, &pkt_size,
+                               (nbytes > 0) ? data + offset : NULL, nbytes, 0, 0, AV_NOPTS_VALUE);
+
+    if(pkt_size > 0) {
+      count++;
+    }
+
+    if(nbytes == 0) {
+      break;
+    }
+
+    if(len < 0) {
+      break;
+    }
+
+    offset += len;
+  }
+
+  av_parser_close(parser);
+  av_free(codec_context);
+
+  return count;
+}
+
+static void print_result(const char* name, uint64_t count, uint64_t duration, size_t nbytes) {
+
+  double seconds = duration / 1000000000.0;
+  double gbps = (seconds > 0.0) ? (nbytes / seconds) / (1000.0 * 1000.0 * 1000.0) : 0.0;
+
+  printf("%-18s count: %10llu, time: %10.2f ms, %8.3f GB/s\n",
+         name,
+         (unsigned long long)count,
+         duration / 1000000.0,
+         gbps);
+}
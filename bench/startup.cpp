@@ -0,0 +1,150 @@
+/*
+
+  Startup benchmark
+  -----------------
+
+  Measures the per file startup cost of H264_Decoder: the time from load()
+  until the callback receives the first frame. The cold path creates a new
+  decoder for every file (which opens a new codec context and parser), the
+  warm path uses one decoder and reload(), which reuses the open codec
+  context. Run it on a short clip to see how much of a file the startup is.
+
+  Usage: ./startup sample.h264 [iterations]
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <H264_Decoder.h>
+
+struct BenchResult {
+  uint64_t total;                                                                        /* sum of the startup times (ns) */
+  uint64_t min;                                                                          /* fastest startup (ns) */
+  uint64_t max;                                                                          /* slowest startup (ns) */
+  int iterations;                                                                        /* number of files we loaded */
+};
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+static bool wait_first_frame(H264_Decoder& decoder, uint64_t& frames);
+static bool bench_cold(const char* filepath, int iterations, BenchResult& result);
+static bool bench_warm(const char* filepath, int iterations, BenchResult& result);
+static void add_sample(BenchResult& result, uint64_t duration);
+static void print_result(const char* name, BenchResult& result);
+
+int main(int argc, char** argv) {
+
+  if(argc < 2) {
+    printf("Usage: %s file.h264 [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int iterations = (argc > 2) ? atoi(argv[2]) : 100;
+  BenchResult cold_result = { 0 };
+  BenchResult warm_result = { 0 };
+
+  if(!bench_cold(argv[1], iterations, cold_result)) {
+    return EXIT_FAILURE;
+  }
+
+  if(!bench_warm(argv[1], iterations, warm_result)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("File: %s, %d iterations\n", argv[1], iterations);
+  print_result("cold (new decoder)", cold_result);
+  print_result("warm (reload)", warm_result);
+
+  return EXIT_SUCCESS;
+}
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+  uint64_t* frames = (uint64_t*)user;
+  *frames = *frames + 1;
+}
+
+static bool wait_first_frame(H264_Decoder& decoder, uint64_t& frames) {
+
+  while(frames == 0) {
+    if(!decoder.readFrame() && (decoder.eof || decoder.error)) {
+      printf("Error: the file has no frames.\n");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool bench_cold(const char* filepath, int iterations, BenchResult& result) {
+
+  H264_DecoderSettings settings;
+  settings.fps = -1.0f;
+
+  for(int i = 0; i < iterations; ++i) {
+
+    uint64_t frames = 0;
+    uint64_t start = rx_hrtime();
+    H264_Decoder* decoder = new H264_Decoder(on_frame, &frames);
+
+    if(!decoder->load(filepath, settings) || !wait_first_frame(*decoder, frames)) {
+      delete decoder;
+      return false;
+    }
+
+    add_sample(result, rx_hrtime() - start);
+
+    delete decoder;
+  }
+
+  return true;
+}
+
+static bool bench_warm(const char* filepath, int iterations, BenchResult& result) {
+
+  uint64_t frames = 0;
+  H264_Decoder decoder(on_frame, &frames);
+  H264_DecoderSettings settings;
+  settings.fps = -1.0f;
+
+  /* the first load opens the codec; this is what the cold path measures */
+  if(!decoder.load(filepath, settings)) {
+    return false;
+  }
+
+  for(int i = 0; i < iterations; ++i) {
+
+    frames = 0;
+    uint64_t start = rx_hrtime();
+
+    if(!decoder.reload(filepath) || !wait_first_frame(decoder, frames)) {
+      return false;
+    }
+
+    add_sample(result, rx_hrtime() - start);
+  }
+
+  return true;
+}
+
+static void add_sample(BenchResult& result, uint64_t duration) {
+
+  if(result.iterations == 0 || duration < result.min) {
+    result.min = duration;
+  }
+
+  if(duration > result.max) {
+    result.max = duration;
+  }
+
+  result.total += duration;
+  result.iterations++;
+}
+
+static void print_result(const char* name, BenchResult& result) {
+
+  double avg = (result.iterations) ? double(result.total) / result.iterations : 0.0;
+
+  printf("%-20s startup avg: %10.1f us, min: %10.1f us, max: %10.1f us\n",
+         name,
+         avg / 1000.0,
+         result.min / 1000.0,
+         result.max / 1000.0);
+}
@@ -0,0 +1,109 @@
+/*
+
+  Stats benchmark
+  ---------------
+
+  Decodes the file and prints the counters and the p50/p99/max of every
+  stage (see H264_Stats), followed by the snapshot in the JSON and the
+  Prometheus format. It also measures what the recorder costs: the time of
+  one `addTime()` call and of one `stats()` snapshot.
+
+  Usage: ./stats sample.h264 [output.prom|output.json]
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <H264_Decoder.h>
+
+#define OVERHEAD_CALLS 10000000                                                          /* number of addTime() calls we time */
+#define SNAPSHOT_CALLS 100000                                                            /* number of snapshots we time */
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+static void print_overhead();
+
+int main(int argc, char** argv) {
+
+  if(argc < 2) {
+    printf("Usage: %s file.h264 [output.prom|output.json]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t frames = 0;
+  H264_Decoder decoder(on_frame, &frames);
+  H264_DecoderSettings settings;
+
+  settings.fps = -1.0f;
+  settings.stats_name = "bench";
+
+  if(argc > 2) {
+    settings.stats_path = argv[2];
+    settings.stats_interval = 100;
+  }
+
+  if(!decoder.load(argv[1], settings)) {
+    return EXIT_FAILURE;
+  }
+
+  while(!decoder.eof && !decoder.error) {
+    decoder.readFrame();
+  }
+
+  H264_DecoderStats stats = decoder.stats();
+
+  printf("File: %s, %llu frames, %llu packets, %llu bytes in %llu reads, errors: %llu read, %llu parse, %llu decode\n",
+         argv[1],
+         (unsigned long long)stats.frames,
+         (unsigned long long)stats.packets,
+         (unsigned long long)stats.bytes_read,
+         (unsigned long long)stats.reads,
+         (unsigned long long)stats.read_errors,
+         (unsigned long long)stats.parse_errors,
+         (unsigned long long)stats.decode_errors);
+
+  for(int i = 0; i < H264_STAGE_COUNT; ++i) {
+    const H264_Histogram& h = stats.stages[i];
+    printf("%-9s calls: %8llu, total: %9.2f ms, p50: < %9.2f us, p99: < %9.2f us, max: %9.2f us\n",
+           h264_stage_name(i),
+           (unsigned long long)h.count,
+           h.sum / 1000000.0,
+           h.percentile(0.5) / 1000.0,
+           h.percentile(0.99) / 1000.0,
+           h.max / 1000.0);
+  }
+
+  print_overhead();
+
+  printf("\n");
+  h264_write_stats_json(stdout, stats);
+  printf("\n");
+  h264_write_stats_prometheus(stdout, stats, "bench");
+
+  return EXIT_SUCCESS;
+}
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+  uint64_t* frames = (uint64_t*)user;
+  *frames = *frames + 1;
+}
+
+static void print_overhead() {
+
+  H264_StatsRecorder recorder;
+  H264_DecoderStats snapshot;
+
+  uint64_t start = rx_hrtime();
+  for(uint64_t i = 0; i < OVERHEAD_CALLS; ++i) {
+    recorder.addTime(H264_STAGE_DECODE, i);
+  }
+  uint64_t add_time = rx_hrtime() - start;
+
+  start = rx_hrtime();
+  for(int i = 0; i < SNAPSHOT_CALLS; ++i) {
+    recorder.snapshot(snapshot);
+  }
+  uint64_t snapshot_time = rx_hrtime() - start;
+
+  printf("Overhead: addTime(): %.2f ns, stats(): %.2f us\n",
+         (double)add_time / OVERHEAD_CALLS,
+         (double)snapshot_time / SNAPSHOT_CALLS / 1000.0);
+}
@@ -0,0 +1,718 @@
+/*
+
+  Throughput benchmark
+  --------------------
+
+  The benchmark every performance change is measured with. For every file
+  we measure:
+
+      parser_annexb/GBps         our access unit splitter (H264_AnnexB) on the file in memory
+      parser_libav/GBps          av_parser_parse2() on the file in memory
+      startup/ms                 load() until the callback got the first frame, new decoder
+      decode_fps/threads=N       frames per second when decoding as fast as possible
+      peak_rss/threads=N         peak resident memory (MB) while decoding
+      allocs_per_frame           malloc() calls (libav included) per decoded frame, 1 thread
+
+  Every measurement runs `--runs` times and we keep the median (peak_rss:
+  the largest value), so a single hiccup doesn't decide the result. The
+  results are written as tab separated lines `name value unit better`,
+  where better is `higher` or `lower`. With `--baseline` we compare the
+  results with an earlier results file and exit with a failure when a
+  metric got more than `--threshold` percent (default 5) worse.
+
+  Usage:
+
+      ./throughput [--runs 3] [--threads 1,2,4,8] [--out results.tsv]
+                   [--baseline baseline.tsv] [--threshold 5] file.h264 ...
+
+      make throughput-baseline    # writes throughput_baseline.tsv
+      make throughput-compare     # fails on a regression against it
+
+  The Makefile creates the synthetic 480p, 1080p and 2160p test streams with
+  avconv. Compare results of the same machine only and keep it otherwise
+  idle; a fixed CPU frequency (performance governor, no turbo) makes the
+  numbers a lot more stable. Peak RSS is reset per run through
+  /proc/self/clear_refs; where that doesn't work it is the peak of the
+  whole process so far, marked "(process)" in the output. Allocations are
+  counted by replacing malloc() and friends, which we can only do with 
+  glibc; elsewhere they are reported as 0.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <H264_Decoder.h>
+#include <H264_AnnexB.h>
+
+#define THROUGHPUT_DEFAULT_RUNS 3                                                        /* number of times we repeat every measurement */
+#define THROUGHPUT_DEFAULT_THRESHOLD 5.0                                                 /* percent a metric may get worse before the comparison fails */
+
+struct Metric {
+  std::string name;                                                                      /* e.g. sample.h264/decode_fps/threads=4 */
+  double value;
+  std::string unit;                                                                      /* GBps, ms, fps, MB, count */
+  bool higher_is_better;
+};
+
+struct Options {
+  int runs;                                                                              /* see --runs */
+  double threshold;                                                                      /* see --threshold, in percent */
+  std::vector<int> threads;                                                              /* see --threads */
+  std::string out_path;                                                                  /* see --out */
+  std::string baseline_path;                                                             /* see --baseline */
+  std::vector<std::string> files;
+};
+
+static std::atomic<uint64_t> num_allocations(0);                                         /* incremented by our malloc() replacements */
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+static bool parse_options(int argc, char** argv, Options& opt);
+static bool read_file(const char* filepath, std::vector<uint8_t>& result);
+static std::string file_name(const std::string& filepath);
+static double median(std::vector<double> values);
+static double gbps(size_t nbytes, uint64_t duration);
+static bool bench_file(const Options& opt, const std::string& filepath, std::vector<Metric>& metrics);
+static bool bench_parsers(const Options& opt, const std::string& name, const std::vector<uint8_t>& data, std::vector<Metric>& metrics);
+static bool bench_startup(const Options& opt, const std::string& filepath, const std::string& name, std::vector<Metric>& metrics);
+static bool bench_decode(const std::string& filepath, int threads, double& fps, double& peakRss, double& allocsPerFrame);
+static bool reset_peak_rss();
+static long read_status_kb(const char* key);
+static double peak_rss_mb();
+static void add_metric(std::vector<Metric>& metrics, const std::string& name, double value, const char* unit, bool higherIsBetter);
+static bool write_results(const std::string& filepath, const Options& opt, const std::vector<Metric>& metrics);
+static bool read_results(const std::string& filepath, std::map<std::string, Metric>& result);
+static bool compare_results(const std::vector<Metric>& metrics, const std::string& baselinePath, double threshold);
+
+int main(int argc, char** argv) {
+
+  Options opt;
+  std::vector<Metric> metrics;
+
+  if(!parse_options(argc, argv, opt)) {
+    printf("Usage: %s [--runs 3] [--threads 1,2,4,8] [--out results.tsv] [--baseline baseline.tsv] [--threshold 5] file.h264 ...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  avcodec_register_all();
+
+  for(size_t i = 0; i < opt.files.size(); ++i) {
+    if(!bench_file(opt, opt.files[i], metrics)) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(opt.out_path.size() && !write_results(opt.out_path, opt, metrics)) {
+    return EXIT_FAILURE;
+  }
+
+  if(opt.baseline_path.size() && !compare_results(metrics, opt.baseline_path, opt.threshold)) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+  uint64_t* frames = (uint64_t*)user;
+  *frames = *frames + 1;
+}
+
+static bool parse_options(int argc, char** argv, Options& opt) {
+
+  opt.runs = THROUGHPUT_DEFAULT_RUNS;
+  opt.threshold = THROUGHPUT_DEFAULT_THRESHOLD;
+
+  for(int i = 1; i < argc; ++i) {
+
+    std::string arg = argv[i];
+    bool has_value = (i + 1 < argc);
+
+    if(arg == "--runs" && has_value) {
+      opt.runs = atoi(argv[++i]);
+    }
+    else if(arg == "--threshold" && has_value) {
+      opt.threshold = atof(argv[++i]);
+    }
+    else if(arg == "--out" && has_value) {
+      opt.out_path = argv[++i];
+    }
+    else if(arg == "--baseline" && has_value) {
+      opt.baseline_path = argv[++i];
+    }
+    else if(arg == "--threads" && has_value) {
+      char* p = argv[++i];
+      while(*p) {
+        int n = (int)strtol(p, &p, 10);
+        if(n <= 0) {
+          printf("Error: invalid thread count in: %s\n", argv[i]);
+          return false;
+        }
+        opt.threads.push_back(n);
+        p += (*p == ',') ? 1 : 0;
+      }
+    }
+    else if(arg.size() > 1 && arg[0] == '-') {
+      printf("Error: unknown option: %s\n", arg.c_str());
+      return false;
+    }
+    else {
+      opt.files.push_back(arg);
+    }
+  }
+
+  if(opt.runs <= 0 || opt.threshold < 0.0 || opt.files.empty()) {
+    return false;
+  }
+
+  /* 1, 2, 4, ... up to the number of cores */
+  if(opt.threads.empty()) {
+    int cores = (int)std::thread::hardware_concurrency();
+    for(int n = 1; n <= 8 && (n == 1 || n <= cores); n *= 2) {
+      opt.threads.push_back(n);
+    }
+  }
+
+  return true;
+}
+
+static bool read_file(const char* filepath, std::vector<uint8_t>& result) {
+
+  FILE* fp = fopen(filepath, "rb");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath);
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  if(size <= 0) {
+    printf("Error: empty file: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  /* the libav parser may read past the end */
+  result.assign(size + FF_INPUT_BUFFER_PADDING_SIZE, 0x00);
+
+  if(fread(&result[0], 1, size, fp) != (size_t)size) {
+    printf("Error: cannot read: %s\n", filepath);
+    fclose(fp);
+    return false;
+  }
+
+  result.resize(size);
+  fclose(fp);
+
+  return true;
+}
+
+static std::string file_name(const std::string& filepath) {
+
+  size_t pos = filepath.find_last_of('/');
+  if(pos == std::string::npos) {
+    return filepath;
+  }
+
+  return filepath.substr(pos + 1);
+}
+
+static double median(std::vector<double> values) {
+
+  if(values.empty()) {
+    return 0.0;
+  }
+
+  std::sort(values.begin(), values.end());
+
+  size_t mid = values.size() / 2;
+  if(values.size() % 2 == 0) {
+    return (values[mid - 1] + values[mid]) * 0.5;
+  }
+
+  return values[mid];
+}
+
+static double gbps(size_t nbytes, uint64_t duration) {
+
+  if(duration == 0) {
+    return 0.0;
+  }
+
+  return (double)nbytes / duration;
+}
+
+static bool bench_file(const Options& opt, const std::string& filepath, std::vector<Metric>& metrics) {
+
+  std::string name = file_name(filepath);
+  std::vector<uint8_t> data;
+
+  if(!read_file(filepath.c_str(), data)) {
+    return false;
+  }
+
+  printf("File: %s, %.2f MB, %d runs\n", filepath.c_str(), data.size() / (1024.0 * 1024.0), opt.runs);
+
+  if(!bench_parsers(opt, name, data, metrics)) {
+    return false;
+  }
+
+  if(!bench_startup(opt, filepath, name, metrics)) {
+    return false;
+  }
+
+  for(size_t i = 0; i < opt.threads.size(); ++i) {
+
+    int threads = opt.threads[i];
+    std::vector<double> fps;
+    double peak_rss = 0.0;
+    double allocs_per_frame = 0.0;
+
+    for(int run = 0; run < opt.runs; ++run) {
+
+      double run_fps = 0.0;
+      double run_rss = 0.0;
+
+      if(!bench_decode(filepath, threads, run_fps, run_rss, allocs_per_frame)) {
+        return false;
+      }
+
+      fps.push_back(run_fps);
+      peak_rss = std::max(peak_rss, run_rss);
+    }
+
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), "/threads=%d", threads);
+
+    add_metric(metrics, name + "/decode_fps" + suffix, median(fps), "fps", true);
+    add_metric(metrics, name + "/peak_rss" + suffix, peak_rss, "MB", false);
+
+    if(threads == 1) {
+      add_metric(metrics, name + "/allocs_per_frame", allocs_per_frame, "count", false);
+    }
+  }
+
+  return true;
+}
+
+static bool bench_parsers(const Options& opt, const std::string& name, const std::vector<uint8_t>& data, std::vector<Metric>& metrics) {
+
+  std::vector<double> annexb;
+  std::vector<double> libav;
+  uint64_t annexb_count = 0;
+  uint64_t libav_count = 0;
+
+  AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+  if(!codec) {
+    printf("Error: cannot find the h264 decoder.\n");
+    return false;
+  }
+
+  for(int run = 0; run < opt.runs; ++run) {
+
+    H264_AnnexB au;
+    size_t offset = 0;
+    uint64_t start = rx_hrtime();
+
+    annexb_count = 0;
+
+    while(offset < data.size()) {
+      size_t nbytes = au.findAccessUnit(&data[offset], data.size() - offset, true);
+      if(nbytes == 0) {
+        break;
+      }
+      offset += nbytes;
+      annexb_count++;
+    }
+
+    annexb.push_back(gbps(data.size(), rx_hrtime() - start));
+
+    AVCodecContext* codec_context = avcodec_alloc_context3(codec);
+    AVCodecParserContext* parser = av_parser_init(AV_CODEC_ID_H264);
+
+    if(!codec_context || !parser) {
+      printf("Error: cannot create the libav parser.\n");
+      return false;
+    }
+
+    offset = 0;
+    libav_count = 0;
+    start = rx_hrtime();
+
+    while(true) {
+
+      uint8_t* pkt_data = NULL;
+      int pkt_size = 0;
+      int nbytes = (int)std::min(data.size() - offset, (size_t)H264_MMAP_CHUNK_SIZE);
+      int len = av_parser_parse2(parser, codec_context, &pkt_data, &pkt_size,
+                                 (nbytes > 0) ? &data[offset] : NULL, nbytes, 0, 0, AV_NOPTS_VALUE);
+
+      libav_count += (pkt_size > 0) ? 1 : 0;
+
+      if(nbytes == 0 || len < 0) {
+        break;
+      }
+
+      offset += len;
+    }
+
+    libav.push_back(gbps(data.size(), rx_hrtime() - start));
+
+    av_parser_close(parser);
+    av_free(codec_context);
+  }
+
+  printf("  parser annexb: %8.3f GB/s (%llu access units), libav: %8.3f GB/s (%llu packets)\n",
+         median(annexb), (unsigned long long)annexb_count,
+         median(libav), (unsigned long long)libav_count);
+
+  add_metric(metrics, name + "/parser_annexb", median(annexb), "GBps", true);
+  add_metric(metrics, name + "/parser_libav", median(libav), "GBps", true);
+
+  return true;
+}
+
+static bool bench_startup(const Options& opt, const std::string& filepath, const std::string& name, std::vector<Metric>& metrics) {
+
+  std::vector<double> startup;
+  H264_DecoderSettings settings;
+  settings.fps = -1.0f;
+
+  for(int run = 0; run < opt.runs; ++run) {
+
+    uint64_t frames = 0;
+    uint64_t start = rx_hrtime();
+    H264_Decoder* decoder = new H264_Decoder(on_frame, &frames);
+
+    if(!decoder->load(filepath, settings)) {
+      delete decoder;
+      return false;
+    }
+
+    while(frames == 0) {
+      if(!decoder->readFrame() && (decoder->eof || decoder->error)) {
+        printf("Error: the file has no frames: %s\n", filepath.c_str());
+        delete decoder;
+        return false;
+      }
+    }
+
+    startup.push_back((rx_hrtime() - start) / 1000000.0);
+
+    delete decoder;
+  }
+
+  printf("  startup: %8.3f ms\n", median(startup));
+
+  add_metric(metrics, name + "/startup", median(startup), "ms", false);
+
+  return true;
+}
+
+static bool bench_decode(const std::string& filepath, int threads, double& fps, double& peakRss, double& allocsPerFrame) {
+
+  uint64_t frames = 0;
+  H264_DecoderSettings settings;
+
+  settings.fps = -1.0f;
+  settings.thread_count = threads;
+
+  bool can_reset_rss = reset_peak_rss();
+
+  H264_Decoder decoder(on_frame, &frames);
+
+  if(!decoder.load(filepath, settings)) {
+    return false;
+  }
+
+  /* the allocations of the first frame (codec setup, picture buffers) are not per frame */
+  while(frames == 0) {
+    if(!decoder.readFrame() && (decoder.eof || decoder.error)) {
+      printf("Error: the file has no frames: %s\n", filepath.c_str());
+      return false;
+    }
+  }
+
+  uint64_t first_frames = frames;
+  uint64_t allocations = num_allocations.load(std::memory_order_relaxed);
+  uint64_t start = rx_hrtime();
+
+  while(!decoder.eof && !decoder.error) {
+    decoder.readFrame();
+  }
+
+  uint64_t duration = rx_hrtime() - start;
+  uint64_t decoded = frames - first_frames;
+
+  allocations = num_allocations.load(std::memory_order_relaxed) - allocations;
+
+  fps = (duration > 0) ? decoded / (duration / 1000000000.0) : 0.0;
+  allocsPerFrame = (decoded > 0) ? (double)allocations / decoded : 0.0;
+  peakRss = peak_rss_mb();
+
+  printf("  threads: %2d, %6llu frames, %9.2f fps, peak rss: %8.2f MB%s, %.2f allocations per frame\n",
+         threads,
+         (unsigned long long)frames,
+         fps,
+         peakRss,
+         (can_reset_rss) ? "" : " (process)",
+         allocsPerFrame);
+
+  return true;
+}
+
+/* Linux >= 4.0: writing 5 resets VmHWM to the current RSS; some kernels accept the write but ignore it */
+static bool reset_peak_rss() {
+
+  FILE* fp = fopen("/proc/self/clear_refs", "w");
+  if(!fp) {
+    return false;
+  }
+
+  bool result = (fputs("5", fp) >= 0);
+
+  if(fclose(fp) != 0 || !result) {
+    return false;
+  }
+
+  long hwm = read_status_kb("VmHWM:");
+  long rss = read_status_kb("VmRSS:");
+
+  return hwm >= 0 && rss >= 0 && hwm <= rss;
+}
+
+/* a value from /proc/self/status in kB, -1 when we can't read it */
+static long read_status_kb(const char* key) {
+
+  FILE* fp = fopen("/proc/self/status", "r");
+  if(!fp) {
+    return -1;
+  }
+
+  char line[256];
+  size_t key_len = strlen(key);
+  long kb = -1;
+
+  while(fgets(line, sizeof(line), fp)) {
+    if(strncmp(line, key, key_len) == 0) {
+      kb = strtol(line + key_len, NULL, 10);
+      break;
+    }
+  }
+
+  fclose(fp);
+
+  return kb;
+}
+
+static double peak_rss_mb() {
+
+  long kb = read_status_kb("VmHWM:");
+  if(kb >= 0) {
+    return kb / 1024.0;
+  }
+
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0.0;
+  }
+
+#if defined(__APPLE__)
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+static void add_metric(std::vector<Metric>& metrics, const std::string& name, double value, const char* unit, bool higherIsBetter) {
+
+  Metric m;
+  m.name = name;
+  m.value = value;
+  m.unit = unit;
+  m.higher_is_better = higherIsBetter;
+
+  metrics.push_back(m);
+}
+
+static bool write_results(const std::string& filepath, const Options& opt, const std::vector<Metric>& metrics) {
+
+  FILE* fp = fopen(filepath.c_str(), "w");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  fprintf(fp, "# h264 throughput, cores: %u, runs: %d\n", std::thread::hardware_concurrency(), opt.runs);
+  fprintf(fp, "# name\tvalue\tunit\tbetter\n");
+
+  for(size_t i = 0; i < metrics.size(); ++i) {
+    const Metric& m = metrics[i];
+    fprintf(fp, "%s\t%.6f\t%s\t%s\n", m.name.c_str(), m.value, m.unit.c_str(), (m.higher_is_better) ? "higher" : "lower");
+  }
+
+  if(fclose(fp) != 0) {
+    printf("Error: cannot write: %s\n", filepath.c_str());
+    return false;
+  }
+
+  printf("Wrote %zu results to %s\n", metrics.size(), filepath.c_str());
+
+  return true;
+}
+
+static bool read_results(const std::string& filepath, std::map<std::string, Metric>& result) {
+
+  FILE* fp = fopen(filepath.c_str(), "r");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  char line[1024];
+  int line_number = 0;
+
+  while(fgets(line, sizeof(line), fp)) {
+
+    line_number++;
+
+    if(line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+
+    char name[512];
+    char unit[64];
+    char better[16];
+    double value = 0.0;
+
+    if(sscanf(line, "%511s %lf %63s %15s", name, &value, unit, better) != 4) {
+      printf("Error: invalid line %d in: %s\n", line_number, filepath.c_str());
+      fclose(fp);
+      return false;
+    }
+
+    Metric m;
+    m.name = name;
+    m.value = value;
+    m.unit = unit;
+    m.higher_is_better = (strcmp(better, "higher") == 0);
+
+    result[m.name] = m;
+  }
+
+  fclose(fp);
+
+  return true;
+}
+
+static bool compare_results(const std::vector<Metric>& metrics, const std::string& baselinePath, double threshold) {
+
+  std::map<std::string, Metric> baseline;
+  int regressions = 0;
+
+  if(!read_results(baselinePath, baseline)) {
+    return false;
+  }
+
+  printf("\nCompared with %s (fails when more than %.1f%% worse):\n", baselinePath.c_str(), threshold);
+
+  for(size_t i = 0; i < metrics.size(); ++i) {
+
+    const Metric& m = metrics[i];
+    std::map<std::string, Metric>::iterator it = baseline.find(m.name);
+
+    if(it == baseline.end()) {
+      printf("  %-48s %12.3f %-5s (not in the baseline)\n", m.name.c_str(), m.value, m.unit.c_str());
+      continue;
+    }
+
+    double base = it->second.value;
+    double change = (base != 0.0) ? (m.value - base) / base * 100.0 : 0.0;
+    double worse = (m.higher_is_better) ? -change : change;
+    bool regressed = (base != 0.0) ? (worse > threshold) : (!m.higher_is_better && m.value > 0.0);
+
+    printf("  %-48s %12.3f %-5s baseline: %12.3f, %+7.2f%%%s\n",
+           m.name.c_str(),
+           m.value,
+           m.unit.c_str(),
+           base,
+           change,
+           (regressed) ? "  REGRESSION" : "");
+
+    regressions += (regressed) ? 1 : 0;
+  }
+
+  if(regressions) {
+    printf("Error: %d metrics regressed more than %.1f%%.\n", regressions, threshold);
+    return false;
+  }
+
+  printf("No regressions.\n");
+
+  return true;
+}
+
+/* count every allocation, including the ones libav makes, by replacing the glibc entry points */
+#if defined(__GLIBC__)
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** result, size_t alignment, size_t size) {
+
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  void* ptr = __libc_memalign(alignment, size);
+  if(!ptr) {
+    return ENOMEM;
+  }
+
+  *result = ptr;
+
+  return 0;
+}
+
+void free(void* ptr) {
+  __libc_free(ptr);
+}
+
+}
+#endif
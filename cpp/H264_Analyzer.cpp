@@ -0,0 +1,407 @@
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <tinylib_trace.h>
+#include "H264_Analyzer.h"
+
+static std::string h264_json_escape(const std::string& str);
+
+H264_Analyzer::H264_Analyzer()
+  :fps(0.0)
+  ,window(H264_ANALYZER_WINDOW)
+  ,file_size(0)
+  ,nal_count(0)
+  ,idr_count(0)
+  ,idr_interval_min(0)
+  ,idr_interval_max(0)
+  ,idr_interval_avg(0.0)
+  ,analyze_ns(0)
+{
+  memset(type_count, 0x00, sizeof(type_count));
+  memset(type_bytes, 0x00, sizeof(type_bytes));
+}
+
+bool H264_Analyzer::analyze(std::string path) {
+
+  filepath = path;
+
+  int fd = ::open(filepath.c_str(), O_RDONLY);
+  if(fd < 0) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.st_size == 0) {
+    printf("Error: cannot analyze an empty file: %s\n", filepath.c_str());
+    ::close(fd);
+    return false;
+  }
+
+  size_t size = (size_t)st.st_size;
+  void* ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if(ptr == MAP_FAILED) {
+    printf("Error: cannot mmap: %s\n", filepath.c_str());
+    return false;
+  }
+
+  madvise(ptr, size, MADV_SEQUENTIAL);
+
+  bool result = analyze((const uint8_t*)ptr, size);
+
+  munmap(ptr, size);
+
+  return result;
+}
+
+bool H264_Analyzer::analyze(const uint8_t* data, size_t size) {
+
+  uint64_t start = rx_hrtime();
+  size_t offset = 0;
+  H264_AnnexB au;
+
+  parser.reset();
+  frames.clear();
+  nal_count = 0;
+  file_size = size;
+
+  while(offset < size) {
+
+    size_t nbytes = au.findAccessUnit(data + offset, size - offset, true);
+    if(nbytes == 0) {
+      break;
+    }
+
+    addFrame(data + offset, nbytes, offset);
+    offset += nbytes;
+  }
+
+  computeStats();
+
+  analyze_ns = rx_hrtime() - start;
+
+  if(frames.empty()) {
+    printf("Error: no pictures found.\n");
+    return false;
+  }
+
+  /* e.g. a file with only malformed parameter sets, where every slice header fails */
+  uint64_t parsed_frames = 0;
+  for(int i = 0; i < 5; ++i) {
+    parsed_frames += type_count[i];
+  }
+
+  if(parsed_frames == 0) {
+    printf("Error: none of the %zu pictures has a slice header we can parse, parse errors: %llu\n",
+           frames.size(), (unsigned long long)parser.errors);
+    return false;
+  }
+
+  return true;
+}
+
+void H264_Analyzer::addFrame(const uint8_t* data, size_t size, uint64_t offset) {
+
+  const uint8_t* p = data;
+  const uint8_t* end = data + size;
+  H264_FrameStats stats;
+  H264_Nal nal;
+  bool has_slice = false;
+
+  memset(&stats, 0x00, sizeof(stats));
+  stats.offset = offset;
+  stats.size = (uint32_t)std::min(size, (size_t)0xFFFFFFFF);
+  stats.slice_type = -1;
+  stats.poc = -1;
+
+  while(h264_next_nal(p, end, nal)) {
+
+    nal_count++;
+    stats.nal_count = (uint16_t)std::min((int)stats.nal_count + 1, 0xFFFF);
+
+    /* parameter sets are stored by the parser; other non VCL NALs are only counted */
+    bool parsed = parser.parseNal(nal);
+
+    if(!h264_is_vcl(nal.type)) {
+      continue;
+    }
+
+    has_slice = true;
+    stats.slice_count = (uint16_t)std::min((int)stats.slice_count + 1, 0xFFFF);
+    stats.idr = stats.idr || (nal.type == H264_NAL_IDR);
+    stats.nal_ref_idc = (uint8_t)std::max((int)stats.nal_ref_idc, nal.ref_idc);
+
+    if(parsed && stats.slice_type < 0) {
+      stats.slice_type = (int8_t)parser.slice.slice_type;
+      stats.frame_num = parser.slice.frame_num;
+      stats.poc = parser.slice.poc;
+      stats.qp = (int8_t)parser.slice.qp;
+    }
+  }
+
+  /* e.g. a trailing end of stream NAL */
+  if(!has_slice) {
+    return;
+  }
+
+  frames.push_back(stats);
+}
+
+double H264_Analyzer::frameRate() {
+
+  if(fps > 0.0) {
+    return fps;
+  }
+
+  const H264_Sps* sps = parser.activeSps();
+
+  if(sps && sps->timing_info_present_flag && sps->num_units_in_tick > 0 && sps->time_scale > 0) {
+    return (double)sps->time_scale / (2.0 * sps->num_units_in_tick);
+  }
+
+  return H264_ANALYZER_DEFAULT_FPS;
+}
+
+void H264_Analyzer::computeStats() {
+
+  double rate = frameRate();
+  double win = (window > 0.0) ? window : H264_ANALYZER_WINDOW;
+  uint64_t last_idr = 0;
+  uint64_t intervals = 0;
+  uint64_t interval_sum = 0;
+
+  gops.clear();
+  bitrate.clear();
+  memset(type_count, 0x00, sizeof(type_count));
+  memset(type_bytes, 0x00, sizeof(type_bytes));
+  idr_count = 0;
+  idr_interval_min = 0;
+  idr_interval_max = 0;
+  idr_interval_avg = 0.0;
+
+  for(size_t i = 0; i < frames.size(); ++i) {
+
+    const H264_FrameStats& f = frames[i];
+
+    if(f.slice_type >= 0) {
+      type_count[f.slice_type]++;
+      type_bytes[f.slice_type] += f.size;
+    }
+
+    if(f.idr) {
+
+      if(idr_count > 0) {
+        uint64_t interval = i - last_idr;
+        idr_interval_min = (intervals == 0) ? interval : std::min(idr_interval_min, interval);
+        idr_interval_max = std::max(idr_interval_max, interval);
+        interval_sum += interval;
+        intervals++;
+      }
+
+      idr_count++;
+      last_idr = i;
+    }
+
+    if(gops.empty() || f.idr) {
+      H264_GopStats gop;
+      gop.start_frame = i;
+      gop.frames = 0;
+      gop.bytes = 0;
+      gop.idr = f.idr;
+      gops.push_back(gop);
+    }
+
+    H264_GopStats& gop = gops.back();
+    gop.frames++;
+    gop.bytes += f.size;
+    gop.structure += (f.slice_type >= 0) ? h264_slice_type_name(f.slice_type) : "?";
+
+    /* the decode order position is the time, see the header */
+    size_t slot = (size_t)((i / rate) / win);
+    if(slot >= bitrate.size()) {
+      bitrate.resize(slot + 1, 0);
+    }
+    bitrate[slot] += (uint64_t)f.size * 8;
+  }
+
+  if(intervals > 0) {
+    idr_interval_avg = (double)interval_sum / intervals;
+  }
+
+  /* bits per window -> bits per second */
+  for(size_t i = 0; i < bitrate.size(); ++i) {
+    bitrate[i] = (uint64_t)(bitrate[i] / win);
+  }
+}
+
+void H264_Analyzer::writeCsv(FILE* fp) {
+
+  double rate = frameRate();
+
+  fprintf(fp, "frame,time,offset,size,nals,slices,type,idr,ref_idc,frame_num,poc,qp\n");
+
+  for(size_t i = 0; i < frames.size(); ++i) {
+
+    const H264_FrameStats& f = frames[i];
+
+    fprintf(fp, "%zu,%.6f,%llu,%u,%u,%u,%s,%d,%u,%u,%d,%d\n",
+            i,
+            i / rate,
+            (unsigned long long)f.offset,
+            f.size,
+            f.nal_count,
+            f.slice_count,
+            (f.slice_type >= 0) ? h264_slice_type_name(f.slice_type) : "?",
+            f.idr ? 1 : 0,
+            f.nal_ref_idc,
+            f.frame_num,
+            f.poc,
+            f.qp);
+  }
+}
+
+void H264_Analyzer::writeJson(FILE* fp) {
+
+  double rate = frameRate();
+  double duration = frames.size() / rate;
+  const H264_Sps* sps = parser.activeSps();
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"file\": \"%s\",\n", h264_json_escape(filepath).c_str());
+  fprintf(fp, "  \"bytes\": %llu,\n", (unsigned long long)file_size);
+  fprintf(fp, "  \"width\": %d,\n", (sps) ? sps->width : 0);
+  fprintf(fp, "  \"height\": %d,\n", (sps) ? sps->height : 0);
+  fprintf(fp, "  \"profile_idc\": %d,\n", (sps) ? sps->profile_idc : 0);
+  fprintf(fp, "  \"level_idc\": %d,\n", (sps) ? sps->level_idc : 0);
+  fprintf(fp, "  \"fps\": %.3f,\n", rate);
+  fprintf(fp, "  \"duration\": %.3f,\n", duration);
+  fprintf(fp, "  \"frame_count\": %zu,\n", frames.size());
+  fprintf(fp, "  \"nals\": %llu,\n", (unsigned long long)nal_count);
+  fprintf(fp, "  \"parse_errors\": %llu,\n", (unsigned long long)parser.errors);
+  fprintf(fp, "  \"avg_bitrate\": %llu,\n", (unsigned long long)((duration > 0.0) ? (file_size * 8) / duration : 0));
+  fprintf(fp, "  \"idr_count\": %llu,\n", (unsigned long long)idr_count);
+  fprintf(fp, "  \"idr_interval\": { \"min\": %llu, \"max\": %llu, \"avg\": %.2f },\n",
+          (unsigned long long)idr_interval_min, (unsigned long long)idr_interval_max, idr_interval_avg);
+
+  fprintf(fp, "  \"slice_types\": {");
+  for(int i = 0; i < 5; ++i) {
+    fprintf(fp, "%s \"%s\": { \"count\": %llu, \"bytes\": %llu }", (i) ? "," : "",
+            h264_slice_type_name(i), (unsigned long long)type_count[i], (unsigned long long)type_bytes[i]);
+  }
+  fprintf(fp, " },\n");
+
+  fprintf(fp, "  \"bitrate_window\": %.3f,\n", window);
+  fprintf(fp, "  \"bitrate\": [");
+  for(size_t i = 0; i < bitrate.size(); ++i) {
+    fprintf(fp, "%s%llu", (i) ? ", " : "", (unsigned long long)bitrate[i]);
+  }
+  fprintf(fp, "],\n");
+
+  fprintf(fp, "  \"gops\": [\n");
+  for(size_t i = 0; i < gops.size(); ++i) {
+    const H264_GopStats& g = gops[i];
+    fprintf(fp, "    { \"start_frame\": %llu, \"frames\": %llu, \"bytes\": %llu, \"idr\": %s, \"structure\": \"%s\" }%s\n",
+            (unsigned long long)g.start_frame,
+            (unsigned long long)g.frames,
+            (unsigned long long)g.bytes,
+            g.idr ? "true" : "false",
+            g.structure.c_str(),
+            (i + 1 < gops.size()) ? "," : "");
+  }
+  fprintf(fp, "  ]");
+
+  /* the same columns as writeCsv() */
+  fprintf(fp, ",\n  \"frames\": [\n");
+  for(size_t i = 0; i < frames.size(); ++i) {
+    const H264_FrameStats& f = frames[i];
+    fprintf(fp, "    { \"frame\": %zu, \"time\": %.6f, \"offset\": %llu, \"size\": %u, \"nals\": %u, \"slices\": %u, \"type\": \"%s\", \"idr\": %s, \"ref_idc\": %u, \"frame_num\": %u, \"poc\": %d, \"qp\": %d }%s\n",
+            i,
+            i / rate,
+            (unsigned long long)f.offset,
+            f.size,
+            f.nal_count,
+            f.slice_count,
+            (f.slice_type >= 0) ? h264_slice_type_name(f.slice_type) : "?",
+            f.idr ? "true" : "false",
+            f.nal_ref_idc,
+            f.frame_num,
+            f.poc,
+            f.qp,
+            (i + 1 < frames.size()) ? "," : "");
+  }
+  fprintf(fp, "  ]");
+
+  fprintf(fp, "\n}\n");
+}
+
+void H264_Analyzer::writeSummary(FILE* fp) {
+
+  double rate = frameRate();
+  double duration = frames.size() / rate;
+  const H264_Sps* sps = parser.activeSps();
+  uint64_t max_bitrate = 0;
+
+  for(size_t i = 0; i < bitrate.size(); ++i) {
+    max_bitrate = std::max(max_bitrate, bitrate[i]);
+  }
+
+  fprintf(fp, "File:          %s, %llu bytes\n", filepath.c_str(), (unsigned long long)file_size);
+
+  if(sps) {
+    fprintf(fp, "Stream:        %dx%d, profile %d, level %d\n", sps->width, sps->height, sps->profile_idc, sps->level_idc);
+  }
+
+  fprintf(fp, "Pictures:      %zu, %.3f fps, %.2f s\n", frames.size(), rate, duration);
+  fprintf(fp, "NALs:          %llu, parse errors: %llu\n", (unsigned long long)nal_count, (unsigned long long)parser.errors);
+  fprintf(fp, "Bitrate:       avg %.1f kbit/s, max %.1f kbit/s (%.2f s windows)\n",
+          (duration > 0.0) ? (file_size * 8) / duration / 1000.0 : 0.0, max_bitrate / 1000.0, window);
+  fprintf(fp, "IDR:           %llu, interval min %llu, max %llu, avg %.2f\n",
+          (unsigned long long)idr_count, (unsigned long long)idr_interval_min,
+          (unsigned long long)idr_interval_max, idr_interval_avg);
+
+  for(int i = 0; i < 5; ++i) {
+    if(type_count[i] == 0) {
+      continue;
+    }
+    fprintf(fp, "%-2s pictures:   %llu, avg %.1f bytes\n", h264_slice_type_name(i),
+            (unsigned long long)type_count[i], (double)type_bytes[i] / type_count[i]);
+  }
+
+  if(gops.size()) {
+    fprintf(fp, "GOPs:          %zu, first: %s\n", gops.size(), gops[0].structure.c_str());
+  }
+
+  fprintf(fp, "Analyzed in:   %.2f ms\n", analyze_ns / 1000000.0);
+}
+
+/* ------------------------------------------------------------------------------ */
+
+static std::string h264_json_escape(const std::string& str) {
+
+  std::string result;
+
+  for(size_t i = 0; i < str.size(); ++i) {
+
+    unsigned char c = (unsigned char)str[i];
+
+    if(c == '"' || c == '\\') {
+      result += '\\';
+      result += (char)c;
+    }
+    else if(c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      result += buf;
+    }
+    else {
+      result += (char)c;
+    }
+  }
+
+  return result;
+}
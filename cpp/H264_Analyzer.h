@@ -0,0 +1,101 @@
+/*
+
+  H264_Analyzer
+  ---------------------------------------
+
+  Bitstream statistics of an Annex B file without decoding it. We map the
+  file, split it into access units with the start code scanner (see
+  H264_AnnexB) and parse the SPS, PPS and slice headers (see
+  H264_SliceHeader). For every picture we keep its offset and size in the
+  file, the number of NALs and slices, the slice type, frame_num, POC and QP.
+  From that we compute the IDR interval, the structure of every GOP (the
+  slice types in decode order, e.g. "IPBBPBB"), the size per slice type and
+  the bitrate per time window.
+
+  Times are based on the decode order position of a picture and the
+  framerate: the one you set in `fps`, or the one from the VUI of the SPS, or
+  H264_ANALYZER_DEFAULT_FPS. A GOP starts at an IDR picture; pictures before
+  the first IDR are counted in a GOP with `start_frame` 0 and no IDR.
+
+  The results can be written as CSV (one row per picture), JSON (the
+  summary, the GOPs, the bitrate and a `frames` array with the same columns
+  as the CSV) or as a short human readable summary. See `h264stat.cpp` for
+  the command line tool.
+
+  Usage:
+
+      H264_Analyzer analyzer;
+      if(analyzer.analyze("file.h264")) {
+        analyzer.writeJson(stdout);
+      }
+
+ */
+#ifndef H264_ANALYZER_H
+#define H264_ANALYZER_H
+
+#define H264_ANALYZER_DEFAULT_FPS 25.0                                                  /* framerate we use when the stream has no timing info and none is set */
+#define H264_ANALYZER_WINDOW 1.0                                                        /* default length (seconds) of a bitrate window */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "H264_SliceHeader.h"
+
+struct H264_FrameStats {
+  uint64_t offset;                                                                       /* offset of the access unit in the file */
+  uint32_t size;                                                                         /* size of the access unit in bytes, including start codes and parameter sets */
+  uint16_t nal_count;                                                                    /* number of NAL units */
+  uint16_t slice_count;                                                                  /* number of slices */
+  int8_t slice_type;                                                                     /* H264_SLICE_*, of the first slice; -1 when the header couldn't be parsed */
+  uint8_t nal_ref_idc;                                                                   /* highest nal_ref_idc of the slices */
+  bool idr;                                                                              /* IDR picture */
+  uint32_t frame_num;                                                                    /* frame_num of the first slice */
+  int32_t poc;                                                                           /* picture order count, -1 when unknown */
+  int8_t qp;                                                                             /* QP of the first slice */
+};
+
+struct H264_GopStats {
+  uint64_t start_frame;                                                                  /* decode order position of the first picture */
+  uint64_t frames;                                                                       /* number of pictures */
+  uint64_t bytes;                                                                        /* size of all access units */
+  bool idr;                                                                              /* false for the pictures before the first IDR */
+  std::string structure;                                                                 /* slice type of every picture in decode order */
+};
+
+class H264_Analyzer {
+
+ public:
+  H264_Analyzer();
+  bool analyze(std::string filepath);                                                    /* map and analyze a file */
+  bool analyze(const uint8_t* data, size_t size);                                        /* analyze an Annex B buffer; false when it has no picture with a slice header we can parse */
+  double frameRate();                                                                    /* the framerate we use for the timing, see above */
+  void writeCsv(FILE* fp);                                                               /* one row per picture */
+  void writeJson(FILE* fp);                                                              /* summary, gops, bitrate and one object per picture */
+  void writeSummary(FILE* fp);                                                           /* human readable summary */
+
+ private:
+  void addFrame(const uint8_t* data, size_t size, uint64_t offset);                      /* parse the NALs of an access unit with slices */
+  void computeStats();                                                                   /* fill gops and bitrate from frames */
+
+ public:
+  double fps;                                                                            /* framerate used for the timing; 0 = from the stream */
+  double window;                                                                         /* length of a bitrate window in seconds */
+  std::string filepath;                                                                  /* the analyzed file */
+  uint64_t file_size;                                                                    /* number of bytes we analyzed */
+  H264_SliceParser parser;                                                               /* keeps the parameter sets and POC state */
+  std::vector<H264_FrameStats> frames;                                                   /* every picture in decode order */
+  std::vector<H264_GopStats> gops;                                                       /* every GOP */
+  std::vector<uint64_t> bitrate;                                                         /* bits per second for each window */
+  uint64_t type_count[5];                                                                /* number of pictures per slice type */
+  uint64_t type_bytes[5];                                                                /* bytes per slice type */
+  uint64_t nal_count;                                                                    /* number of NALs in the file */
+  uint64_t idr_count;                                                                    /* number of IDR pictures */
+  uint64_t idr_interval_min;                                                             /* smallest number of pictures between two IDRs */
+  uint64_t idr_interval_max;                                                             /* largest number of pictures between two IDRs */
+  double idr_interval_avg;                                                               /* average number of pictures between two IDRs */
+  uint64_t analyze_ns;                                                                   /* how long analyze() took */
+};
+
+#endif
@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include "H264_AnnexB.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define H264_ANNEXB_X86 1
+#  include <immintrin.h>
+#endif
+
+/* we need the NAL header and the first byte of the slice header before we can decide if a NAL starts a new access unit */
+#define H264_ANNEXB_PEEK_SIZE 5
+
+static h264_find_startcode_func find_startcode = NULL;
+static const char* find_startcode_name = NULL;
+
+static void h264_select_startcode_func();
+static int h264_read_rbsp_byte(const uint8_t*& p, const uint8_t* end, int& zeros);
+
+/* ------------------------------------------------------------------------------ */
+
+const uint8_t* h264_find_startcode_c(const uint8_t* p, const uint8_t* end) {
+
+  if(end - p < 3) {
+    return end;
+  }
+
+  const uint8_t* last = end - 2;
+
+  /*
+     We check the third byte first: when it's > 1 none of the three
+     positions can be the start of a start code, so we skip 3 bytes.
+  */
+  while(p < last) {
+    if(p[2] > 1) {
+      p += 3;
+    }
+    else if(p[1]) {
+      p += 2;
+    }
+    else if(p[0] || p[2] != 1) {
+      p += 1;
+    }
+    else {
+      return p;
+    }
+  }
+
+  return end;
+}
+
+#if defined(H264_ANNEXB_X86)
+
+__attribute__((target("sse2")))
+const uint8_t* h264_find_startcode_sse2(const uint8_t* p, const uint8_t* end) {
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+
+  /* we load 16 bytes at p, p + 1 and p + 2 */
+  while(end - p >= 18) {
+
+    __m128i a = _mm_loadu_si128((const __m128i*)p);
+    __m128i b = _mm_loadu_si128((const __m128i*)(p + 1));
+    __m128i c = _mm_loadu_si128((const __m128i*)(p + 2));
+    __m128i m = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)), _mm_cmpeq_epi8(c, one));
+    int mask = _mm_movemask_epi8(m);
+
+    if(mask) {
+      return p + __builtin_ctz(mask);
+    }
+
+    p += 16;
+  }
+
+  return h264_find_startcode_c(p, end);
+}
+
+__attribute__((target("avx2")))
+const uint8_t* h264_find_startcode_avx2(const uint8_t* p, const uint8_t* end) {
+
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+
+  /* we load 32 bytes at p, p + 1 and p + 2 */
+  while(end - p >= 34) {
+
+    __m256i a = _mm256_loadu_si256((const __m256i*)p);
+    __m256i b = _mm256_loadu_si256((const __m256i*)(p + 1));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(p + 2));
+    __m256i m = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(b, zero)), _mm256_cmpeq_epi8(c, one));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+
+    if(mask) {
+      return p + __builtin_ctz(mask);
+    }
+
+    p += 32;
+  }
+
+  return h264_find_startcode_sse2(p, end);
+}
+
+bool h264_cpu_has_avx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+/* the functions don't check the CPU themselves, we only select what it supports */
+static void h264_select_startcode_func() {
+
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx2")) {
+    find_startcode_name = "avx2";
+    find_startcode = h264_find_startcode_avx2;
+  }
+  else if(__builtin_cpu_supports("sse2")) {
+    find_startcode_name = "sse2";
+    find_startcode = h264_find_startcode_sse2;
+  }
+  else {
+    find_startcode_name = "c";
+    find_startcode = h264_find_startcode_c;
+  }
+}
+
+#else
+
+const uint8_t* h264_find_startcode_sse2(const uint8_t* p, const uint8_t* end) {
+  return h264_find_startcode_c(p, end);
+}
+
+const uint8_t* h264_find_startcode_avx2(const uint8_t* p, const uint8_t* end) {
+  return h264_find_startcode_c(p, end);
+}
+
+bool h264_cpu_has_avx2() {
+  return false;
+}
+
+static void h264_select_startcode_func() {
+  find_startcode_name = "c";
+  find_startcode = h264_find_startcode_c;
+}
+
+#endif
+
+const uint8_t* h264_find_startcode(const uint8_t* p, const uint8_t* end) {
+
+  /* all threads select the same function, so a race here is harmless */
+  if(!find_startcode) {
+    h264_select_startcode_func();
+  }
+
+  return find_startcode(p, end);
+}
+
+const char* h264_find_startcode_name() {
+
+  if(!find_startcode) {
+    h264_select_startcode_func();
+  }
+
+  return find_startcode_name;
+}
+
+bool h264_next_nal(const uint8_t*& p, const uint8_t* end, H264_Nal& nal) {
+
+  const uint8_t* sc = h264_find_startcode(p, end);
+  if(sc == end || sc + 3 >= end) {
+    p = end;
+    return false;
+  }
+
+  nal.start = (sc > p && sc[-1] == 0x00) ? sc - 1 : sc;
+  nal.data = sc + 3;
+  nal.type = nal.data[0] & 0x1F;
+  nal.ref_idc = (nal.data[0] >> 5) & 0x03;
+
+  const uint8_t* next = h264_find_startcode(nal.data, end);
+  if(next != end && next[-1] == 0x00) {
+    next--;
+  }
+
+  nal.size = next - nal.data;
+  p = next;
+
+  return true;
+}
+
+bool h264_is_vcl(int nalType) {
+  return nalType >= H264_NAL_SLICE && nalType <= H264_NAL_IDR;
+}
+
+int h264_access_unit_info(const uint8_t* data, size_t size, bool& isIdr, int& refIdc) {
+
+  const uint8_t* p = data;
+  const uint8_t* end = data + size;
+  H264_Nal nal;
+  int vcl_type = 0;
+
+  isIdr = false;
+  refIdc = 0;
+
+  while(h264_next_nal(p, end, nal)) {
+
+    if(!h264_is_vcl(nal.type)) {
+      continue;
+    }
+
+    vcl_type = (vcl_type == 0) ? nal.type : vcl_type;
+    isIdr = isIdr || (nal.type == H264_NAL_IDR);
+    refIdc = (nal.ref_idc > refIdc) ? nal.ref_idc : refIdc;
+  }
+
+  return vcl_type;
+}
+
+bool h264_has_recovery_point(const uint8_t* data, size_t size) {
+
+  const uint8_t* p = data;
+  const uint8_t* end = data + size;
+  H264_Nal nal;
+
+  while(h264_next_nal(p, end, nal)) {
+
+    if(nal.type != H264_NAL_SEI) {
+      continue;
+    }
+
+    const uint8_t* sei = nal.data + 1;
+    const uint8_t* sei_end = nal.data + nal.size;
+    int zeros = 0;
+
+    /* sei_message()s until the rbsp_trailing_bits */
+    while(sei < sei_end && *sei != 0x80) {
+
+      int payload_type = 0;
+      int payload_size = 0;
+      int b = 0;
+
+      do {
+        b = h264_read_rbsp_byte(sei, sei_end, zeros);
+        payload_type += b;
+      } while(b == 0xFF);
+
+      do {
+        b = h264_read_rbsp_byte(sei, sei_end, zeros);
+        payload_size += b;
+      } while(b == 0xFF);
+
+      if(b < 0) {
+        break;
+      }
+
+      if(payload_type == H264_SEI_RECOVERY_POINT) {
+        return true;
+      }
+
+      for(int i = 0; i < payload_size && b >= 0; ++i) {
+        b = h264_read_rbsp_byte(sei, sei_end, zeros);
+      }
+    }
+  }
+
+  return false;
+}
+
+/* returns the next byte of the payload without the emulation prevention bytes, or -1 at the end */
+static int h264_read_rbsp_byte(const uint8_t*& p, const uint8_t* end, int& zeros) {
+
+  if(p < end && zeros >= 2 && *p == 0x03) {
+    zeros = 0;
+    p++;
+  }
+
+  if(p >= end) {
+    return -1;
+  }
+
+  uint8_t b = *p++;
+  zeros = (b == 0x00) ? zeros + 1 : 0;
+
+  return b;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+H264_AnnexB::H264_AnnexB() {
+  reset();
+  is_idr = false;
+  ref_idc = 0;
+  nal_count = 0;
+  vcl_type = 0;
+}
+
+void H264_AnnexB::reset() {
+  scan_offset = 0;
+  has_vcl = false;
+  cur_idr = false;
+  cur_ref_idc = 0;
+  cur_nal_count = 0;
+  cur_vcl_type = 0;
+}
+
+size_t H264_AnnexB::findAccessUnit(const uint8_t* data, size_t size, bool eof) {
+
+  const uint8_t* end = data + size;
+
+  while(scan_offset < size) {
+
+    const uint8_t* sc = h264_find_startcode(data + scan_offset, end);
+
+    if(sc == end) {
+      /* a start code may be split over the end of the data; we rescan the last bytes next time */
+      scan_offset = (size > 2) ? size - 2 : 0;
+      break;
+    }
+
+    if(end - sc < H264_ANNEXB_PEEK_SIZE && !eof) {
+      scan_offset = sc - data;
+      return 0;
+    }
+
+    const uint8_t* nal = sc + 3;
+    int nal_type = (nal < end) ? (nal[0] & 0x1F) : 0;
+    int nal_ref_idc = (nal < end) ? ((nal[0] >> 5) & 0x03) : 0;
+    bool first_slice = (nal + 1 < end) && (nal[1] & 0x80);
+    bool starts_au = false;
+
+    if(has_vcl) {
+      if(nal_type == H264_NAL_SEI
+         || nal_type == H264_NAL_SPS
+         || nal_type == H264_NAL_PPS
+         || nal_type == H264_NAL_AUD
+         || (nal_type >= 14 && nal_type <= 18))
+      {
+        starts_au = true;
+      }
+      else if((nal_type == H264_NAL_SLICE || nal_type == H264_NAL_DPA || nal_type == H264_NAL_IDR) && first_slice) {
+        starts_au = true;
+      }
+    }
+
+    if(starts_au) {
+
+      const uint8_t* au_end = (sc > data && sc[-1] == 0x00) ? sc - 1 : sc;
+
+      is_idr = cur_idr;
+      ref_idc = cur_ref_idc;
+      nal_count = cur_nal_count;
+      vcl_type = cur_vcl_type;
+      reset();
+
+      return au_end - data;
+    }
+
+    if(h264_is_vcl(nal_type)) {
+      cur_vcl_type = has_vcl ? cur_vcl_type : nal_type;
+      has_vcl = true;
+      cur_idr = cur_idr || (nal_type == H264_NAL_IDR);
+      cur_ref_idc = (nal_ref_idc > cur_ref_idc) ? nal_ref_idc : cur_ref_idc;
+    }
+
+    cur_nal_count++;
+    scan_offset = (sc - data) + 3;
+  }
+
+  if(eof && size > 0) {
+    is_idr = cur_idr;
+    ref_idc = cur_ref_idc;
+    nal_count = cur_nal_count;
+    vcl_type = cur_vcl_type;
+    reset();
+    return size;
+  }
+
+  return 0;
+}
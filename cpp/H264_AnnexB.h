@@ -0,0 +1,98 @@
+/*
+
+  H264_AnnexB
+  ---------------------------------------
+
+  Start code scanner and access unit splitter for H264 Annex B bitstreams.
+
+  `h264_find_startcode()` returns the position of the next `00 00 01` start code.
+  It uses SSE2 or AVX2 when the CPU supports it; the implementation is selected
+  once at runtime. The scalar version is used on other architectures and for
+  the last bytes of a buffer. A 4 byte start code (`00 00 00 01`) is found as
+  a 3 byte one that is preceded by a zero; `h264_next_nal()` takes care of that.
+
+  `H264_AnnexB` groups NAL units into access units (one coded picture each)
+  using the rules of H.264, 7.4.1.2.3: after we've seen the first VCL NAL of an
+  access unit, a new access unit starts with an access unit delimiter, SPS, PPS,
+  SEI, a NAL of type 14..18 or with the first slice of a new picture. A slice
+  is the first slice of a picture when first_mb_in_slice is 0, which means that
+  the first bit of the slice header is set (ue(v) of 0 is coded as `1`).
+
+  `h264_has_recovery_point()` tells you if an access unit contains a recovery
+  point SEI message (D.2.7): decoding can (re)start there, also when it's not
+  an IDR picture. Streams from encoders with intra refresh only have these.
+
+  Usage:
+
+      H264_AnnexB au;
+      size_t nbytes = au.findAccessUnit(data, size, eof);
+      if(nbytes) {
+        // [data, data + nbytes) is a complete access unit; the next call must
+        // start at data + nbytes.
+      }
+      else {
+        // need more data; call again with the same `data` and more bytes.
+      }
+
+ */
+#ifndef H264_ANNEXB_H
+#define H264_ANNEXB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define H264_NAL_SLICE 1                                                                /* coded slice of a non IDR picture */
+#define H264_NAL_DPA 2                                                                  /* coded slice data partition A */
+#define H264_NAL_DPB 3                                                                  /* coded slice data partition B */
+#define H264_NAL_DPC 4                                                                  /* coded slice data partition C */
+#define H264_NAL_IDR 5                                                                  /* coded slice of an IDR picture */
+#define H264_NAL_SEI 6                                                                  /* supplemental enhancement information */
+#define H264_NAL_SPS 7                                                                  /* sequence parameter set */
+#define H264_NAL_PPS 8                                                                  /* picture parameter set */
+#define H264_NAL_AUD 9                                                                  /* access unit delimiter */
+#define H264_NAL_END_SEQUENCE 10                                                        /* end of sequence */
+#define H264_NAL_END_STREAM 11                                                          /* end of stream */
+#define H264_SEI_RECOVERY_POINT 6                                                       /* payloadType of the recovery point SEI message */
+
+typedef const uint8_t*(*h264_find_startcode_func)(const uint8_t* p, const uint8_t* end);   /* returns the first `00 00 01` in [p, end) or `end` */
+
+struct H264_Nal {
+  const uint8_t* start;                                                                  /* first byte of the start code, including the leading zero of a 4 byte start code */
+  const uint8_t* data;                                                                   /* first byte of the NAL header */
+  size_t size;                                                                           /* number of bytes from `data` up to the next start code or the end of the buffer */
+  int type;                                                                              /* nal_unit_type */
+  int ref_idc;                                                                           /* nal_ref_idc */
+};
+
+const uint8_t* h264_find_startcode(const uint8_t* p, const uint8_t* end);               /* uses the fastest implementation for this CPU */
+const uint8_t* h264_find_startcode_c(const uint8_t* p, const uint8_t* end);             /* scalar implementation */
+const uint8_t* h264_find_startcode_sse2(const uint8_t* p, const uint8_t* end);          /* SSE2 implementation (always there on x86_64); the scalar one on other CPUs */
+const uint8_t* h264_find_startcode_avx2(const uint8_t* p, const uint8_t* end);          /* AVX2 implementation; only call it when h264_cpu_has_avx2() */
+bool h264_cpu_has_avx2();                                                                /* true when the CPU supports AVX2, see the _avx2 functions */
+const char* h264_find_startcode_name();                                                  /* name of the implementation that h264_find_startcode() uses */
+bool h264_next_nal(const uint8_t*& p, const uint8_t* end, H264_Nal& nal);                /* find the next NAL in [p, end); on success p is set to the start code of the NAL that follows */
+bool h264_is_vcl(int nalType);                                                           /* true for the NAL types that contain slice data */
+int h264_access_unit_info(const uint8_t* data, size_t size, bool& isIdr, int& refIdc);   /* scan a complete access unit; returns the nal_unit_type of its first slice (0 when it has none), sets isIdr and the highest nal_ref_idc */
+bool h264_has_recovery_point(const uint8_t* data, size_t size);                          /* true when the access unit contains a recovery point SEI message */
+
+class H264_AnnexB {
+
+ public:
+  H264_AnnexB();
+  void reset();                                                                          /* forget the state of the current access unit; call when you reposition the input */
+  size_t findAccessUnit(const uint8_t* data, size_t size, bool eof);                     /* returns the size of the access unit that starts at data, or 0 when we need more data; when eof is true the remaining bytes are returned as the last access unit */
+
+ public:
+  size_t scan_offset;                                                                    /* offset from where we continue scanning for start codes */
+  bool has_vcl;                                                                          /* true when the access unit we're scanning contains a slice */
+  bool cur_idr;                                                                          /* true when the access unit we're scanning contains an IDR slice */
+  int cur_ref_idc;                                                                       /* highest nal_ref_idc of the slices in the access unit we're scanning */
+  int cur_nal_count;                                                                     /* number of NAL units in the access unit we're scanning */
+  int cur_vcl_type;                                                                      /* nal_unit_type of the first slice in the access unit we're scanning */
+  bool is_idr;                                                                           /* true when the access unit returned by the last findAccessUnit() is an IDR picture */
+  int ref_idc;                                                                           /* highest nal_ref_idc of the slices in the returned access unit; 0 means non reference picture */
+  int nal_count;                                                                         /* number of NAL units in the returned access unit */
+  int vcl_type;                                                                          /* nal_unit_type of the first slice of the returned access unit; 0 when it has no slices */
+};
+
+#endif
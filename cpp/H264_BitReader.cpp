@@ -0,0 +1,366 @@
+#include <string.h>
+#include "H264_BitReader.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define H264_BITREADER_X86 1
+#  include <immintrin.h>
+#endif
+
+typedef const uint8_t*(*h264_find_epb_func)(const uint8_t* p, const uint8_t* end);
+
+static h264_unescape_rbsp_func unescape_rbsp = NULL;
+static h264_find_epb_func find_epb = NULL;
+static const char* unescape_rbsp_name = NULL;
+
+static void h264_select_unescape_func();
+static const uint8_t* h264_find_epb_c(const uint8_t* p, const uint8_t* end);
+static size_t h264_unescape_rbsp_with(h264_find_epb_func find, const uint8_t* src, size_t size, uint8_t* dest);
+
+/* ------------------------------------------------------------------------------ */
+
+H264_BitReader::H264_BitReader()
+  :data(NULL)
+  ,size(0)
+  ,next(NULL)
+  ,end(NULL)
+  ,cache(0)
+  ,cache_bits(0)
+  ,error(false)
+{
+}
+
+H264_BitReader::H264_BitReader(const uint8_t* d, size_t nbytes)
+  :data(NULL)
+  ,size(0)
+  ,next(NULL)
+  ,end(NULL)
+  ,cache(0)
+  ,cache_bits(0)
+  ,error(false)
+{
+  init(d, nbytes);
+}
+
+void H264_BitReader::init(const uint8_t* d, size_t nbytes) {
+  data = d;
+  size = (d) ? nbytes : 0;
+  next = data;
+  end = data + size;
+  cache = 0;
+  cache_bits = 0;
+  error = false;
+}
+
+uint32_t H264_BitReader::readUeSlow() {
+
+  int leading_zeros = 0;
+
+  while(readBit() == 0) {
+
+    if(error) {
+      return 0;
+    }
+
+    /* ue(v) of a 32 bit value never has more than 31 leading zeros */
+    if(++leading_zeros > 31) {
+      error = true;
+      return 0;
+    }
+  }
+
+  if(leading_zeros == 0) {
+    return 0;
+  }
+
+  return (uint32_t)(((uint64_t)1 << leading_zeros) - 1 + readBits(leading_zeros));
+}
+
+int32_t H264_BitReader::readSe() {
+
+  uint32_t k = readUe();
+
+  /* 1 -> 1, 2 -> -1, 3 -> 2, 4 -> -2, ... */
+  if(k & 0x01) {
+    return (int32_t)((k + 1) >> 1);
+  }
+
+  return -(int32_t)(k >> 1);
+}
+
+void H264_BitReader::skipBits(size_t n) {
+
+  if(n > bitsLeft()) {
+    next = end;
+    cache = 0;
+    cache_bits = 0;
+    error = true;
+    return;
+  }
+
+  if(n < (size_t)cache_bits) {
+    cache <<= n;
+    cache_bits -= (int)n;
+    return;
+  }
+
+  /* drop the cache and continue at the byte we need */
+  n -= cache_bits;
+  cache = 0;
+  cache_bits = 0;
+  next += n >> 3;
+  readBits((int)(n & 7));
+}
+
+bool H264_BitReader::moreRbspData() {
+
+  size_t left = bitsLeft();
+
+  if(left == 0) {
+    return false;
+  }
+
+  /* the last 1 bit of the rbsp is the rbsp_stop_one_bit; everything after it is zero */
+  size_t last = size;
+  while(last > 0 && data[last - 1] == 0x00) {
+    last--;
+  }
+
+  if(last == 0) {
+    return false;
+  }
+
+  uint8_t b = data[last - 1];
+  size_t stop_bit = (last - 1) * 8 + 7;
+
+  while((b & 0x01) == 0) {
+    b >>= 1;
+    stop_bit--;
+  }
+
+  return position() < stop_bit;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+size_t h264_unescape_rbsp_c(const uint8_t* src, size_t size, uint8_t* dest) {
+
+  size_t written = 0;
+  int zeros = 0;
+
+  for(size_t i = 0; i < size; ++i) {
+
+    uint8_t b = src[i];
+
+    /* 00 00 03 -> 00 00 */
+    if(zeros >= 2 && b == 0x03) {
+      zeros = 0;
+      continue;
+    }
+
+    dest[written++] = b;
+    zeros = (b == 0x00) ? zeros + 1 : 0;
+  }
+
+  return written;
+}
+
+/* returns the first `00 00 03` in [p, end), or end */
+static const uint8_t* h264_find_epb_c(const uint8_t* p, const uint8_t* end) {
+
+  if(end - p < 3) {
+    return end;
+  }
+
+  const uint8_t* last = end - 2;
+
+  /* same idea as h264_find_startcode_c(): when the third byte is not 00 or 03 we skip 3 bytes */
+  while(p < last) {
+    if(p[2] != 0x00 && p[2] != 0x03) {
+      p += 3;
+    }
+    else if(p[1]) {
+      p += 2;
+    }
+    else if(p[0] || p[2] != 0x03) {
+      p += 1;
+    }
+    else {
+      return p;
+    }
+  }
+
+  return end;
+}
+
+/*
+   Copies the bytes between the emulation prevention bytes with memcpy. After
+   an emulation prevention byte we continue the search behind it, so its zeros
+   never count for the next one; this gives the same result as the scalar
+   reference.
+*/
+static size_t h264_unescape_rbsp_with(h264_find_epb_func find, const uint8_t* src, size_t size, uint8_t* dest) {
+
+  const uint8_t* p = src;
+  const uint8_t* end = src + size;
+  uint8_t* out = dest;
+
+  while(p < end) {
+
+    const uint8_t* epb = find(p, end);
+
+    if(epb == end) {
+      memcpy(out, p, end - p);
+      out += end - p;
+      break;
+    }
+
+    /* keep the 00 00, drop the 03 */
+    memcpy(out, p, (epb + 2) - p);
+    out += (epb + 2) - p;
+    p = epb + 3;
+  }
+
+  return out - dest;
+}
+
+#if defined(H264_BITREADER_X86)
+
+__attribute__((target("sse2")))
+static const uint8_t* h264_find_epb_sse2(const uint8_t* p, const uint8_t* end) {
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i three = _mm_set1_epi8(3);
+
+  /* we load 16 bytes at p, p + 1 and p + 2 */
+  while(end - p >= 18) {
+
+    __m128i a = _mm_loadu_si128((const __m128i*)p);
+    __m128i b = _mm_loadu_si128((const __m128i*)(p + 1));
+    __m128i c = _mm_loadu_si128((const __m128i*)(p + 2));
+    __m128i m = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)), _mm_cmpeq_epi8(c, three));
+    int mask = _mm_movemask_epi8(m);
+
+    if(mask) {
+      return p + __builtin_ctz(mask);
+    }
+
+    p += 16;
+  }
+
+  return h264_find_epb_c(p, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t* h264_find_epb_avx2(const uint8_t* p, const uint8_t* end) {
+
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i three = _mm256_set1_epi8(3);
+
+  /* we load 32 bytes at p, p + 1 and p + 2 */
+  while(end - p >= 34) {
+
+    __m256i a = _mm256_loadu_si256((const __m256i*)p);
+    __m256i b = _mm256_loadu_si256((const __m256i*)(p + 1));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(p + 2));
+    __m256i m = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(b, zero)), _mm256_cmpeq_epi8(c, three));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+
+    if(mask) {
+      return p + __builtin_ctz(mask);
+    }
+
+    p += 32;
+  }
+
+  return h264_find_epb_sse2(p, end);
+}
+
+size_t h264_unescape_rbsp_sse2(const uint8_t* src, size_t size, uint8_t* dest) {
+  return h264_unescape_rbsp_with(h264_find_epb_sse2, src, size, dest);
+}
+
+size_t h264_unescape_rbsp_avx2(const uint8_t* src, size_t size, uint8_t* dest) {
+  return h264_unescape_rbsp_with(h264_find_epb_avx2, src, size, dest);
+}
+
+static void h264_select_unescape_func() {
+
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx2")) {
+    unescape_rbsp_name = "avx2";
+    find_epb = h264_find_epb_avx2;
+    unescape_rbsp = h264_unescape_rbsp_avx2;
+  }
+  else if(__builtin_cpu_supports("sse2")) {
+    unescape_rbsp_name = "sse2";
+    find_epb = h264_find_epb_sse2;
+    unescape_rbsp = h264_unescape_rbsp_sse2;
+  }
+  else {
+    unescape_rbsp_name = "c";
+    find_epb = h264_find_epb_c;
+    unescape_rbsp = h264_unescape_rbsp_c;
+  }
+}
+
+#else
+
+size_t h264_unescape_rbsp_sse2(const uint8_t* src, size_t size, uint8_t* dest) {
+  return h264_unescape_rbsp_c(src, size, dest);
+}
+
+size_t h264_unescape_rbsp_avx2(const uint8_t* src, size_t size, uint8_t* dest) {
+  return h264_unescape_rbsp_c(src, size, dest);
+}
+
+static void h264_select_unescape_func() {
+  unescape_rbsp_name = "c";
+  find_epb = h264_find_epb_c;
+  unescape_rbsp = h264_unescape_rbsp_c;
+}
+
+#endif
+
+size_t h264_unescape_rbsp(const uint8_t* src, size_t size, uint8_t* dest) {
+
+  /* all threads select the same function, so a race here is harmless */
+  if(!unescape_rbsp) {
+    h264_select_unescape_func();
+  }
+
+  return unescape_rbsp(src, size, dest);
+}
+
+const char* h264_unescape_rbsp_name() {
+
+  if(!unescape_rbsp) {
+    h264_select_unescape_func();
+  }
+
+  return unescape_rbsp_name;
+}
+
+const uint8_t* h264_rbsp(const uint8_t* src, size_t size, std::vector<uint8_t>& buffer, size_t& rbspSize) {
+
+  if(!unescape_rbsp || !find_epb) {
+    h264_select_unescape_func();
+  }
+
+  const uint8_t* end = src + size;
+  const uint8_t* epb = find_epb(src, end);
+
+  if(epb == end) {
+    rbspSize = size;
+    return src;
+  }
+
+  /* we already know where the first one is, so we only unescape what comes after it */
+  size_t head = (epb + 2) - src;
+
+  buffer.resize(size);
+  memcpy(&buffer[0], src, head);
+  rbspSize = head + h264_unescape_rbsp(epb + 3, end - (epb + 3), &buffer[head]);
+
+  return &buffer[0];
+}
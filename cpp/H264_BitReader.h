@@ -0,0 +1,170 @@
+/*
+
+  H264_BitReader
+  ---------------------------------------
+
+  Reads the syntax elements of H264 headers (SPS, PPS, slice headers, SEI)
+  from a RBSP: fixed size values with `readBits()` and the Exp-Golomb codes
+  ue(v) and se(v) with `readUe()` and `readSe()`. Reading past the end of the
+  data returns zeros and sets `error`; check it once after parsing instead of
+  after every read.
+
+  The reader keeps up to 64 bits in a cache which we refill with one 8 byte
+  big endian load when possible. A ue(v) code that fits in the cache is read
+  with one count leading zeros and one shift instead of bit by bit.
+
+  The payload of a NAL unit contains emulation prevention bytes: the encoder
+  inserts a `03` after every `00 00` that is followed by a byte <= 3, so the
+  payload never contains a start code. Use `h264_unescape_rbsp()` to remove
+  them before you read the payload with the bit reader, or `h264_rbsp()`,
+  which only copies when the payload contains emulation prevention bytes
+  (most headers don't). Like the start code scanner (see H264_AnnexB), the
+  search for `00 00 03` uses SSE2 or AVX2 when the CPU supports it;
+  `h264_unescape_rbsp_c()` is the scalar reference.
+
+  Usage:
+
+      std::vector<uint8_t> buffer;
+      size_t rbsp_size = 0;
+      const uint8_t* rbsp = h264_rbsp(nal.data + 1, nal.size - 1, buffer, rbsp_size);
+
+      H264_BitReader br(rbsp, rbsp_size);
+      uint32_t profile_idc = br.readBits(8);
+      ...
+      if(br.error) { ... }
+
+ */
+#ifndef H264_BITREADER_H
+#define H264_BITREADER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+typedef size_t(*h264_unescape_rbsp_func)(const uint8_t* src, size_t size, uint8_t* dest);  /* copies src into dest without the emulation prevention bytes, returns the number of bytes written */
+
+class H264_BitReader {
+
+ public:
+  H264_BitReader();
+  H264_BitReader(const uint8_t* data, size_t size);
+  void init(const uint8_t* data, size_t size);                                           /* start reading at the first bit of data */
+  uint32_t readBits(int n);                                                              /* read n (0..32) bits, msb first */
+  uint32_t readBit();                                                                    /* read one bit */
+  uint32_t readUe();                                                                     /* read an unsigned Exp-Golomb code, ue(v) */
+  int32_t readSe();                                                                      /* read a signed Exp-Golomb code, se(v) */
+  void skipBits(size_t n);                                                               /* skip n bits */
+  size_t position();                                                                     /* number of bits we've read */
+  size_t bitsLeft();                                                                     /* number of bits we haven't read */
+  bool moreRbspData();                                                                   /* true when there is more data before the rbsp_trailing_bits */
+
+ private:
+  void refill();                                                                         /* fill the cache with as many whole bytes as fit */
+  uint32_t readUeSlow();                                                                 /* readUe() for codes that don't fit in the cache */
+
+ public:
+  const uint8_t* data;                                                                   /* the RBSP we read from */
+  size_t size;                                                                           /* size of data in bytes */
+  const uint8_t* next;                                                                   /* the next byte we load into the cache */
+  const uint8_t* end;                                                                    /* data + size */
+  uint64_t cache;                                                                        /* the next bits, msb first; the bits after `cache_bits` are zero */
+  int cache_bits;                                                                        /* number of valid bits in the cache */
+  bool error;                                                                            /* set when we read past the end */
+};
+
+size_t h264_unescape_rbsp(const uint8_t* src, size_t size, uint8_t* dest);               /* copy src into dest without the emulation prevention bytes; returns the number of bytes written (<= size); uses the fastest implementation for this CPU */
+size_t h264_unescape_rbsp_c(const uint8_t* src, size_t size, uint8_t* dest);             /* scalar reference implementation */
+size_t h264_unescape_rbsp_sse2(const uint8_t* src, size_t size, uint8_t* dest);          /* SSE2 implementation (always there on x86_64); the scalar one on other CPUs */
+size_t h264_unescape_rbsp_avx2(const uint8_t* src, size_t size, uint8_t* dest);          /* AVX2 implementation; only call it when h264_cpu_has_avx2() (H264_AnnexB.h) */
+const char* h264_unescape_rbsp_name();                                                   /* name of the implementation that h264_unescape_rbsp() uses */
+const uint8_t* h264_rbsp(const uint8_t* src, size_t size, std::vector<uint8_t>& buffer, size_t& rbspSize);  /* returns src when it has no emulation prevention bytes, otherwise the unescaped copy in buffer */
+
+inline size_t H264_BitReader::position() {
+  return (size_t)(next - data) * 8 - (size_t)cache_bits;
+}
+
+inline size_t H264_BitReader::bitsLeft() {
+  return size * 8 - position();
+}
+
+inline void H264_BitReader::refill() {
+
+  if(end - next >= 8) {
+
+    /* whole bytes only, so `next` stays byte aligned */
+    int nbytes = (64 - cache_bits) >> 3;
+    if(nbytes == 0) {
+      return;
+    }
+
+    uint64_t v;
+    __builtin_memcpy(&v, next, 8);
+    v = __builtin_bswap64(v);
+
+    int total = cache_bits + nbytes * 8;
+    if(cache_bits) {
+      v >>= cache_bits;
+    }
+    if(total < 64) {
+      v &= ~0ull << (64 - total);
+    }
+
+    cache |= v;
+    cache_bits = total;
+    next += nbytes;
+    return;
+  }
+
+  while(cache_bits <= 56 && next < end) {
+    cache |= (uint64_t)(*next++) << (56 - cache_bits);
+    cache_bits += 8;
+  }
+}
+
+inline uint32_t H264_BitReader::readBits(int n) {
+
+  if(n == 0) {
+    return 0;
+  }
+
+  if(cache_bits < n) {
+    refill();
+    if(cache_bits < n) {
+      error = true;
+      cache_bits = n;                                                                    /* the missing bits are zero */
+    }
+  }
+
+  uint32_t result = (uint32_t)(cache >> (64 - n));
+  cache <<= n;
+  cache_bits -= n;
+
+  return result;
+}
+
+inline uint32_t H264_BitReader::readBit() {
+  return readBits(1);
+}
+
+inline uint32_t H264_BitReader::readUe() {
+
+  if(cache_bits < 32) {
+    refill();
+  }
+
+  /* a code with n leading zeros has 2n + 1 bits; when it fits in the cache n <= 31 */
+  if(cache) {
+    int leading_zeros = __builtin_clzll(cache);
+    int code_bits = 2 * leading_zeros + 1;
+    if(code_bits <= cache_bits) {
+      uint32_t result = (uint32_t)((cache >> (64 - code_bits)) - 1);
+      cache <<= code_bits;
+      cache_bits -= code_bits;
+      return result;
+    }
+  }
+
+  return readUeSlow();
+}
+
+#endif
@@ -0,0 +1,579 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include "H264_ByteSource.h"
+
+/* ------------------------------------------------------------------------------ */
+
+H264_FileSource::H264_FileSource()
+  :fp(NULL)
+{
+}
+
+H264_FileSource::~H264_FileSource() {
+
+  if(fp) {
+    fclose(fp);
+    fp = NULL;
+  }
+}
+
+bool H264_FileSource::open(std::string filepath) {
+
+  if(fp) {
+    printf("Error: file source already opened.\n");
+    return false;
+  }
+
+  fp = fopen(filepath.c_str(), "rb");
+
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+int H264_FileSource::read(uint8_t* dest, size_t nbytes) {
+
+  size_t bytes_read = fread(dest, 1, nbytes, fp);
+
+  if(bytes_read == 0 && ferror(fp)) {
+    return H264_SOURCE_ERROR;
+  }
+
+  return (int)bytes_read;
+}
+
+bool H264_FileSource::seek(uint64_t offset) {
+  return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+}
+
+int H264_FileSource::fd() {
+  return (fp) ? fileno(fp) : -1;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+H264_MmapSource::H264_MmapSource()
+  :map_data(NULL)
+  ,map_size(0)
+  ,offset(0)
+{
+}
+
+H264_MmapSource::~H264_MmapSource() {
+
+  if(map_data) {
+    munmap(map_data, map_size);
+    map_data = NULL;
+  }
+
+  map_size = 0;
+  offset = 0;
+}
+
+bool H264_MmapSource::open(std::string filepath) {
+
+  if(map_data) {
+    printf("Error: mmap source already opened.\n");
+    return false;
+  }
+
+  int fd = ::open(filepath.c_str(), O_RDONLY);
+  if(fd < 0) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.st_size == 0) {
+    printf("Error: cannot map an empty file: %s\n", filepath.c_str());
+    ::close(fd);
+    return false;
+  }
+
+  void* ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if(ptr == MAP_FAILED) {
+    printf("Error: cannot mmap: %s\n", filepath.c_str());
+    return false;
+  }
+
+  madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  map_data = (uint8_t*)ptr;
+  map_size = (size_t)st.st_size;
+  offset = 0;
+
+  return true;
+}
+
+int H264_MmapSource::read(uint8_t* dest, size_t nbytes) {
+
+  nbytes = std::min(nbytes, map_size - offset);
+  memcpy(dest, map_data + offset, nbytes);
+  offset += nbytes;
+
+  return (int)nbytes;
+}
+
+bool H264_MmapSource::seek(uint64_t newOffset) {
+
+  if(newOffset > map_size) {
+    return false;
+  }
+
+  offset = (size_t)newOffset;
+
+  return true;
+}
+
+const uint8_t* H264_MmapSource::map(size_t& nbytes) {
+  nbytes = map_size;
+  return map_data;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+H264_FdSource::H264_FdSource()
+  :sock(-1)
+  ,epoll_fd(-1)
+  ,saved_flags(-1)
+  ,owner(false)
+{
+}
+
+H264_FdSource::~H264_FdSource() {
+
+  if(epoll_fd >= 0) {
+    ::close(epoll_fd);
+    epoll_fd = -1;
+  }
+
+  /* stdin is shared with our parent; give it back the way we got it */
+  if(sock >= 0 && !owner && saved_flags >= 0) {
+    fcntl(sock, F_SETFL, saved_flags);
+  }
+
+  if(sock >= 0 && owner) {
+    ::close(sock);
+  }
+
+  sock = -1;
+  saved_flags = -1;
+}
+
+bool H264_FdSource::open(std::string path) {
+
+  /* a blocking open waits for the writer of a fifo; opened non blocking, read() returns 0 (the end) until a writer connects */
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0) {
+    printf("Error: cannot open: %s\n", path.c_str());
+    return false;
+  }
+
+  return openDescriptor(fd, true);
+}
+
+bool H264_FdSource::openDescriptor(int fd, bool isOwner) {
+
+  if(sock >= 0) {
+    printf("Error: fd source already opened.\n");
+    return false;
+  }
+
+  sock = fd;
+  owner = isOwner;
+
+  return setup();
+}
+
+bool H264_FdSource::connectUnix(std::string path) {
+
+  struct sockaddr_un addr;
+
+  if(path.size() >= sizeof(addr.sun_path)) {
+    printf("Error: unix socket path too long: %s\n", path.c_str());
+    return false;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0) {
+    printf("Error: cannot create a unix socket.\n");
+    return false;
+  }
+
+  memset(&addr, 0x00, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size());
+
+  if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    printf("Error: cannot connect to: %s\n", path.c_str());
+    ::close(fd);
+    return false;
+  }
+
+  return openDescriptor(fd, true);
+}
+
+bool H264_FdSource::connectTcp(std::string host, std::string port) {
+
+  struct addrinfo hints;
+  struct addrinfo* result = NULL;
+
+  memset(&hints, 0x00, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if(getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+    printf("Error: cannot resolve: %s:%s\n", host.c_str(), port.c_str());
+    return false;
+  }
+
+  int fd = -1;
+
+  for(struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if(fd < 0) {
+      continue;
+    }
+
+    if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      break;
+    }
+
+    ::close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(result);
+
+  if(fd < 0) {
+    printf("Error: cannot connect to: %s:%s\n", host.c_str(), port.c_str());
+    return false;
+  }
+
+  return openDescriptor(fd, true);
+}
+
+bool H264_FdSource::setup() {
+
+  int flags = fcntl(sock, F_GETFL, 0);
+  if(flags < 0) {
+    printf("Error: cannot get the descriptor flags.\n");
+    return false;
+  }
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if(epoll_fd < 0) {
+    printf("Error: cannot create an epoll instance.\n");
+    return false;
+  }
+
+  struct epoll_event ev;
+  memset(&ev, 0x00, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.fd = sock;
+
+  if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &ev) < 0) {
+
+    /* regular files (e.g. `decoder - < file.h264`) and some devices can't be polled, but reading them never blocks for long */
+    if(errno == EPERM) {
+      ::close(epoll_fd);
+      epoll_fd = -1;
+      return true;
+    }
+
+    printf("Error: cannot add the descriptor to epoll.\n");
+    return false;
+  }
+
+  if(0 == (flags & O_NONBLOCK)) {
+    if(fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+      printf("Error: cannot make the descriptor non blocking.\n");
+      return false;
+    }
+    saved_flags = flags;
+  }
+
+  return true;
+}
+
+int H264_FdSource::read(uint8_t* dest, size_t nbytes) {
+
+  while(true) {
+
+    ssize_t r = ::read(sock, dest, nbytes);
+
+    if(r >= 0) {
+      return (int)r;
+    }
+
+    if(errno == EINTR) {
+      continue;
+    }
+
+    if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      return H264_SOURCE_AGAIN;
+    }
+
+    return H264_SOURCE_ERROR;
+  }
+}
+
+bool H264_FdSource::wait(int timeoutMs) {
+
+  struct epoll_event ev;
+  int r = 0;
+
+  /* a descriptor we can't poll is read blocking */
+  if(epoll_fd < 0) {
+    return true;
+  }
+
+  do {
+    r = epoll_wait(epoll_fd, &ev, 1, timeoutMs);
+  } while(r < 0 && errno == EINTR);
+
+  /* also true for EPOLLHUP/EPOLLERR; the next read() returns the end or the error */
+  return r > 0;
+}
+
+int H264_FdSource::fd() {
+  return sock;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+H264_ReadAheadSource::H264_ReadAheadSource()
+  :stream(NULL)
+{
+}
+
+H264_ReadAheadSource::~H264_ReadAheadSource() {
+
+  if(stream) {
+    ioring_stream_close(stream);
+    stream = NULL;
+  }
+}
+
+bool H264_ReadAheadSource::open(std::string filepath, unsigned int depth) {
+
+  if(stream) {
+    printf("Error: read ahead source already opened.\n");
+    return false;
+  }
+
+  ioring_engine_t* engine = ioring_shared();
+  if(!engine) {
+    printf("Error: cannot create the read ahead engine.\n");
+    return false;
+  }
+
+  stream = ioring_stream_open_path(engine, filepath.c_str(), depth);
+  if(!stream) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+int H264_ReadAheadSource::read(uint8_t* dest, size_t nbytes) {
+
+  ssize_t r = ioring_stream_read(stream, dest, nbytes);
+
+  if(r < 0) {
+    return H264_SOURCE_ERROR;
+  }
+
+  return (int)r;
+}
+
+bool H264_ReadAheadSource::seek(uint64_t offset) {
+  return ioring_stream_seek(stream, offset) == 0;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+H264_RangeSource::H264_RangeSource()
+  :fp(NULL)
+  ,range_begin(0)
+  ,range_end(0)
+  ,position(0)
+  ,prefix_offset(0)
+{
+}
+
+H264_RangeSource::~H264_RangeSource() {
+
+  if(fp) {
+    fclose(fp);
+    fp = NULL;
+  }
+}
+
+bool H264_RangeSource::open(std::string filepath, uint64_t begin, uint64_t end, const std::vector<uint8_t>& prefixBytes) {
+
+  if(fp) {
+    printf("Error: range source already opened.\n");
+    return false;
+  }
+
+  if(begin > end) {
+    printf("Error: invalid range: %llu - %llu\n", (unsigned long long)begin, (unsigned long long)end);
+    return false;
+  }
+
+  fp = fopen(filepath.c_str(), "rb");
+
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  if(fseeko(fp, (off_t)begin, SEEK_SET) != 0) {
+    printf("Error: cannot seek to %llu in: %s\n", (unsigned long long)begin, filepath.c_str());
+    fclose(fp);
+    fp = NULL;
+    return false;
+  }
+
+  range_begin = begin;
+  range_end = end;
+  position = begin;
+  prefix = prefixBytes;
+  prefix_offset = 0;
+
+  return true;
+}
+
+int H264_RangeSource::read(uint8_t* dest, size_t nbytes) {
+
+  if(prefix_offset < prefix.size()) {
+    nbytes = std::min(nbytes, prefix.size() - prefix_offset);
+    memcpy(dest, &prefix[prefix_offset], nbytes);
+    prefix_offset += nbytes;
+    return (int)nbytes;
+  }
+
+  nbytes = (size_t)std::min((uint64_t)nbytes, range_end - position);
+
+  if(nbytes == 0) {
+    return 0;
+  }
+
+  size_t bytes_read = fread(dest, 1, nbytes, fp);
+
+  if(bytes_read == 0 && ferror(fp)) {
+    return H264_SOURCE_ERROR;
+  }
+
+  position += bytes_read;
+
+  return (int)bytes_read;
+}
+
+bool H264_RangeSource::seek(uint64_t offset) {
+
+  if(offset < range_begin || offset > range_end) {
+    return false;
+  }
+
+  if(fseeko(fp, (off_t)offset, SEEK_SET) != 0) {
+    return false;
+  }
+
+  position = offset;
+  prefix_offset = prefix.size();
+
+  return true;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+H264_ByteSource* h264_open_source(std::string uri, bool useMmap, unsigned int readAhead) {
+
+  if(uri == "-" || uri == "stdin") {
+    H264_FdSource* src = new H264_FdSource();
+    if(!src->openDescriptor(STDIN_FILENO, false)) {
+      delete src;
+      return NULL;
+    }
+    return src;
+  }
+
+  if(uri.compare(0, 5, "unix:") == 0) {
+    H264_FdSource* src = new H264_FdSource();
+    if(!src->connectUnix(uri.substr(5))) {
+      delete src;
+      return NULL;
+    }
+    return src;
+  }
+
+  if(uri.compare(0, 4, "tcp:") == 0) {
+
+    size_t colon = uri.rfind(':');
+    if(colon <= 4) {
+      printf("Error: invalid tcp uri, use tcp:host:port: %s\n", uri.c_str());
+      return NULL;
+    }
+
+    H264_FdSource* src = new H264_FdSource();
+    if(!src->connectTcp(uri.substr(4, colon - 4), uri.substr(colon + 1))) {
+      delete src;
+      return NULL;
+    }
+    return src;
+  }
+
+  struct stat st;
+  if(stat(uri.c_str(), &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode))) {
+    H264_FdSource* src = new H264_FdSource();
+    if(!src->open(uri)) {
+      delete src;
+      return NULL;
+    }
+    return src;
+  }
+
+  if(useMmap) {
+    H264_MmapSource* src = new H264_MmapSource();
+    if(!src->open(uri)) {
+      delete src;
+      return NULL;
+    }
+    return src;
+  }
+
+  if(readAhead > 0) {
+    H264_ReadAheadSource* src = new H264_ReadAheadSource();
+    if(!src->open(uri, readAhead)) {
+      delete src;
+      return NULL;
+    }
+    return src;
+  }
+
+  H264_FileSource* src = new H264_FileSource();
+  if(!src->open(uri)) {
+    delete src;
+    return NULL;
+  }
+
+  return src;
+}
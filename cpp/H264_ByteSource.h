@@ -0,0 +1,153 @@
+/*
+
+  H264_ByteSource
+  ---------------------------------------
+
+  The input of the H264_Decoder. A byte source hands out the bitstream in
+  chunks with `read()`; there are implementations for regular files, mapped
+  files, pipes/stdin and unix/tcp sockets, so you can decode a live Annex B
+  stream from a local encoder process without writing it to disk first.
+
+  `h264_open_source()` picks the implementation from the uri you pass to
+  `H264_Decoder::load()`:
+
+      "-" or "stdin"           read from stdin
+      "unix:/path/to/socket"   connect to a unix domain stream socket
+      "tcp:host:port"          connect to a tcp server
+      a fifo or device         H264_FdSource
+      anything else            H264_FileSource, or H264_MmapSource for H264_INPUT_MMAP,
+                               or H264_ReadAheadSource when a read ahead depth is given
+
+  Pipes and sockets are non blocking: `read()` returns H264_SOURCE_AGAIN when
+  no data is available yet and `wait()` blocks on an epoll instance until the
+  descriptor becomes readable (or the timeout expires). When we make stdin
+  non blocking we restore its flags in the d'tor, as the file description is
+  shared with the shell. Stdin redirected from a regular file can't be polled;
+  we read it blocking. Opening a fifo blocks until a writer opened the other
+  end. Only files can seek, so the index and seeking only work for files.
+
+  H264_RangeSource reads a byte range of a file, optionally preceded by some
+  bytes you give it. H264_GopDecoder uses it to decode a part of a file that
+  starts at an IDR, with the parameter sets of the stream in front of it.
+
+  H264_ReadAheadSource keeps `depth` large reads in flight on the shared ioring
+  engine (io_uring, or a thread pool when that's not available; see ioring.h).
+  Use it when many decoders read from slow or network attached disks. The read
+  size and backend are those of `ioring_shared()`; call `ioring_shared_init()`
+  before the first decoder is loaded to change them.
+
+  `map()` returns the whole input when it is available in memory (only for
+  H264_MmapSource); the decoder parses directly from it in that case.
+
+ */
+#ifndef H264_BYTESOURCE_H
+#define H264_BYTESOURCE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "../ioring.h"
+
+#define H264_SOURCE_AGAIN -1                                                            /* read() returns this when a non blocking source has no data yet */
+#define H264_SOURCE_ERROR -2                                                            /* read() returns this when reading failed */
+
+class H264_ByteSource {
+
+ public:
+  virtual ~H264_ByteSource() {}
+  virtual int read(uint8_t* dest, size_t nbytes) = 0;                                    /* read max nbytes; returns the number of bytes, 0 at the end of the input, H264_SOURCE_AGAIN or H264_SOURCE_ERROR */
+  virtual bool wait(int timeoutMs) { return true; }                                      /* wait until read() may return data; returns false on timeout */
+  virtual bool seek(uint64_t offset) { return false; }                                   /* reposition the input; only supported by files */
+  virtual const uint8_t* map(size_t& nbytes) { nbytes = 0; return NULL; }                /* returns the whole input when it's in memory */
+  virtual int fd() { return -1; }                                                        /* descriptor you can add to your own poll loop, -1 when there is none */
+};
+
+class H264_FileSource : public H264_ByteSource {
+
+ public:
+  H264_FileSource();
+  ~H264_FileSource();
+  bool open(std::string filepath);                                                       /* open a file for reading */
+  int read(uint8_t* dest, size_t nbytes);
+  bool seek(uint64_t offset);
+  int fd();
+
+ public:
+  FILE* fp;                                                                              /* the file we read from */
+};
+
+class H264_MmapSource : public H264_ByteSource {
+
+ public:
+  H264_MmapSource();
+  ~H264_MmapSource();
+  bool open(std::string filepath);                                                       /* map the whole file */
+  int read(uint8_t* dest, size_t nbytes);                                                /* copies from the mapping; the decoder uses map() instead */
+  bool seek(uint64_t offset);
+  const uint8_t* map(size_t& nbytes);
+
+ public:
+  uint8_t* map_data;                                                                     /* the mapped file */
+  size_t map_size;                                                                       /* size of the mapped file */
+  size_t offset;                                                                         /* read position used by read() */
+};
+
+class H264_FdSource : public H264_ByteSource {
+
+ public:
+  H264_FdSource();
+  ~H264_FdSource();
+  bool open(std::string path);                                                           /* open a fifo or device */
+  bool openDescriptor(int fd, bool isOwner);                                             /* use an existing descriptor, e.g. 0 for stdin or one end of a pipe(); closed in the d'tor when owner is true */
+  bool connectUnix(std::string path);                                                    /* connect to a unix domain stream socket */
+  bool connectTcp(std::string host, std::string port);                                   /* connect to a tcp server */
+  int read(uint8_t* dest, size_t nbytes);
+  bool wait(int timeoutMs);
+  int fd();
+
+ private:
+  bool setup();                                                                          /* makes the descriptor non blocking and adds it to our epoll instance; leaves descriptors we can't poll blocking */
+
+ public:
+  int sock;                                                                              /* the descriptor we read from */
+  int epoll_fd;                                                                          /* epoll instance we use in wait(); -1 when the descriptor can't be polled */
+  int saved_flags;                                                                       /* the flags before we set O_NONBLOCK, -1 when we didn't change them */
+  bool owner;                                                                            /* when true we close `sock` */
+};
+
+class H264_ReadAheadSource : public H264_ByteSource {
+
+ public:
+  H264_ReadAheadSource();
+  ~H264_ReadAheadSource();
+  bool open(std::string filepath, unsigned int depth);                                   /* open a file and start reading ahead; depth is the number of reads in flight, 0 uses the engine default */
+  int read(uint8_t* dest, size_t nbytes);
+  bool seek(uint64_t offset);
+
+ public:
+  ioring_stream_t* stream;                                                               /* the read ahead stream on the shared engine */
+};
+
+class H264_RangeSource : public H264_ByteSource {
+
+ public:
+  H264_RangeSource();
+  ~H264_RangeSource();
+  bool open(std::string filepath, uint64_t begin, uint64_t end, const std::vector<uint8_t>& prefix);  /* read [begin, end) of a file; `prefix` is returned before the first byte of the range */
+  int read(uint8_t* dest, size_t nbytes);
+  bool seek(uint64_t offset);                                                            /* offset in the file; must be inside the range, the prefix is not returned again */
+
+ public:
+  FILE* fp;                                                                              /* the file we read from */
+  uint64_t range_begin;                                                                  /* first byte of the range */
+  uint64_t range_end;                                                                    /* one past the last byte of the range */
+  uint64_t position;                                                                     /* file offset of the next byte we read */
+  std::vector<uint8_t> prefix;                                                           /* bytes we return before the range, e.g. parameter sets */
+  size_t prefix_offset;                                                                  /* number of prefix bytes we returned */
+};
+
+H264_ByteSource* h264_open_source(std::string uri, bool useMmap, unsigned int readAhead = 0);/* creates and opens the source for the given uri, see above; readAhead > 0 reads files ahead; returns NULL on error */
+
+#endif
@@ -0,0 +1,64 @@
+#include <time.h>
+#include <errno.h>
+#include <tinylib_trace.h>
+#include "H264_Clock.h"
+
+H264_Clock::H264_Clock() {
+  reset();
+  late_frames = 0;
+  frames = 0;
+}
+
+void H264_Clock::reset() {
+  started = false;
+  start_time = 0;
+  start_pts = 0;
+  last_lateness = 0;
+  max_lateness = 0;
+}
+
+int64_t H264_Clock::waitUntil(int64_t pts) {
+
+  if(!started) {
+    started = true;
+    start_time = rx_hrtime();
+    start_pts = pts;
+  }
+
+  int64_t deadline = (int64_t)start_time + (pts - start_pts);
+  int64_t now = (int64_t)rx_hrtime();
+
+  if(deadline > now) {
+
+#if defined(__linux)
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ll;
+    ts.tv_nsec = deadline % 1000000000ll;
+
+    /* restart when a signal interrupted us; the deadline is absolute so we don't drift */
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+#else
+    struct timespec ts;
+    ts.tv_sec = (deadline - now) / 1000000000ll;
+    ts.tv_nsec = (deadline - now) % 1000000000ll;
+    nanosleep(&ts, NULL);
+#endif
+
+    now = (int64_t)rx_hrtime();
+  }
+
+  last_lateness = now - deadline;
+
+  if(last_lateness > max_lateness) {
+    max_lateness = last_lateness;
+  }
+
+  if(last_lateness > H264_CLOCK_LATE_NS) {
+    late_frames++;
+  }
+
+  frames++;
+
+  return last_lateness;
+}
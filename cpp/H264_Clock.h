@@ -0,0 +1,41 @@
+/*
+
+  H264_Clock
+  ---------------------------------------
+
+  Presentation clock used by the H264_Decoder when pacing is set to
+  H264_PACING_CLOCK. The first frame we present defines the start of the
+  timeline; every next frame is presented at `start_time + (pts - start_pts)`.
+  `waitUntil()` sleeps until that deadline with an absolute
+  clock_nanosleep(CLOCK_MONOTONIC), so there is no drift and no busy polling.
+  It returns how late we were: a few microseconds after a sleep, more when
+  the frame was decoded after its deadline.
+
+  All times are in nanoseconds; rx_hrtime() uses the same monotonic clock.
+
+ */
+#ifndef H264_CLOCK_H
+#define H264_CLOCK_H
+
+#include <stdint.h>
+
+#define H264_CLOCK_LATE_NS 2000000                                                      /* a frame that is presented more than 2ms after its deadline counts as late */
+
+class H264_Clock {
+
+ public:
+  H264_Clock();
+  void reset();                                                                          /* the next frame starts a new timeline; call after seeking */
+  int64_t waitUntil(int64_t pts);                                                        /* sleep until the frame with `pts` (ns) must be presented; returns the lateness in ns */
+
+ public:
+  bool started;                                                                          /* true when the timeline has been started by the first frame */
+  uint64_t start_time;                                                                   /* rx_hrtime() of the first frame of the timeline */
+  int64_t start_pts;                                                                     /* pts (ns) of the first frame of the timeline */
+  int64_t last_lateness;                                                                 /* lateness of the last presented frame (ns) */
+  int64_t max_lateness;                                                                  /* max lateness since the last reset (ns) */
+  uint64_t late_frames;                                                                  /* number of frames that were more than H264_CLOCK_LATE_NS late */
+  uint64_t frames;                                                                       /* number of frames we presented */
+};
+
+#endif
@@ -1,82 +1,273 @@
+#include <string.h>
+#include <algorithm>
+#include <mutex>
 #include "H264_Decoder.h"
  
+/* avcodec_register_all() walks all codecs; once per process is enough */
+static std::once_flag h264_register_flag;
+ 
+H264_DecoderSettings::H264_DecoderSettings()
+  :fps(0.0f)
+  ,input_mode(H264_INPUT_STREAM)
+  ,thread_count(1)
+  ,thread_type(H264_THREAD_AUTO)
+  ,framing(H264_FRAMING_PARSER)
+  ,use_index(false)
+  ,async(false)
+  ,pacing(H264_PACING_POLL)
+  ,skip_mode(H264_SKIP_NONE)
+  ,read_ahead(0)
+  ,use_frame_pool(false)
+  ,huge_pages(false)
+  ,queue_size(H264_FRAME_QUEUE_SIZE)
+  ,resilient(false)
+  ,low_latency(false)
+  ,low_latency_idle_ms(H264_LOW_LATENCY_IDLE_MS)
+  ,track_latency(false)
+  ,stats_interval(0)
+{
+}
+ 
 H264_Decoder::H264_Decoder(h264_decoder_callback frameCallback, void* user) 
   :codec(NULL)
   ,codec_context(NULL)
   ,parser(NULL)
-  ,fp(NULL)
+  ,picture(NULL)
+  ,source(NULL)
   ,frame(0)
+  ,skip_frames(0)
   ,cb_frame(frameCallback)
   ,cb_user(user)
   ,frame_timeout(0)
   ,frame_delay(0)
+  ,pacing(H264_PACING_POLL)
+  ,frame_pts(0)
+  ,frame_lateness(0)
+  ,eof(false)
+  ,error(false)
+  ,input_done(false)
+  ,draining(false)
+  ,input_mode(H264_INPUT_STREAM)
+  ,map_data(NULL)
+  ,map_size(0)
+  ,map_offset(0)
+  ,map_tail_offset(0)
+  ,input_base(0)
+  ,framing(H264_FRAMING_PARSER)
+  ,async(false)
+  ,worker_stop(false)
+  ,worker_done(false)
+  ,skip_mode(H264_SKIP_NONE)
+  ,au_index(0)
+  ,dropped_frames(0)
+  ,resilient(false)
+  ,resyncing(false)
+  ,decode_errors(0)
+  ,resync_count(0)
+  ,error_dropped_frames(0)
+  ,error_dropped_bytes(0)
+  ,low_latency(false)
+  ,input_idle(false)
+  ,idle_start(0)
+  ,idle_timeout(0)
+  ,track_latency(false)
+  ,packet_read_time(0)
+  ,packet_parse_time(0)
+  ,stats_interval(0)
+  ,stats_timeout(0)
+  ,frame_pool(NULL)
 {
-  avcodec_register_all();
+  std::call_once(h264_register_flag, avcodec_register_all);
 }
  
 H264_Decoder::~H264_Decoder() {
  
-  if(parser) {
-    av_parser_close(parser);
-    parser = NULL;
+  reset();
+  closeCodec();
+ 
+  if(picture) {
+    av_frame_free(&picture);
+    picture = NULL;
   }
  
+  cb_frame = NULL;
+  cb_user = NULL;
+}
+ 
+void H264_Decoder::reset() {
+ 
+  stopWorker();
+  frame_queue.clear();
+ 
+  /* drops the delayed frames and the references; the context stays open */
   if(codec_context) {
-    avcodec_close(codec_context);
-    av_free(codec_context);
-    codec_context = NULL;
+    avcodec_flush_buffers(codec_context);
   }
  
-  if(picture) {
-    av_free(picture);
-    picture = NULL;
+  if(parser) {
+    av_parser_close(parser);
+    parser = NULL;
   }
  
-  if(fp) {
-    fclose(fp);
-    fp = NULL;
+  if(source) {
+    delete source;
+    source = NULL;
   }
  
-  cb_frame = NULL;
-  cb_user = NULL;
+  map_data = NULL;
+  map_size = 0;
+  map_offset = 0;
+  index.close();
+  buffer.clear();
+  access_unit.reset();
+  au_tail.clear();
+ 
   frame = 0;
+  skip_frames = 0;
   frame_timeout = 0;
+  frame_delay = 0;
+  frame_pts = 0;
+  frame_lateness = 0;
+  eof = false;
+  error = false;
+  input_done = false;
+  draining = false;
+  input_base = 0;
+  au_index = 0;
+  dropped_frames = 0;
+  resyncing = false;
+  decode_errors = 0;
+  resync_count = 0;
+  error_dropped_frames = 0;
+  error_dropped_bytes = 0;
+  input_idle = false;
+  idle_start = 0;
+  latency.reset();
+  read_marks.clear();
+  packet_read_time = 0;
+  packet_parse_time = 0;
+}
+ 
+bool H264_Decoder::reload(std::string path) {
+  return load(path, load_settings);
 }
  
 bool H264_Decoder::load(std::string filepath, float fps) {
  
-  codec = avcodec_find_decoder(AV_CODEC_ID_H264);
-  if(!codec) {
-    printf("Error: cannot find the h264 codec: %s\n", filepath.c_str());
+  H264_DecoderSettings settings;
+  settings.fps = fps;
+ 
+  return load(filepath, settings);
+}
+ 
+bool H264_Decoder::load(std::string path, H264_DecoderSettings settings) {
+ 
+  filepath = path;
+ 
+  H264_ByteSource* src = h264_open_source(filepath, settings.input_mode == H264_INPUT_MMAP, settings.read_ahead);
+  if(!src) {
     return false;
   }
  
-  codec_context = avcodec_alloc_context3(codec);
+  return load(src, settings);
+}
  
-  if(codec->capabilities & CODEC_CAP_TRUNCATED) {
-    codec_context->flags |= CODEC_FLAG_TRUNCATED;
+bool H264_Decoder::load(H264_ByteSource* src, H264_DecoderSettings settings) {
+ 
+  float fps = settings.fps;
+ 
+  /* everything of the previous file goes, except for the codec context */
+  reset();
+ 
+  /* the low latency profile overrides everything that delays a frame */
+  if(settings.low_latency) {
+    settings.framing = H264_FRAMING_ANNEXB;
+    settings.pacing = H264_PACING_NONE;
+    settings.track_latency = true;
+    settings.thread_type = H264_THREAD_SLICE;
   }
  
-  if(avcodec_open2(codec_context, codec, NULL) < 0) {
-    printf("Error: could not open codec.\n");
+  input_mode = settings.input_mode;
+  load_settings = settings;
+ 
+  if(!openSource(src)) {
     return false;
   }
  
-  fp = fopen(filepath.c_str(), "rb");
+  AVDiscard discard = AVDISCARD_DEFAULT;
  
-  if(!fp) {
-    printf("Error: cannot open: %s\n", filepath.c_str());
+  switch(settings.skip_mode) {
+    case H264_SKIP_NONE:   { discard = AVDISCARD_DEFAULT; break; } 
+    case H264_SKIP_NONREF: { discard = AVDISCARD_NONREF;  break; } 
+    case H264_SKIP_NONKEY: { discard = AVDISCARD_NONKEY;  break; } 
+    default: {
+      printf("Error: invalid skip mode: %d\n", settings.skip_mode);
+      return false;
+    }
+  }
+ 
+  skip_mode = settings.skip_mode;
+  resilient = settings.resilient;
+  low_latency = settings.low_latency;
+  idle_timeout = (settings.low_latency_idle_ms > 0) ? (uint64_t)settings.low_latency_idle_ms * 1000ull * 1000ull : 0;
+  track_latency = settings.track_latency;
+  stats_path = settings.stats_path;
+  stats_name = (settings.stats_name.size()) ? settings.stats_name : filepath;
+  stats_interval = settings.stats_interval * 1000ull * 1000ull;
+  stats_timeout = rx_hrtime() + stats_interval;
+ 
+  if(codec_context && !canReuseCodec(settings)) {
+    closeCodec();
+  }
+ 
+  if(!codec_context && !openCodec(settings)) {
     return false;
   }
  
-  picture = av_frame_alloc();
-  parser = av_parser_init(AV_CODEC_ID_H264);
+  /* frames are handed out as references, so they stay valid after the next decode call */
+  async = settings.async;
+  codec_context->skip_frame = discard;
+ 
+  framing = settings.framing;
  
-  if(!parser) {
-    printf("Erorr: cannot create H264 parser.\n");
+  if(settings.use_index && !index.load(filepath)) {
+    printf("Error: cannot load or build the index for: %s\n", filepath.c_str());
     return false;
   }
  
+  if(!picture) {
+    picture = av_frame_alloc();
+  }
+ 
+  if(framing == H264_FRAMING_PARSER) {
+ 
+    parser = av_parser_init(AV_CODEC_ID_H264);
+ 
+    if(!parser) {
+      printf("Erorr: cannot create H264 parser.\n");
+      return false;
+    }
+  }
+ 
+  /* the ring buffer is kept between files, unless the framing needs the other kind */
+  if(buffer.capacity && buffer.mirrored != (framing == H264_FRAMING_ANNEXB)) {
+    buffer.release();
+  }
+ 
+  if(input_mode == H264_INPUT_STREAM && !buffer.capacity) {
+ 
+    bool allocated = (framing == H264_FRAMING_ANNEXB)
+      ? buffer.allocate(H264_ANNEXB_RINGBUFFER_SIZE, FF_INPUT_BUFFER_PADDING_SIZE, true)
+      : buffer.allocate(H264_RINGBUFFER_SIZE, FF_INPUT_BUFFER_PADDING_SIZE);
+ 
+    if(!allocated) {
+      return false;
+    }
+  }
+ 
+  pacing = (fps < 0.0f) ? H264_PACING_NONE : settings.pacing;
+  clock.reset();
+ 
   if(fps > 0.0001f) {
     frame_delay = (1.0f/fps) * 1000ull * 1000ull * 1000ull;
     frame_timeout = rx_hrtime() + frame_delay;
@@ -85,29 +276,128 @@ bool H264_Decoder::load(std::string filepath, float fps) {
   // kickoff reading...
   readBuffer();
  
+  if(async) {
+ 
+    if(!frame_queue.capacity && !frame_queue.allocate(settings.queue_size)) {
+      return false;
+    }
+ 
+    pacing = H264_PACING_NONE;
+ 
+    if(!startWorker()) {
+      return false;
+    }
+  }
+ 
   return true;
 }
  
-bool H264_Decoder::readFrame() {
+bool H264_Decoder::openCodec(H264_DecoderSettings settings) {
  
-  uint64_t now = rx_hrtime();
-  if(now < frame_timeout) {
+  if(!codec) {
+    codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if(!codec) {
+      printf("Error: cannot find the h264 codec: %s\n", filepath.c_str());
+      return false;
+    }
+  }
+ 
+  codec_context = avcodec_alloc_context3(codec);
+  if(!codec_context) {
+    printf("Error: cannot allocate the codec context.\n");
     return false;
   }
  
-  bool needs_more = false;
+  /* libav disables frame threading for truncated input; the parser gives us complete frames anyway */
+  if(settings.thread_count == 1 && (codec->capabilities & CODEC_CAP_TRUNCATED)) {
+    codec_context->flags |= CODEC_FLAG_TRUNCATED;
+  }
+ 
+  codec_context->thread_count = settings.thread_count;
+  codec_context->refcounted_frames = 1;
+ 
+  /* output every frame as soon as it's decoded instead of filling the reorder buffer first */
+  if(settings.low_latency) {
+    codec_context->flags |= CODEC_FLAG_LOW_DELAY;
+  }
+ 
+  if(settings.use_frame_pool) {
+    frame_pool = new H264_FramePool(settings.huge_pages);
+    codec_context->opaque = frame_pool;
+    codec_context->get_buffer2 = h264_framepool_get_buffer2;
+    codec_context->thread_safe_callbacks = 1;
+  }
  
-  while(!update(needs_more)) { 
-    if(needs_more) {
-      readBuffer();
+  switch(settings.thread_type) {
+    case H264_THREAD_AUTO:  { codec_context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE; break; } 
+    case H264_THREAD_FRAME: { codec_context->thread_type = FF_THREAD_FRAME;                   break; } 
+    case H264_THREAD_SLICE: { codec_context->thread_type = FF_THREAD_SLICE;                   break; } 
+    default: {
+      printf("Error: invalid thread type: %d\n", settings.thread_type);
+      closeCodec();
+      return false;
     }
   }
  
+  if(avcodec_open2(codec_context, codec, NULL) < 0) {
+    printf("Error: could not open codec.\n");
+    closeCodec();
+    return false;
+  }
+ 
+  codec_settings = settings;
+ 
+  return true;
+}
+ 
+bool H264_Decoder::canReuseCodec(H264_DecoderSettings settings) {
+ 
+  /* these are fixed once the context is opened; the rest is set per file */
+  return settings.thread_count == codec_settings.thread_count
+    && settings.thread_type == codec_settings.thread_type
+    && settings.use_frame_pool == codec_settings.use_frame_pool
+    && settings.huge_pages == codec_settings.huge_pages
+    && settings.low_latency == codec_settings.low_latency;
+}
+ 
+void H264_Decoder::closeCodec() {
+ 
+  if(codec_context) {
+    avcodec_close(codec_context);
+    av_free(codec_context);
+    codec_context = NULL;
+  }
+ 
+  /* frames that consumers still hold keep the pool alive */
+  if(frame_pool) {
+    frame_pool->release();
+    frame_pool = NULL;
+  }
+}
+ 
+bool H264_Decoder::readFrame() {
+ 
+  if(async) {
+    printf("Error: don't call readFrame() in async mode, use popFrame().\n");
+    return false;
+  }
+ 
+  if(pacing == H264_PACING_POLL) {
+    uint64_t now = rx_hrtime();
+    if(now < frame_timeout) {
+      return false;
+    }
+  }
+ 
+  if(!decodeNext()) {
+    return false;
+  }
+ 
   // it may take some 'reads' before we can set the fps
   if(frame_timeout == 0 && frame_delay == 0) {
-    double fps = av_q2d(codec_context->time_base);
-    if(fps > 0.0) {
-      frame_delay = fps * 1000ull * 1000ull * 1000ull;
+    double frame_duration = av_q2d(codec_context->time_base) * codec_context->ticks_per_frame;
+    if(frame_duration > 0.0) {
+      frame_delay = frame_duration * 1000ull * 1000ull * 1000ull;
     }
   }
  
@@ -118,7 +408,423 @@ bool H264_Decoder::readFrame() {
   return true;
 }
  
-void H264_Decoder::decodeFrame(uint8_t* data, int size) {
+bool H264_Decoder::waitForInput(int timeoutMs) {
+ 
+  if(!source) {
+    return false;
+  }
+ 
+  RX_TRACE_BEGIN("wait for input");
+  bool result = source->wait(timeoutMs);
+  RX_TRACE_END("wait for input");
+ 
+  return result;
+}
+ 
+bool H264_Decoder::decodeNext() {
+ 
+  if(eof || error) {
+    return false;
+  }
+ 
+  bool needs_more = false;
+ 
+  if(!draining) {
+    while(!update(needs_more)) { 
+ 
+      if(!needs_more) {
+        continue;
+      }
+ 
+      int bytes_read = readBuffer();
+ 
+      /* a failed read is not the end of the stream; we stop without flushing so the caller can tell both apart */
+      if(bytes_read == H264_SOURCE_ERROR) {
+        return false;
+      }
+ 
+      /* a non blocking source has no data yet; this is not the end of the stream */
+      if(bytes_read == H264_SOURCE_AGAIN) {
+ 
+        /* low latency: don't wait for the next access unit to see where this one ends, only until the source stays idle */
+        if(low_latency && framing == H264_FRAMING_ANNEXB && access_unit.has_vcl) {
+ 
+          uint64_t now = rx_hrtime();
+          if(idle_start == 0) {
+            idle_start = now;
+          }
+ 
+          /* the rest of a large access unit may still be on its way */
+          uint64_t idle = now - idle_start;
+          if(idle < idle_timeout && source->wait((int)((idle_timeout - idle + 999999) / 1000000))) {
+            continue;
+          }
+ 
+          idle_start = 0;
+          input_idle = true;
+          bool decoded = update(needs_more);
+          input_idle = false;
+          return decoded;
+        }
+ 
+        return false;
+      }
+ 
+      idle_start = 0;
+ 
+      if(bytes_read == 0) {
+        /* give update() one more chance to return the last access unit */
+        if(!input_done) {
+          input_done = true;
+          continue;
+        }
+        draining = true;
+        break;
+      }
+    }
+  }
+ 
+  if(draining && !flush()) {
+    eof = true;
+    if(stats_path.size()) {
+      dumpStats(stats_path);
+    }
+    return false;
+  }
+ 
+  if(stats_interval) {
+    updateStatsFile();
+  }
+ 
+  return true;
+}
+ 
+bool H264_Decoder::startWorker() {
+ 
+  if(worker.joinable()) {
+    printf("Error: the decoder worker is already running.\n");
+    return false;
+  }
+ 
+  worker_stop = false;
+  worker_done = false;
+  worker = std::thread(&H264_Decoder::runWorker, this);
+ 
+  return true;
+}
+ 
+void H264_Decoder::stopWorker() {
+ 
+  if(!worker.joinable()) {
+    return;
+  }
+ 
+  worker_stop = true;
+  worker.join();
+}
+ 
+void H264_Decoder::runWorker() {
+ 
+  RX_TRACE_THREAD_NAME("h264 decoder");
+ 
+  while(!worker_stop.load(std::memory_order_acquire)) {
+ 
+    if(decodeNext()) {
+      continue;
+    }
+ 
+    if(eof || error) {
+      break;
+    }
+ 
+    waitForInput(H264_SOURCE_WAIT_MS);
+  }
+ 
+  worker_done.store(true, std::memory_order_release);
+}
+ 
+AVFrame* H264_Decoder::tryPopFrame() {
+  return frame_queue.tryPop();
+}
+ 
+AVFrame* H264_Decoder::popFrame(uint64_t timeoutNs) {
+ 
+  AVFrame* result = frame_queue.tryPop();
+ 
+  if(result || isFinished()) {
+    return result;
+  }
+ 
+  RX_TRACE_BEGIN("wait for frame");
+  result = frame_queue.pop(timeoutNs, worker_done);
+  RX_TRACE_END("wait for frame");
+ 
+  return result;
+}
+ 
+bool H264_Decoder::isFinished() {
+  return worker_done.load(std::memory_order_acquire) && frame_queue.size() == 0;
+}
+ 
+size_t H264_Decoder::queueDepth() {
+  return frame_queue.size();
+}
+ 
+H264_DecoderStats H264_Decoder::stats() {
+ 
+  H264_DecoderStats result;
+  recorder.snapshot(result);
+ 
+  return result;
+}
+ 
+bool H264_Decoder::dumpStats(std::string path) {
+  return h264_dump_stats(path, stats(), stats_name);
+}
+ 
+void H264_Decoder::updateStatsFile() {
+ 
+  if(stats_path.empty()) {
+    return;
+  }
+ 
+  uint64_t now = rx_hrtime();
+  if(now < stats_timeout) {
+    return;
+  }
+ 
+  dumpStats(stats_path);
+  stats_timeout = now + stats_interval;
+}
+ 
+bool H264_Decoder::getPoolStats(H264_FramePoolStats& stats) {
+ 
+  if(!frame_pool) {
+    return false;
+  }
+ 
+  frame_pool->getStats(stats);
+ 
+  return true;
+}
+ 
+bool H264_Decoder::seekToFrame(uint64_t n) {
+ 
+  if(!codec_context || !source) {
+    printf("Error: cannot seek, no file loaded.\n");
+    return false;
+  }
+ 
+  if(index.size() == 0 && !index.load(filepath)) {
+    printf("Error: cannot seek, failed to load the index for: %s\n", filepath.c_str());
+    return false;
+  }
+ 
+  const H264_IndexEntry* keyframe = index.findKeyframe(n);
+  if(!keyframe) {
+    printf("Error: cannot seek to frame %llu, there is no IDR before it.\n", (unsigned long long)n);
+    return false;
+  }
+ 
+  if(n >= index.size()) {
+    printf("Error: cannot seek to frame %llu, the stream has %llu frames.\n", 
+           (unsigned long long)n, (unsigned long long)index.size());
+    return false;
+  }
+ 
+  /* the worker uses the input, parser and codec; we stop it while we reposition */
+  stopWorker();
+  frame_queue.clear();
+ 
+  if(!seekInput(keyframe->offset)) {
+    return false;
+  }
+ 
+  /* the parser has no reset; a new one is cheap compared to the codec */
+  if(framing == H264_FRAMING_PARSER) {
+ 
+    if(parser) {
+      av_parser_close(parser);
+    }
+ 
+    parser = av_parser_init(AV_CODEC_ID_H264);
+    if(!parser) {
+      printf("Erorr: cannot create H264 parser.\n");
+      return false;
+    }
+  }
+ 
+  avcodec_flush_buffers(codec_context);
+ 
+  eof = false;
+  error = false;
+  input_done = false;
+  draining = false;
+  resyncing = false;
+  frame = (int)keyframe->frame;
+  au_index = keyframe->frame;
+  skip_frames = n - keyframe->frame;
+  frame_timeout = 0;
+  clock.reset();
+ 
+  if(async) {
+    return startWorker();
+  }
+ 
+  return true;
+}
+ 
+bool H264_Decoder::seekInput(uint64_t offset) {
+ 
+  if(input_mode == H264_INPUT_STREAM) {
+    if(!source->seek(offset)) {
+      printf("Error: cannot seek in: %s\n", filepath.c_str());
+      return false;
+    }
+    buffer.clear();
+    input_base = offset;
+  }
+  else {
+    map_offset = (size_t)std::min(offset, (uint64_t)map_size);
+  }
+ 
+  access_unit.reset();
+ 
+  /* the marks of the old position would be used for the frames after a backward seek */
+  read_marks.clear();
+ 
+  return true;
+}
+ 
+bool H264_Decoder::skipToNextKeyframe() {
+ 
+  const H264_IndexEntry* keyframe = index.findNextKeyframe(au_index);
+ 
+  /* no IDR left; skip the rest of the input */
+  if(!keyframe) {
+    if(au_index < index.size()) {
+      dropped_frames += index.size() - au_index;
+      au_index = index.size();
+    }
+    return seekInput(index.header.file_size);
+  }
+ 
+  dropped_frames += keyframe->frame - au_index;
+  au_index = keyframe->frame;
+ 
+  return seekInput(keyframe->offset);
+}
+ 
+bool H264_Decoder::seekToTime(uint64_t ns) {
+ 
+  uint64_t delay = frame_delay;
+ 
+  if(delay == 0 && codec_context && codec_context->time_base.num > 0) {
+    delay = frameDuration();
+  }
+ 
+  if(delay == 0) {
+    printf("Error: cannot seek by time, the framerate is unknown; pass it to load().\n");
+    return false;
+  }
+ 
+  return seekToFrame(ns / delay);
+}
+ 
+bool H264_Decoder::flush() {
+ 
+  /* the parser keeps the last packet until it sees the end of the input */
+  if(parser) {
+ 
+    uint8_t* data = NULL;
+    int size = 0;
+ 
+    av_parser_parse2(parser, codec_context, &data, &size, NULL, 0, AV_NOPTS_VALUE, AV_NOPTS_VALUE, inputPosition());
+ 
+    av_parser_close(parser);
+    parser = NULL;
+ 
+    if(size > 0) {
+ 
+      if(track_latency) {
+        packet_parse_time = rx_hrtime();
+        packet_read_time = readTime(inputPosition());
+      }
+ 
+      bool is_idr = false;
+      int ref_idc = 0;
+      int vcl_type = H264_NAL_SLICE;
+ 
+      if(skip_mode != H264_SKIP_NONE || resyncing) {
+        vcl_type = h264_access_unit_info(data, size, is_idr, ref_idc);
+      }
+ 
+      decodeAccessUnit(data, size, vcl_type, is_idr, ref_idc);
+      return true;
+    }
+  }
+ 
+  return decodeFrame(NULL, 0);
+}
+ 
+bool H264_Decoder::decodePacket(uint8_t* data, int size) {
+ 
+  bool is_idr = false;
+  int ref_idc = 0;
+  int vcl_type = H264_NAL_SLICE;
+ 
+  /* the parser doesn't tell us what it found; we only look at the NALs when we may drop the packet */
+  if(skip_mode != H264_SKIP_NONE || resyncing) {
+    vcl_type = h264_access_unit_info(data, size, is_idr, ref_idc);
+  }
+ 
+  return decodeAccessUnit(data, size, vcl_type, is_idr, ref_idc);
+}
+ 
+bool H264_Decoder::decodeAccessUnit(uint8_t* data, int size, int vclType, bool isIdr, int refIdc) {
+ 
+  /* after a decode error we drop pictures until we can decode again without references to damaged data */
+  if(resyncing && vclType != 0) {
+ 
+    if(!isIdr && !h264_has_recovery_point(data, size)) {
+      au_index++;
+      recorder.add(recorder.dropped_frames, 1);
+      error_dropped_frames++;
+      error_dropped_bytes += size;
+      return false;
+    }
+ 
+    resyncing = false;
+  }
+ 
+  if(skip_mode == H264_SKIP_NONE) {
+    decodeFrame(data, size);
+    return true;
+  }
+ 
+  /* access units without slices (e.g. parameter sets at the end of the stream) are always decoded */
+  if(vclType == 0) {
+    decodeFrame(data, size);
+    return true;
+  }
+ 
+  bool drop = (skip_mode == H264_SKIP_NONKEY && !isIdr) 
+           || (skip_mode == H264_SKIP_NONREF && refIdc == 0);
+ 
+  if(drop) {
+    au_index++;
+    recorder.add(recorder.dropped_frames, 1);
+    dropped_frames++;
+    return false;
+  }
+ 
+  decodeFrame(data, size);
+  au_index++;
+ 
+  return true;
+}
+ 
+bool H264_Decoder::decodeFrame(uint8_t* data, int size) {
  
   AVPacket pkt;
   int got_picture = 0;
@@ -129,28 +835,270 @@ void H264_Decoder::decodeFrame(uint8_t* data, int size) {
   pkt.data = data;
   pkt.size = size;
  
+  /* the parser tells us where the packet it returned started in the file */
+  if(parser && data) {
+    pkt.pts = parser->pts;
+    pkt.dts = parser->dts;
+    pkt.pos = parser->pos;
+  }
+ 
+  /* in the skip modes the decoder returns this with the picture, see below */
+  if(skip_mode != H264_SKIP_NONE && data) {
+    pkt.pts = (int64_t)au_index;
+  }
+ 
+  /* the codec copies this into the frame that it decodes from this packet */
+  if(track_latency && data) {
+    codec_context->reordered_opaque = latency.begin(packet_read_time, packet_parse_time);
+  }
+ 
+  RX_TRACE_BEGIN("decode");
+  uint64_t decode_start = rx_hrtime();
   len = avcodec_decode_video2(codec_context, picture, &got_picture, &pkt);
+  recorder.addTime(H264_STAGE_DECODE, rx_hrtime() - decode_start);
+  RX_TRACE_END("decode");
+ 
   if(len < 0) {
-    printf("Error while decoding a frame.\n");
+ 
+    decode_errors++;
+    recorder.add(recorder.decode_errors, 1);
+ 
+    if(!resilient) {
+      printf("Error while decoding a frame.\n");
+    }
+    else if(data && !resyncing) {
+      printf("Error while decoding a frame, skipping to the next IDR or recovery point.\n");
+      resyncing = true;
+      resync_count++;
+    }
   }
  
   if(got_picture == 0) {
-    return;
+    return false;
   }
  
+  uint64_t decode_time = (track_latency) ? rx_hrtime() : 0;
+  int64_t latency_seq = picture->reordered_opaque;
+ 
+  recorder.add(recorder.frames, 1);
+ 
+  if(skip_mode != H264_SKIP_NONE && picture->pkt_pts != AV_NOPTS_VALUE) {
+    frame = (int)picture->pkt_pts;
+  }
+ 
+  /* raw Annex B has no timestamps; the display index is the presentation time */
+  frame_pts = (int64_t)frame * frameDuration();
+  picture->pts = frame_pts;
+ 
   ++frame;
  
+  if(skip_frames > 0) {
+    skip_frames--;
+    av_frame_unref(picture);
+    return true;
+  }
+ 
+  if(async) {
+ 
+    AVFrame* ref = av_frame_clone(picture);
+    av_frame_unref(picture);
+ 
+    if(!ref) {
+      printf("Error: cannot reference the decoded frame.\n");
+      return true;
+    }
+ 
+    RX_TRACE_BEGIN("push frame");
+    bool pushed = frame_queue.push(ref, worker_stop);
+    RX_TRACE_END("push frame");
+ 
+    if(!pushed) {
+      av_frame_free(&ref);
+      return true;
+    }
+ 
+    if(track_latency) {
+      latency.end(latency_seq, decode_time, rx_hrtime());
+    }
+ 
+    return true;
+  }
+ 
+  if(pacing == H264_PACING_CLOCK) {
+    RX_TRACE_BEGIN("pacing");
+    frame_lateness = clock.waitUntil(frame_pts);
+    RX_TRACE_END("pacing");
+  }
+ 
   if(cb_frame) {
+    RX_TRACE_BEGIN("callback");
+    uint64_t callback_start = rx_hrtime();
     cb_frame(picture, &pkt, cb_user);
+    recorder.addTime(H264_STAGE_CALLBACK, rx_hrtime() - callback_start);
+    RX_TRACE_END("callback");
+  }
+ 
+  if(track_latency) {
+    latency.end(latency_seq, decode_time, rx_hrtime());
+  }
+ 
+  av_frame_unref(picture);
+ 
+  return true;
+}
+ 
+bool H264_Decoder::openSource(H264_ByteSource* src) {
+ 
+  if(!src) {
+    printf("Error: no input given.\n");
+    return false;
+  }
+ 
+  if(source) {
+    delete source;
+  }
+ 
+  source = src;
+  map_data = NULL;
+  map_size = 0;
+  map_offset = 0;
+ 
+  if(input_mode != H264_INPUT_STREAM && input_mode != H264_INPUT_MMAP) {
+    printf("Error: unknown input mode: %d\n", input_mode);
+    return false;
+  }
+ 
+  if(input_mode == H264_INPUT_STREAM) {
+    return true;
+  }
+ 
+  map_data = (uint8_t*)source->map(map_size);
+ 
+  if(!map_data) {
+    printf("Error: H264_INPUT_MMAP needs a regular file as input.\n");
+    return false;
+  }
+ 
+  /* 
+     The parser may read FF_INPUT_BUFFER_PADDING_SIZE bytes past the end of its input. 
+     Everywhere except at the end of the file these bytes are part of the mapping; 
+     for the tail we use a zero padded copy.
+  */
+  size_t tail_size = std::min(map_size, (size_t)FF_INPUT_BUFFER_PADDING_SIZE);
+  map_tail_offset = map_size - tail_size;
+  memset(map_tail, 0x00, sizeof(map_tail));
+  memcpy(map_tail, map_data + map_tail_offset, tail_size);
+ 
+  return true;
+}
+ 
+uint8_t* H264_Decoder::peekInput(size_t& nbytes) {
+ 
+  if(input_mode == H264_INPUT_STREAM) {
+    return buffer.readPtr(nbytes);
+  }
+ 
+  /* access units must be contiguous, see updateAnnexB() for the padding */
+  if(framing == H264_FRAMING_ANNEXB) {
+    nbytes = map_size - map_offset;
+    return map_data + map_offset;
+  }
+ 
+  if(map_offset < map_tail_offset) {
+    nbytes = std::min(map_tail_offset - map_offset, (size_t)H264_MMAP_CHUNK_SIZE);
+    return map_data + map_offset;
+  }
+ 
+  nbytes = map_size - map_offset;
+ 
+  return map_tail + (map_offset - map_tail_offset);
+}
+ 
+uint64_t H264_Decoder::inputPosition() {
+ 
+  if(input_mode == H264_INPUT_STREAM) {
+    return input_base + buffer.read_pos;
+  }
+ 
+  return map_offset;
+}
+ 
+uint64_t H264_Decoder::readTime(uint64_t endOffset) {
+ 
+  /* the first read that ends at or after endOffset brought in the last byte */
+  while(read_marks.size() > 1 && read_marks.front().first < endOffset) {
+    read_marks.pop_front();
+  }
+ 
+  /* mapped files aren't read */
+  if(read_marks.empty()) {
+    return rx_hrtime();
+  }
+ 
+  return read_marks.front().second;
+}
+ 
+int64_t H264_Decoder::frameDuration() {
+ 
+  if(frame_delay > 0) {
+    return (int64_t)frame_delay;
   }
+ 
+  if(codec_context && codec_context->time_base.num > 0 && codec_context->time_base.den > 0) {
+    return av_rescale(1000000000ll, (int64_t)codec_context->time_base.num * codec_context->ticks_per_frame, codec_context->time_base.den);
+  }
+ 
+  return H264_DEFAULT_FRAME_DURATION;
+}
+ 
+void H264_Decoder::consumeInput(size_t nbytes) {
+ 
+  if(input_mode == H264_INPUT_STREAM) {
+    buffer.consume(nbytes);
+    return;
+  }
+ 
+  map_offset = std::min(map_offset + nbytes, map_size);
 }
  
 int H264_Decoder::readBuffer() {
  
-  int bytes_read = (int)fread(inbuf, 1, H264_INBUF_SIZE, fp);
+  /* the mapping holds all data already */
+  if(input_mode == H264_INPUT_MMAP) {
+    return 0;
+  }
+ 
+  size_t nbytes = 0;
+  uint8_t* dest = buffer.writePtr(nbytes);
  
-  if(bytes_read) {
-    std::copy(inbuf, inbuf + bytes_read, std::back_inserter(buffer));
+  if(nbytes == 0) {
+    return 0;
+  }
+ 
+  if(nbytes > H264_INBUF_SIZE) {
+    nbytes = H264_INBUF_SIZE;
+  }
+ 
+  RX_TRACE_BEGIN("read");
+  uint64_t read_start = rx_hrtime();
+  int bytes_read = source->read(dest, nbytes);
+  recorder.addTime(H264_STAGE_READ, rx_hrtime() - read_start);
+  RX_TRACE_END("read");
+ 
+  if(bytes_read == H264_SOURCE_ERROR) {
+    printf("Error: cannot read from the input: %s\n", filepath.c_str());
+    recorder.add(recorder.read_errors, 1);
+    error = true;
+    return H264_SOURCE_ERROR;
+  }
+ 
+  if(bytes_read > 0) {
+    recorder.add(recorder.bytes_read, bytes_read);
+    recorder.add(recorder.reads, 1);
+    buffer.commit(bytes_read);
+    if(track_latency) {
+      read_marks.push_back(std::make_pair(input_base + buffer.write_pos, rx_hrtime()));
+    }
   }
  
   return bytes_read;
@@ -160,31 +1108,116 @@ bool H264_Decoder::update(bool& needsMoreBytes) {
  
   needsMoreBytes = false;
  
-  if(!fp) {
+  if(!source) {
     printf("Cannot update .. file not opened...\n");
     return false;
   }
  
-  if(buffer.size() == 0) {
+  if(framing == H264_FRAMING_ANNEXB) {
+    return updateAnnexB(needsMoreBytes);
+  }
+ 
+  size_t nbytes = 0;
+  uint8_t* ptr = peekInput(nbytes);
+ 
+  if(nbytes == 0) {
     needsMoreBytes = true;
     return false;
   }
  
   uint8_t* data = NULL;
   int size = 0;
+  RX_TRACE_BEGIN("parse");
+  uint64_t parse_start = rx_hrtime();
   int len = av_parser_parse2(parser, codec_context, &data, &size, 
-                             &buffer[0], buffer.size(), 0, 0, AV_NOPTS_VALUE);
+                             ptr, (int)nbytes, AV_NOPTS_VALUE, AV_NOPTS_VALUE, inputPosition());
+  recorder.addTime(H264_STAGE_PARSE, rx_hrtime() - parse_start);
+  RX_TRACE_END("parse");
+ 
+  if(len < 0) {
+    printf("Error: the parser failed to parse the bitstream.\n");
+    recorder.add(recorder.parse_errors, 1);
+    return false;
+  }
+ 
+  /* `data` may point into the ring buffer, so we decode before we release the bytes. */
+  bool decoded = false;
+ 
+  if(size > 0) {
+ 
+    recorder.add(recorder.packets, 1);
+ 
+    if(track_latency) {
+      packet_parse_time = rx_hrtime();
+      packet_read_time = readTime(inputPosition() + len);
+    }
+ 
+    decoded = decodePacket(data, size);
+  }
+ 
+  consumeInput(len);
+ 
+  if(size == 0 || !decoded) {
+    peekInput(nbytes);
+    needsMoreBytes = (nbytes == 0);
+    return false;
+  }
+ 
+  return true;
+}
+ 
+bool H264_Decoder::updateAnnexB(bool& needsMoreBytes) {
+ 
+  size_t nbytes = 0;
+  uint8_t* ptr = peekInput(nbytes);
+  bool end_of_input = (input_mode == H264_INPUT_MMAP) || input_done || (input_idle && access_unit.has_vcl);
+  RX_TRACE_BEGIN("parse");
+  uint64_t parse_start = rx_hrtime();
+  size_t au_size = access_unit.findAccessUnit(ptr, nbytes, end_of_input);
+  recorder.addTime(H264_STAGE_PARSE, rx_hrtime() - parse_start);
+  RX_TRACE_END("parse");
+ 
+  if(au_size == 0) {
+ 
+    if(input_mode == H264_INPUT_STREAM && buffer.space() == 0) {
+      printf("Error: access unit doesn't fit in the ring buffer, dropping %zu bytes.\n", nbytes);
+      recorder.add(recorder.parse_errors, 1);
+      consumeInput(nbytes);
+      access_unit.reset();
+    }
  
-  if(size == 0 && len >= 0) {
     needsMoreBytes = true;
     return false;
   }
  
-  if(len) {
-    decodeFrame(&buffer[0], size);
-    buffer.erase(buffer.begin(), buffer.begin() + len);
-    return true;
+  /* the decoder may read past the end of the packet; the last access unit of a mapped file is copied into a padded buffer */
+  uint8_t* au_data = ptr;
+ 
+  if(input_mode == H264_INPUT_MMAP && map_offset + au_size > map_tail_offset) {
+    au_tail.assign(ptr, ptr + au_size);
+    au_tail.resize(au_size + FF_INPUT_BUFFER_PADDING_SIZE, 0x00);
+    au_data = &au_tail[0];
+  }
+ 
+  recorder.add(recorder.packets, 1);
+ 
+  if(track_latency) {
+    packet_parse_time = rx_hrtime();
+    packet_read_time = readTime(inputPosition() + au_size);
+  }
+ 
+  bool decoded = decodeAccessUnit(au_data, (int)au_size, access_unit.vcl_type, access_unit.is_idr, access_unit.ref_idc);
+ 
+  consumeInput(au_size);
+ 
+  /* a dropped access unit is never seen by the decoder; let decodeNext() continue with the next one */
+  if(!decoded) {
+    return false;
   }
  
-  return false;
+  if(skip_mode == H264_SKIP_NONKEY && access_unit.is_idr && index.size()) {
+    skipToNextKeyframe();
+  }
+ 
+  return true;
 }
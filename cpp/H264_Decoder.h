@@ -7,32 +7,273 @@
   H264 parser and codec. You use it by opening a file that is encoded with x264 
   using the `load()` function. You can pass the framerate you want to use for playback.
   If you don't pass the framerate, we will detect it as soon as the parser found 
-  the correct information.
+  the correct information. When you pass a negative framerate we don't pace at all
+  and decode as fast as possible (e.g. for benchmarks or transcoding).
+ 
+  Pacing
+  ------
+  With the default `H264_PACING_POLL`, readFrame() returns false until the frame 
+  delay has passed, so you have to call it in a loop. With `H264_PACING_CLOCK` 
+  readFrame() always decodes and sleeps (see H264_Clock) until the presentation 
+  time of the frame before it calls the callback. A raw Annex B stream has no 
+  timestamps, so the presentation time is the display index of the frame times the 
+  frame duration (the framerate passed to load() or the one from the stream); we 
+  store it in `frame->pts` (ns) for both pacing modes and the async frames. How 
+  late the frame was is available in `frame_lateness` while the callback runs and 
+  `clock` keeps the max lateness and the number of late frames. Seeking starts a
+  new timeline. `H264_PACING_NONE` decodes as fast as possible.
+ 
+  Input
+  -----
+  The path you pass to load() can also be "-" (stdin), "unix:/path", "tcp:host:port"
+  or a fifo, see H264_ByteSource; or pass your own H264_ByteSource. Pipes and 
+  sockets are non blocking: when no data is available readFrame() returns false 
+  without `eof` being set. Use `waitForInput(ms)` to block until more data arrives 
+  (the async worker does this for you). When reading fails we set `error` instead 
+  of `eof`: readFrame() returns false and the async worker stops without flushing
+  the delayed frames. The index, seeking and H264_INPUT_MMAP only work for files.
+  Set `H264_DecoderSettings::read_ahead` to read files through the shared read 
+  ahead engine (see ioring.h), which keeps that many large reads in flight; this
+  helps when many decoders read from slow disks.
  
   After calling load(), you can call readFrame() which will read a new frame when
   necessary. It will also make sure that it will read enough data from the buffer/file
   when there is not enough data in the buffer.
  
   `readFrame()` will trigger calls to the given `h264_decoder_callback` that you pass
-  to the constructor. 
+  to the constructor. When we reached the end of the file we flush the parser and
+  the decoder: each following `readFrame()` outputs one of the delayed frames. When 
+  all frames have been output `readFrame()` returns false and `eof` is set.
+ 
+  Framing
+  -------
+  By default we use the libav parser to find the packets in the bitstream. When you 
+  set `H264_DecoderSettings::framing` to `H264_FRAMING_ANNEXB` we use our own SIMD 
+  start code scanner (see H264_AnnexB) to split the input into access units and 
+  pass these directly to the decoder. With H264_INPUT_STREAM we use a mirrored ring 
+  buffer of H264_ANNEXB_RINGBUFFER_SIZE bytes so access units are always contiguous; 
+  an access unit must fit in this buffer.
+ 
+  Index
+  -----
+  When `H264_DecoderSettings::use_index` is true, load() opens the access unit index
+  sidecar (`filepath.idx`) or builds and writes it when it doesn't exist or is 
+  outdated. See H264_Index; the index is available as `H264_Decoder::index`.
+ 
+  Seeking
+  -------
+  `seekToFrame(n)` and `seekToTime(ns)` use the index (which is loaded on first use 
+  when `use_index` wasn't set) to jump to the last IDR at or before the requested
+  frame. We reposition the input, reset the parser and flush the decoder (the codec
+  is not reopened) and then decode the frames between the IDR and the target 
+  without calling the callback. The next callback is for frame `n`. Frames are 
+  counted in display order from the IDR, which matches the stream position for 
+  streams with closed GOPs. `seekToTime()` uses the framerate passed to load() or, 
+  when not given, the framerate from the stream.
+ 
+  Fast decode modes
+  -----------------
+  For thumbnails or content indexing set `H264_DecoderSettings::skip_mode`. With 
+  `H264_SKIP_NONKEY` we only decode IDR pictures and with `H264_SKIP_NONREF` we 
+  don't decode non reference pictures (usually the B frames). We drop the access 
+  units before they reach the decoder (and also set `skip_frame` so the decoder 
+  skips what we let through). When you use H264_SKIP_NONKEY together with 
+  H264_FRAMING_ANNEXB and `use_index`, we don't even read the data between two 
+  IDRs: after decoding an IDR we jump to the next one using the index. The 
+  number of dropped pictures is counted in `dropped_frames`. In these modes 
+  `frame` and `frame->pts` are based on the decode order position of the access 
+  unit, which is exact for IDR pictures.
+ 
+  Error resilience
+  ----------------
+  By default a packet the decoder can't decode is reported and we continue with
+  the next one, which gives broken pictures until the next IDR and wastes time
+  on P and B frames that reference missing data. When you set 
+  `H264_DecoderSettings::resilient`, a decode error makes us drop the access 
+  units (they never reach the decoder) until one that is an IDR picture or has
+  a recovery point SEI (see h264_has_recovery_point()); we find those with the
+  start code scanner. `decode_errors` counts the failed decode calls, 
+  `resync_count` the number of times we skipped ahead and `error_dropped_frames` 
+  and `error_dropped_bytes` what we dropped. Pictures after a recovery point may
+  still show errors until `recovery_frame_cnt` frames have been decoded.
+ 
+  Low latency
+  -----------
+  For live monitoring the time from bytes in to frame out matters more than
+  throughput. `H264_DecoderSettings::low_latency` selects a profile for that:
+  we set CODEC_FLAG_LOW_DELAY, use slice threading instead of frame threading
+  (which delays every frame by `thread_count - 1` packets), don't pace and use
+  H264_FRAMING_ANNEXB. Normally an access unit is only complete when we see the
+  start of the next one; with a non blocking source we decode what we have
+  once we've seen a slice and the source stayed without data for 
+  `H264_DecoderSettings::low_latency_idle_ms`, so a frame is decoded when it
+  arrives instead of when the next one arrives. The idle time keeps us from
+  decoding the first part of a large IDR that arrives in many TCP segments or
+  pipe writes; it is also the latency the profile adds to every frame, and 
+  readFrame() may block for that long. With 0 we decode as soon as a read 
+  returns no data. A sender that pauses longer than that in the middle of an
+  access unit gets a damaged picture.
+ 
+  The profile also sets `track_latency`, which you can set without the profile
+  too: we then measure for every frame how long it took from reading its last 
+  byte until the callback returned, split into stages; see H264_Latency. Get 
+  the p50/p99 with `latency.percentile(H264_LATENCY_TOTAL, 0.99)` or print them
+  with `latency.print(stdout)`. In async mode the worker updates `latency`, so
+  only read it after `isFinished()` returned true.
+ 
+  Statistics
+  ----------
+  The decoder counts the bytes it read, the packets, frames, errors and 
+  dropped frames and measures every call of the read, parse, decode and 
+  callback stages in a log2 histogram; see H264_Stats. `stats()` returns a 
+  snapshot and may be called from any thread, also while the async worker 
+  runs. The counters keep counting over reset()/reload(), so they can be 
+  exported as Prometheus counters. Set `H264_DecoderSettings::stats_path` and
+  `stats_interval` to write a snapshot to a file every `stats_interval` ms 
+  (Prometheus text when the path ends with ".prom", JSON otherwise) and once 
+  more at the end of the stream.
+ 
+  Tracing
+  -------
+  Build with -DROXLU_USE_TRACE to record the read, parse, decode, callback,
+  pacing and queue waits of every thread on a timeline; write it with 
+  RX_TRACE_FLUSH("trace.json") and open it in chrome://tracing or Perfetto.
+  See the TRACE notes in tinylib_trace.h.
+ 
+  Async decoding
+  --------------
+  When `H264_DecoderSettings::async` is true, load() starts a worker thread that
+  decodes ahead into a bounded, lock free frame queue (see H264_FrameQueue) of
+  `queue_size` reference counted frames. The callback is NOT used in this mode 
+  and you must not call readFrame(); instead pop the frames with `tryPopFrame()` 
+  or `popFrame(timeout)` from one consumer thread. You own the frames you pop 
+  and must release them with `av_frame_free()`. `isFinished()` returns true when
+  the worker decoded the whole stream and all frames have been popped. Use 
+  `queueDepth()` and the stall counters of `frame_queue` to see if the decoder 
+  or the consumer is the bottleneck. Seeking stops the worker, drops the queued 
+  frames and restarts it.
+ 
+  Threading
+  ---------
+  Use `H264_DecoderSettings::thread_count` and `thread_type` to decode with more 
+  than one thread. A `thread_count` of 0 lets libav pick the number of threads 
+  based on the number of cores. Slice threading only helps for streams that have 
+  multiple slices per picture; frame threading works for all streams. Frame 
+  threading stops scaling after a couple of threads; to decode one large file 
+  on many cores use H264_GopDecoder, which decodes ranges of GOPs in parallel.
+ 
+  Callback contract with frame threading: the decoder needs `thread_count - 1` 
+  packets before it outputs the first frame, so frames arrive delayed. The `pkt`
+  passed to the callback is the packet we just fed into the decoder, NOT the 
+  packet from which the frame was decoded; use `frame->pkt_pts` / `frame->pkt_dts` 
+  if you need to match them. For flushed frames `pkt->data` is NULL. The callback 
+  is always called from the thread that calls `readFrame()` and the frame is only 
+  valid until the callback returns.
+ 
+  Reuse
+  -----
+  Opening the codec costs more than decoding a short clip, so the codec context 
+  stays open between files: load() calls `reset()`, which stops the worker, closes 
+  the input and flushes the decoder, and then reuses the context when the 
+  `thread_count`, `thread_type`, `use_frame_pool` and `huge_pages` settings didn't 
+  change (otherwise the codec is reopened). `reload(path)` loads the next file 
+  with the settings of the last load(). The codecs are registered once per 
+  process. The frame queue keeps the size of the first async load.
+ 
+  Frame buffers
+  -------------
+  Decoded frames are reference counted. To keep a frame after the callback 
+  returns, use `av_frame_ref()` or `av_frame_clone()`: this only adds a reference 
+  to the planes, the pixels are not copied, and you can release the frame with 
+  `av_frame_unref()`/`av_frame_free()` on any thread. When `use_frame_pool` is set
+  the planes are allocated by our own pool (see H264_FramePool): aligned buffers,
+  optionally on huge pages (`huge_pages`), which are reused once all references 
+  are gone. `getPoolStats()` returns the hit/miss counters and the peak number of 
+  bytes used by pictures.
+ 
+  The data we read from file is stored in a fixed size ring buffer (see H264_RingBuffer)
+  which is parsed in place; bytes that have been parsed are never moved.
+ 
+  When you load a file with `H264_DecoderSettings::input_mode` set to `H264_INPUT_MMAP`
+  we map the whole file and hand pointers into the mapping to the parser, so the
+  data is never copied. Only the last FF_INPUT_BUFFER_PADDING_SIZE bytes of the file 
+  are copied into a small, zero padded tail buffer so the parser can safely read 
+  past the end of the input.
  
  */
 #ifndef H264_DECODER_H
 #define H264_DECODER_H
  
 #define H264_INBUF_SIZE 16384                                                           /* number of bytes we read per chunk */
+#define H264_RINGBUFFER_SIZE (H264_INBUF_SIZE * 4)                                      /* capacity of the ring buffer that holds the unparsed bitstream data */
+#define H264_ANNEXB_RINGBUFFER_SIZE (8 * 1024 * 1024)                                   /* capacity of the mirrored ring buffer we use with H264_FRAMING_ANNEXB; must be bigger than the largest access unit */
+#define H264_MMAP_CHUNK_SIZE (1024 * 1024)                                              /* max number of bytes from the mapping we pass to the parser in one call */
+#define H264_INPUT_STREAM 0                                                             /* read the file in chunks into the ring buffer */
+#define H264_INPUT_MMAP 1                                                               /* map the whole file and parse directly from the mapping */
+#define H264_FRAMING_PARSER 0                                                           /* use av_parser_parse2() to find the packets */
+#define H264_FRAMING_ANNEXB 1                                                           /* use our start code scanner to find the access units */
+#define H264_SOURCE_WAIT_MS 100                                                         /* max time the async worker waits for a non blocking source before it checks if it must stop */
+#define H264_FRAME_QUEUE_SIZE 8                                                         /* default number of frames the async worker decodes ahead */
+#define H264_SKIP_NONE 0                                                                /* decode all pictures */
+#define H264_SKIP_NONREF 1                                                              /* drop the non reference pictures */
+#define H264_SKIP_NONKEY 2                                                              /* only decode IDR pictures */
+#define H264_THREAD_AUTO 0                                                              /* let libav use frame and/or slice threading */
+#define H264_THREAD_FRAME 1                                                             /* decode multiple frames in parallel; adds thread_count - 1 frames of delay */
+#define H264_THREAD_SLICE 2                                                             /* decode the slices of one frame in parallel; no extra delay */
+#define H264_PACING_POLL 0                                                              /* readFrame() returns false until the frame delay passed; call it in a loop (default) */
+#define H264_PACING_CLOCK 1                                                             /* readFrame() sleeps until the presentation time of the next frame */
+#define H264_PACING_NONE 2                                                              /* decode as fast as possible */
+#define H264_DEFAULT_FRAME_DURATION 40000000ll                                          /* frame duration (ns) we use until we know the framerate */
+#define H264_LOW_LATENCY_IDLE_MS 2                                                      /* default time (ms) a non blocking source must stay without data before the low latency profile decodes the buffered access unit */
  
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <tinylib_trace.h>
 #include <vector>
-#include <tinylib.h>
+#include <deque>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include "H264_RingBuffer.h"
+#include "H264_AnnexB.h"
+#include "H264_Index.h"
+#include "H264_FrameQueue.h"
+#include "H264_Clock.h"
+#include "H264_ByteSource.h"
+#include "H264_FramePool.h"
+#include "H264_Latency.h"
+#include "H264_Stats.h"
  
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
 }
  
+struct H264_DecoderSettings {
+  H264_DecoderSettings();
+  float fps;                                                                             /* the framerate used for playback, see load() */
+  int input_mode;                                                                        /* H264_INPUT_STREAM or H264_INPUT_MMAP */
+  int thread_count;                                                                      /* number of decoder threads; 0 = auto, defaults to 1 */
+  int thread_type;                                                                       /* H264_THREAD_AUTO, H264_THREAD_FRAME or H264_THREAD_SLICE */
+  int framing;                                                                           /* H264_FRAMING_PARSER or H264_FRAMING_ANNEXB */
+  bool use_index;                                                                        /* load or build the access unit index sidecar file */
+  bool async;                                                                            /* decode on a worker thread into a frame queue; see the Async notes above */
+  int pacing;                                                                            /* H264_PACING_POLL, H264_PACING_CLOCK or H264_PACING_NONE; a negative fps always disables pacing */
+  int skip_mode;                                                                         /* H264_SKIP_NONE, H264_SKIP_NONREF or H264_SKIP_NONKEY; see the Fast decode notes above */
+  unsigned int read_ahead;                                                               /* number of reads the shared ioring engine keeps in flight for this file; 0 (default) reads with fread() */
+  bool use_frame_pool;                                                                   /* allocate the pictures from our own buffer pool, see the Frame buffers notes above */
+  bool huge_pages;                                                                       /* use huge pages for the pooled picture buffers */
+  int queue_size;                                                                        /* number of frames the worker may decode ahead */
+  bool resilient;                                                                        /* after a decode error, drop everything up to the next IDR or recovery point; see the Error resilience notes above */
+  bool low_latency;                                                                      /* use the low latency profile; overrides framing, pacing and thread_type, see the Low latency notes above */
+  int low_latency_idle_ms;                                                               /* low latency: how long (ms) the source must stay without data before we decode the access unit we have; 0 decodes at once */
+  bool track_latency;                                                                    /* measure the per frame latency of every stage, see H264_Latency */
+  std::string stats_path;                                                                /* write a snapshot of the statistics to this file every stats_interval ms; see the Statistics notes above */
+  std::string stats_name;                                                                /* value of the `decoder` label in the Prometheus output; the file path when empty */
+  uint64_t stats_interval;                                                               /* ms between two writes of stats_path; 0 (default) never writes */
+};
+ 
 typedef void(*h264_decoder_callback)(AVFrame* frame, AVPacket* pkt, void* user);         /* the decoder callback, which will be called when we have decoded a frame */
  
 class H264_Decoder {
@@ -41,26 +282,111 @@ class H264_Decoder {
   H264_Decoder(h264_decoder_callback frameCallback, void* user);                         /* pass in a callback function that is called whenever we decoded a video frame, make sure to call `readFrame()` repeatedly */
   ~H264_Decoder();                                                                       /* d'tor, cleans up the allocated objects and closes the codec context */
   bool load(std::string filepath, float fps = 0.0f);                                     /* load a video file which is encoded with x264 */
+  bool load(std::string filepath, H264_DecoderSettings settings);                        /* load a video file using the given settings */
+  bool load(H264_ByteSource* source, H264_DecoderSettings settings);                     /* decode from the given source; the decoder takes ownership of it, also when load() fails */
+  void reset();                                                                          /* stop decoding the current file and close the input; keeps the codec context open, see the Reuse notes above */
+  bool reload(std::string filepath);                                                     /* load another file with the settings of the last load(); reuses the open codec context */
   bool readFrame();                                                                      /* read a frame if necessary */
+  bool waitForInput(int timeoutMs);                                                      /* block until the input has new data, for non blocking sources; returns false on timeout */
+  bool seekToFrame(uint64_t n);                                                          /* make the next callback deliver frame n; see the Seeking notes above */
+  bool seekToTime(uint64_t ns);                                                          /* seek to the frame that is displayed at the given time (in ns) */
+  AVFrame* tryPopFrame();                                                                /* async mode: returns the next decoded frame or NULL when none is ready; free it with av_frame_free() */
+  AVFrame* popFrame(uint64_t timeoutNs);                                                 /* async mode: waits max timeoutNs for the next decoded frame; NULL on timeout or end of stream */
+  bool isFinished();                                                                     /* async mode: true when the worker is done and all frames have been popped */
+  size_t queueDepth();                                                                   /* async mode: number of decoded frames waiting in the queue */
+  bool getPoolStats(H264_FramePoolStats& stats);                                         /* get the statistics of the picture buffer pool; returns false when use_frame_pool isn't set */
+  H264_DecoderStats stats();                                                             /* snapshot of the counters and stage timings; any thread */
+  bool dumpStats(std::string path);                                                      /* write a snapshot to path, see h264_dump_stats() */
  
  private:
   bool update(bool& needsMoreBytes);                                                     /* internally used to update/parse the data we read from the buffer or file */
-  int readBuffer();                                                                      /* read a bit more data from the buffer */
-  void decodeFrame(uint8_t* data, int size);                                             /* decode a frame we read from the buffer */
+  bool updateAnnexB(bool& needsMoreBytes);                                               /* used by update() with H264_FRAMING_ANNEXB; finds the next access unit and decodes it */
+  int readBuffer();                                                                      /* read a bit more data from the buffer; returns the bytes read, 0 at the end of the input, H264_SOURCE_AGAIN or H264_SOURCE_ERROR */
+  bool openSource(H264_ByteSource* src);                                                 /* takes ownership of the source and sets up the mapping for H264_INPUT_MMAP */
+  uint8_t* peekInput(size_t& nbytes);                                                    /* returns the next contiguous region of unparsed data */
+  uint64_t inputPosition();                                                              /* byte offset in the file of the next unparsed byte */
+  int64_t frameDuration();                                                               /* duration of one frame in ns, see the Pacing notes above */
+  void consumeInput(size_t nbytes);                                                      /* marks nbytes of the region returned by peekInput() as parsed */
+  bool decodeFrame(uint8_t* data, int size);                                             /* decode a frame we read from the buffer, returns true when we got a picture; pass NULL to drain delayed frames */
+  bool decodePacket(uint8_t* data, int size);                                            /* decodes or drops a packet from the parser, see decodeAccessUnit() */
+  bool decodeAccessUnit(uint8_t* data, int size, int vclType, bool isIdr, int refIdc);   /* decodes the access unit or drops it, depending on the skip mode; returns true when it was passed to the decoder */
+  bool skipToNextKeyframe();                                                             /* H264_SKIP_NONKEY with an index: reposition the input at the next IDR */
+  bool seekInput(uint64_t offset);                                                       /* reposition the file or mapping at the given byte offset */
+  bool decodeNext();                                                                     /* decode the next packet; returns false when all frames have been output */
+  bool startWorker();                                                                    /* async mode: start the thread that runs decodeNext() */
+  void stopWorker();                                                                     /* async mode: stop and join the worker thread */
+  void runWorker();                                                                      /* async mode: the function of the worker thread */
+  bool openCodec(H264_DecoderSettings settings);                                         /* find the codec and open a new codec context for the given settings */
+  bool canReuseCodec(H264_DecoderSettings settings);                                     /* true when the open codec context was created with compatible settings */
+  void closeCodec();                                                                     /* close the codec context and release the frame pool */
+  uint64_t readTime(uint64_t endOffset);                                                 /* track_latency: rx_hrtime() of the read that brought in the byte before endOffset */
+  void updateStatsFile();                                                                /* writes stats_path when stats_interval has passed */
+  bool flush();                                                                          /* called at the end of the input; decodes the last packet of the parser and outputs one delayed frame per call */
  
  public:
   AVCodec* codec;                                                                        /* the AVCodec* which represents the H264 decoder */
   AVCodecContext* codec_context;                                                         /* the context; keeps generic state */
   AVCodecParserContext* parser;                                                          /* parser that is used to decode the h264 bitstream */
   AVFrame* picture;                                                                      /* will contain a decoded picture */
-  uint8_t inbuf[H264_INBUF_SIZE + FF_INPUT_BUFFER_PADDING_SIZE];                         /* used to read chunks from the file */
-  FILE* fp;                                                                              /* file pointer to the file from which we read the h264 data */
-  int frame;                                                                             /* the number of decoded frames */
+  H264_ByteSource* source;                                                               /* where we read the h264 data from, see H264_ByteSource */
+  int frame;                                                                             /* the number of decoded frames; after a seek, the number of the last decoded frame + 1 */
+  uint64_t skip_frames;                                                                  /* number of frames we decode without calling the callback, used when seeking */
+  std::string filepath;                                                                  /* the file we loaded */
   h264_decoder_callback cb_frame;                                                        /* the callback function which will receive the frame/packet data */
   void* cb_user;                                                                         /* the void* with user data that is passed into the set callback */
   uint64_t frame_timeout;                                                                /* timeout when we need to parse a new frame */
   uint64_t frame_delay;                                                                  /* delay between frames (in ns) */
-  std::vector<uint8_t> buffer;                                                           /* buffer we use to keep track of read/unused bitstream data */
+  int pacing;                                                                            /* H264_PACING_POLL, H264_PACING_CLOCK or H264_PACING_NONE */
+  H264_Clock clock;                                                                      /* presentation clock used with H264_PACING_CLOCK */
+  int64_t frame_pts;                                                                     /* presentation time (ns) of the last decoded frame */
+  int64_t frame_lateness;                                                                /* how late (ns) the last frame was presented with H264_PACING_CLOCK */
+  H264_RingBuffer buffer;                                                                /* ring buffer we use to keep track of read/unused bitstream data; we fread() directly into it */
+  bool eof;                                                                              /* is set to true when we read all data from the file */
+  bool error;                                                                            /* is set to true when reading from the input failed; readFrame() returns false without setting `eof` */
+  bool input_done;                                                                       /* is set to true when readBuffer() reached the end of the input */
+  bool draining;                                                                         /* is set to true when we read all input and are flushing the delayed frames */
+  int input_mode;                                                                        /* H264_INPUT_STREAM or H264_INPUT_MMAP */
+  uint8_t* map_data;                                                                     /* the mapped file when using H264_INPUT_MMAP; owned by `source` */
+  size_t map_size;                                                                       /* size of the mapped file */
+  size_t map_offset;                                                                     /* offset of the first byte in the mapping we haven't parsed yet */
+  size_t map_tail_offset;                                                                /* offset of the first byte that we read from map_tail instead of the mapping */
+  uint8_t map_tail[FF_INPUT_BUFFER_PADDING_SIZE * 2];                                    /* copy of the last bytes of the file followed by zeroed padding */
+  uint64_t input_base;                                                                   /* file offset of the first byte we read into the ring buffer after load() or a seek */
+  int framing;                                                                           /* H264_FRAMING_PARSER or H264_FRAMING_ANNEXB */
+  H264_AnnexB access_unit;                                                               /* splits the input into access units when using H264_FRAMING_ANNEXB */
+  std::vector<uint8_t> au_tail;                                                          /* padded copy of the last access unit of a mapped file */
+  bool async;                                                                            /* decode on a worker thread, see H264_DecoderSettings::async */
+  H264_FrameQueue frame_queue;                                                           /* async mode: the frames that have been decoded by the worker */
+  std::thread worker;                                                                    /* async mode: the worker thread */
+  std::atomic<bool> worker_stop;                                                         /* async mode: set to stop the worker */
+  std::atomic<bool> worker_done;                                                         /* async mode: set by the worker when it decoded all frames */
+  int skip_mode;                                                                         /* H264_SKIP_NONE, H264_SKIP_NONREF or H264_SKIP_NONKEY */
+  uint64_t au_index;                                                                     /* decode order position of the next access unit; only maintained when skip_mode is set */
+  uint64_t dropped_frames;                                                               /* number of pictures we didn't decode because of the skip mode */
+  bool resilient;                                                                        /* see H264_DecoderSettings::resilient */
+  bool resyncing;                                                                        /* true after a decode error in resilient mode, until we found an IDR or recovery point */
+  uint64_t decode_errors;                                                                /* number of times avcodec_decode_video2() failed */
+  uint64_t resync_count;                                                                 /* number of times we skipped to the next IDR or recovery point */
+  uint64_t error_dropped_frames;                                                         /* number of access units we dropped while resyncing */
+  uint64_t error_dropped_bytes;                                                          /* size of the access units we dropped while resyncing */
+  bool low_latency;                                                                      /* see H264_DecoderSettings::low_latency */
+  bool input_idle;                                                                       /* low latency: set while we decode the buffered data because the source has no more */
+  uint64_t idle_start;                                                                   /* low latency: rx_hrtime() of the first read without data after we got a slice; 0 while data arrives */
+  uint64_t idle_timeout;                                                                 /* low latency: low_latency_idle_ms in ns */
+  bool track_latency;                                                                    /* see H264_DecoderSettings::track_latency */
+  H264_Latency latency;                                                                  /* per frame latency of every stage, when track_latency is set */
+  std::deque<std::pair<uint64_t, uint64_t> > read_marks;                                 /* track_latency: file offset of the end of every read we haven't parsed yet, and when we read it */
+  uint64_t packet_read_time;                                                             /* track_latency: when we read the last byte of the packet we decode next */
+  uint64_t packet_parse_time;                                                            /* track_latency: when the packet we decode next was split off the input */
+  H264_StatsRecorder recorder;                                                           /* counters and stage timings, see stats() */
+  std::string stats_path;                                                                /* see H264_DecoderSettings::stats_path */
+  std::string stats_name;                                                                /* see H264_DecoderSettings::stats_name */
+  uint64_t stats_interval;                                                               /* see H264_DecoderSettings::stats_interval, in ns */
+  uint64_t stats_timeout;                                                                /* rx_hrtime() when we write stats_path next */
+  H264_FramePool* frame_pool;                                                            /* picture buffers, when H264_DecoderSettings::use_frame_pool is set; reference counted because frames may outlive the decoder */
+  H264_DecoderSettings load_settings;                                                    /* the settings passed to the last load(), used by reload() */
+  H264_DecoderSettings codec_settings;                                                   /* the settings the open codec context was created with */
+  H264_Index index;                                                                      /* access unit index, loaded when H264_DecoderSettings::use_index is set */
 };
  
 #endif
@@ -0,0 +1,346 @@
+#include <string.h>
+#include <sys/stat.h>
+#include "H264_DecoderFarm.h"
+
+struct H264_FarmJobContext {
+  H264_FarmJob* job;
+  uint64_t frames;
+};
+
+static void h264_farm_on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+
+/* ------------------------------------------------------------------------------ */
+
+H264_FarmJob::H264_FarmJob()
+  :on_frame(NULL)
+  ,on_done(NULL)
+  ,user(NULL)
+  ,size(0)
+  ,submit_time(0)
+{
+}
+
+H264_FarmWorker::H264_FarmWorker()
+  :queued_bytes(0)
+  ,decoder(NULL)
+{
+}
+
+/* ------------------------------------------------------------------------------ */
+
+H264_DecoderFarm::H264_DecoderFarm()
+  :stopping(false)
+  ,queued_jobs(0)
+  ,pending_jobs(0)
+  ,start_time(0)
+{
+  memset(&stats, 0x00, sizeof(stats));
+  memset(&latency, 0x00, sizeof(latency));
+}
+
+H264_DecoderFarm::~H264_DecoderFarm() {
+  stop();
+}
+
+bool H264_DecoderFarm::start(int numThreads) {
+
+  if(workers.size()) {
+    printf("Error: the decoder farm is already started.\n");
+    return false;
+  }
+
+  if(numThreads <= 0) {
+    numThreads = (int)std::thread::hardware_concurrency();
+  }
+
+  if(numThreads <= 0) {
+    numThreads = 1;
+  }
+
+  stopping = false;
+  queued_jobs = 0;
+  pending_jobs = 0;
+  start_time = rx_hrtime();
+  memset(&stats, 0x00, sizeof(stats));
+  memset(&latency, 0x00, sizeof(latency));
+
+  for(int i = 0; i < numThreads; ++i) {
+    workers.push_back(new H264_FarmWorker());
+  }
+
+  for(size_t i = 0; i < workers.size(); ++i) {
+    workers[i]->thread = std::thread(&H264_DecoderFarm::runWorker, this, i);
+  }
+
+  return true;
+}
+
+void H264_DecoderFarm::stop() {
+
+  if(workers.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  work_cond.notify_all();
+
+  for(size_t i = 0; i < workers.size(); ++i) {
+    workers[i]->thread.join();
+  }
+
+  for(size_t i = 0; i < workers.size(); ++i) {
+    delete workers[i]->decoder;
+    delete workers[i];
+  }
+
+  workers.clear();
+
+  /* dropped jobs will never finish */
+  std::lock_guard<std::mutex> lock(mutex);
+  pending_jobs = 0;
+  done_cond.notify_all();
+}
+
+bool H264_DecoderFarm::submit(H264_FarmJob job) {
+
+  if(workers.empty() || stopping) {
+    printf("Error: cannot submit a job, the decoder farm is not running.\n");
+    return false;
+  }
+
+  struct stat st;
+  job.size = (stat(job.filepath.c_str(), &st) == 0 && S_ISREG(st.st_mode)) ? (uint64_t)st.st_size : 0;
+  job.submit_time = rx_hrtime();
+
+  /* the worker with the least amount of work */
+  size_t best = 0;
+  uint64_t best_bytes = UINT64_MAX;
+
+  for(size_t i = 0; i < workers.size(); ++i) {
+    std::lock_guard<std::mutex> lock(workers[i]->mutex);
+    uint64_t bytes = workers[i]->queued_bytes + workers[i]->jobs.size();
+    if(bytes < best_bytes) {
+      best_bytes = bytes;
+      best = i;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_jobs++;
+  }
+
+  /* counted with the push, so a worker that takes the job right away can't decrement it first */
+  {
+    std::lock_guard<std::mutex> lock(workers[best]->mutex);
+    workers[best]->jobs.push_back(job);
+    workers[best]->queued_bytes += job.size;
+    queued_jobs++;
+  }
+
+  /* a worker checks queued_jobs with our mutex held; taking it makes sure the worker either sees the job or already waits for the notification */
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+  }
+
+  work_cond.notify_one();
+
+  return true;
+}
+
+void H264_DecoderFarm::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  done_cond.wait(lock, [this] { return pending_jobs == 0; });
+}
+
+void H264_DecoderFarm::getStats(H264_FarmStats& result) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  result = stats;
+  result.elapsed_ns = rx_hrtime() - start_time;
+
+  if(result.elapsed_ns > 0) {
+    double secs = result.elapsed_ns / 1e9;
+    result.frames_per_sec = result.frames / secs;
+    result.bytes_per_sec = result.bytes / secs;
+  }
+
+  if(latency.count == 0) {
+    return;
+  }
+
+  result.latency_avg_ns = latency.sum / latency.count;
+  result.latency_p50_ns = latency.percentile(0.5);
+  result.latency_p99_ns = latency.percentile(0.99);
+  result.latency_max_ns = latency.max;
+}
+
+void H264_DecoderFarm::runWorker(size_t index) {
+
+  H264_FarmJob job;
+
+  while(true) {
+
+    if(takeJob(index, job)) {
+      runJob(index, job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_cond.wait(lock, [this] { return stopping || queued_jobs > 0; });
+
+    if(stopping) {
+      break;
+    }
+  }
+}
+
+bool H264_DecoderFarm::takeJob(size_t index, H264_FarmJob& job) {
+
+  if(stopping) {
+    return false;
+  }
+
+  H264_FarmWorker* self = workers[index];
+
+  {
+    std::lock_guard<std::mutex> lock(self->mutex);
+    if(self->jobs.size()) {
+      job = self->jobs.front();
+      self->jobs.pop_front();
+      self->queued_bytes -= job.size;
+      queued_jobs--;
+      return true;
+    }
+  }
+
+  /* steal from the worker with the most queued work; we take its newest job */
+  while(queued_jobs > 0) {
+
+    H264_FarmWorker* victim = NULL;
+    uint64_t victim_bytes = 0;
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+      if(i == index) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(workers[i]->mutex);
+      uint64_t bytes = workers[i]->queued_bytes + workers[i]->jobs.size();
+      if(workers[i]->jobs.size() && bytes > victim_bytes) {
+        victim_bytes = bytes;
+        victim = workers[i];
+      }
+    }
+
+    if(!victim) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(victim->mutex);
+
+    /* the victim may have taken it in the meantime */
+    if(victim->jobs.empty()) {
+      continue;
+    }
+
+    job = victim->jobs.back();
+    victim->jobs.pop_back();
+    victim->queued_bytes -= job.size;
+    queued_jobs--;
+
+    std::lock_guard<std::mutex> stats_lock(mutex);
+    stats.steals++;
+
+    return true;
+  }
+
+  return false;
+}
+
+void H264_DecoderFarm::runJob(size_t index, H264_FarmJob& job) {
+
+  H264_FarmWorker* self = workers[index];
+  H264_FarmJobContext ctx;
+  H264_FarmJobResult result;
+
+  ctx.job = &job;
+  ctx.frames = 0;
+
+  uint64_t start = rx_hrtime();
+
+  /* the decoder of the previous job keeps its codec context open, see H264_Decoder::reset() */
+  if(!self->decoder) {
+    self->decoder = new H264_Decoder(h264_farm_on_frame, &ctx);
+  }
+
+  self->decoder->cb_user = &ctx;
+
+  H264_DecoderSettings settings = job.settings;
+  settings.fps = -1.0f;
+  settings.async = false;
+
+  result.filepath = job.filepath;
+  result.ok = self->decoder->load(job.filepath, settings);
+
+  while(result.ok && !stopping) {
+
+    if(self->decoder->readFrame()) {
+      continue;
+    }
+
+    if(self->decoder->eof || self->decoder->error) {
+      break;
+    }
+
+    /* a non blocking source without data */
+    self->decoder->waitForInput(H264_FARM_WAIT_MS);
+  }
+
+  /* stop() interrupted the job or reading the file failed */
+  if(result.ok && !self->decoder->eof) {
+    result.ok = false;
+  }
+
+  uint64_t end = rx_hrtime();
+
+  result.frames = ctx.frames;
+  result.bytes = job.size;
+  result.queued_ns = start - job.submit_time;
+  result.decode_ns = end - start;
+  result.latency_ns = end - job.submit_time;
+  result.worker = (int)index;
+
+  if(job.on_done) {
+    job.on_done(result, job.user);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  stats.jobs++;
+  stats.failed += (result.ok) ? 0 : 1;
+  stats.frames += result.frames;
+  stats.bytes += result.bytes;
+  latency.add(result.latency_ns);
+
+  pending_jobs--;
+  if(pending_jobs == 0) {
+    done_cond.notify_all();
+  }
+}
+
+/* ------------------------------------------------------------------------------ */
+
+static void h264_farm_on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+
+  H264_FarmJobContext* ctx = (H264_FarmJobContext*)user;
+  ctx->frames++;
+
+  if(ctx->job->on_frame) {
+    ctx->job->on_frame(frame, pkt, ctx->job->user);
+  }
+}
@@ -0,0 +1,137 @@
+/*
+
+  H264_DecoderFarm
+  ---------------------------------------
+
+  Decodes many files in parallel. `start(n)` creates n worker threads (one per
+  core by default), each with its own queue of jobs. `submit()` puts a job in
+  the queue of the worker with the least amount of queued bytes, so a couple
+  of long files don't end up behind each other. A worker that runs out of jobs
+  steals from the worker with the most queued bytes; idle workers sleep until
+  new jobs are submitted.
+
+  Every job has its own frame callback (called on the worker thread, like the
+  H264_Decoder callback) and done callback, which receives the result of the
+  job: number of frames, bytes, how long the job was queued and how long it
+  took to decode. Jobs always decode as fast as possible: pacing and async
+  mode of the job settings are ignored.
+
+  Every worker owns one decoder which it reuses for all its jobs, so the codec
+  context is only opened once per worker (as long as the jobs use compatible
+  thread and frame pool settings). `getStats()` returns the throughput of the
+  farm since `start()` and the percentiles of the per job latency (time
+  between submit() and the done callback). The latencies are kept in a log2
+  histogram (see H264_Stats), so the percentiles are the upper bound of their
+  bucket and the memory use doesn't grow with the number of jobs.
+
+  Usage:
+
+      H264_DecoderFarm farm;
+      farm.start();
+
+      H264_FarmJob job;
+      job.filepath = "file.h264";
+      job.on_frame = on_frame;
+      job.on_done = on_done;
+      farm.submit(job);
+
+      farm.wait();        // all submitted jobs are done
+      farm.stop();
+
+ */
+#ifndef H264_DECODERFARM_H
+#define H264_DECODERFARM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include "H264_Decoder.h"
+#include "H264_Stats.h"
+
+#define H264_FARM_WAIT_MS 100                                                           /* how long a job waits for a non blocking source before it checks if the farm is stopping */
+
+struct H264_FarmJobResult;
+
+typedef void(*h264_farm_done_callback)(const H264_FarmJobResult& result, void* user);   /* called on the worker thread when a job is done */
+
+struct H264_FarmJob {
+  H264_FarmJob();
+  std::string filepath;                                                                  /* the file (or uri, see H264_ByteSource) to decode */
+  H264_DecoderSettings settings;                                                         /* decoder settings; fps and async are overwritten */
+  h264_decoder_callback on_frame;                                                        /* called for every decoded frame, may be NULL */
+  h264_farm_done_callback on_done;                                                       /* called when the job is done, may be NULL */
+  void* user;                                                                            /* passed to both callbacks */
+  uint64_t size;                                                                         /* size of the file, set by submit() and used to balance the workers */
+  uint64_t submit_time;                                                                  /* rx_hrtime() of submit() */
+};
+
+struct H264_FarmJobResult {
+  std::string filepath;                                                                  /* the decoded file */
+  bool ok;                                                                               /* false when the file couldn't be loaded or read, or stop() interrupted the job */
+  uint64_t frames;                                                                       /* number of decoded frames */
+  uint64_t bytes;                                                                        /* size of the file */
+  uint64_t queued_ns;                                                                    /* time between submit() and the start of decoding */
+  uint64_t decode_ns;                                                                    /* time it took to decode */
+  uint64_t latency_ns;                                                                   /* time between submit() and the end of the job */
+  int worker;                                                                            /* index of the worker that decoded the job */
+};
+
+struct H264_FarmStats {
+  uint64_t jobs;                                                                         /* number of finished jobs */
+  uint64_t failed;                                                                       /* number of jobs that couldn't be loaded, failed to read or were interrupted */
+  uint64_t frames;                                                                       /* number of decoded frames */
+  uint64_t bytes;                                                                        /* number of decoded bytes */
+  uint64_t steals;                                                                       /* number of jobs that were stolen from another worker */
+  uint64_t elapsed_ns;                                                                   /* time since start() */
+  double frames_per_sec;                                                                 /* decoded frames per second since start() */
+  double bytes_per_sec;                                                                  /* decoded bytes per second since start() */
+  uint64_t latency_avg_ns;                                                               /* average job latency */
+  uint64_t latency_p50_ns;                                                               /* median job latency; upper bound of its histogram bucket */
+  uint64_t latency_p99_ns;                                                               /* 99th percentile of the job latency; upper bound of its histogram bucket */
+  uint64_t latency_max_ns;                                                               /* max job latency */
+};
+
+struct H264_FarmWorker {
+  H264_FarmWorker();
+  std::thread thread;                                                                    /* the worker thread */
+  std::mutex mutex;                                                                      /* protects `jobs` and `queued_bytes` */
+  std::deque<H264_FarmJob> jobs;                                                         /* queued jobs; the worker takes from the front, thieves from the back */
+  uint64_t queued_bytes;                                                                 /* sum of the sizes of the queued jobs */
+  H264_Decoder* decoder;                                                                 /* the decoder of the current (or last) job */
+};
+
+class H264_DecoderFarm {
+
+ public:
+  H264_DecoderFarm();
+  ~H264_DecoderFarm();                                                                   /* stops the farm; jobs that haven't started are dropped */
+  bool start(int numThreads = 0);                                                        /* start the workers; 0 uses one per core */
+  bool submit(H264_FarmJob job);                                                         /* queue a job */
+  void wait();                                                                           /* blocks until all submitted jobs are done */
+  void stop();                                                                           /* stops and joins the workers; queued jobs are dropped */
+  void getStats(H264_FarmStats& stats);                                                  /* statistics since start() */
+
+ private:
+  void runWorker(size_t index);                                                          /* the function of the worker threads */
+  bool takeJob(size_t index, H264_FarmJob& job);                                         /* pop a job from our own queue or steal one */
+  void runJob(size_t index, H264_FarmJob& job);                                          /* decode a job and call its callbacks */
+
+ public:
+  std::vector<H264_FarmWorker*> workers;                                                 /* the workers */
+  std::atomic<bool> stopping;                                                            /* set by stop() */
+  std::atomic<uint64_t> queued_jobs;                                                     /* jobs in the queues of the workers; only changed with the mutex of the worker whose queue changes */
+  std::mutex mutex;                                                                      /* used with the condition variables and protects the statistics */
+  std::condition_variable work_cond;                                                     /* signalled when a job is submitted */
+  std::condition_variable done_cond;                                                     /* signalled when a job is done */
+  uint64_t pending_jobs;                                                                 /* submitted and not finished jobs */
+  uint64_t start_time;                                                                   /* rx_hrtime() of start() */
+  H264_FarmStats stats;                                                                  /* counters; the throughput and latency fields are filled in getStats() */
+  H264_Histogram latency;                                                                /* latencies of the finished jobs */
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "H264_FramePool.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+H264_FramePool::H264_FramePool(bool hugePages)
+  :huge_pages(hugePages)
+  ,refs(1)
+  ,pool_width(0)
+  ,pool_height(0)
+  ,pool_format(-1)
+{
+  memset(&stats, 0x00, sizeof(stats));
+}
+
+H264_FramePool::~H264_FramePool() {
+
+  for(size_t i = 0; i < free_list.size(); ++i) {
+    destroy(free_list[i]);
+  }
+
+  free_list.clear();
+}
+
+void H264_FramePool::retain() {
+  refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void H264_FramePool::release() {
+  if(refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete this;
+  }
+}
+
+AVBufferRef* H264_FramePool::get(size_t size) {
+
+  H264_PoolBuffer* buf = NULL;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for(size_t i = 0; i < free_list.size(); ++i) {
+      if(free_list[i]->size == size) {
+        buf = free_list[i];
+        free_list[i] = free_list.back();
+        free_list.pop_back();
+        break;
+      }
+    }
+
+    if(buf) {
+      stats.hits++;
+    }
+    else {
+      stats.misses++;
+    }
+  }
+
+  if(!buf) {
+    buf = allocate(size);
+    if(!buf) {
+      return NULL;
+    }
+  }
+
+  AVBufferRef* ref = av_buffer_create(buf->data, (int)buf->size, H264_FramePool::freeBuffer, buf, 0);
+  if(!ref) {
+    std::lock_guard<std::mutex> lock(mutex);
+    free_list.push_back(buf);
+    return NULL;
+  }
+
+  retain();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  stats.in_use_bytes += buf->size;
+  if(stats.in_use_bytes > stats.peak_bytes) {
+    stats.peak_bytes = stats.in_use_bytes;
+  }
+
+  return ref;
+}
+
+void H264_FramePool::freeBuffer(void* opaque, uint8_t* data) {
+
+  H264_PoolBuffer* buf = (H264_PoolBuffer*)opaque;
+  H264_FramePool* pool = buf->pool;
+
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stats.in_use_bytes -= buf->size;
+    pool->free_list.push_back(buf);
+  }
+
+  pool->release();
+}
+
+void H264_FramePool::setFormat(int width, int height, int format) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if(width == pool_width && height == pool_height && format == pool_format) {
+    return;
+  }
+
+  /* the frame size changed; the free buffers are of no use anymore */
+  for(size_t i = 0; i < free_list.size(); ++i) {
+    stats.allocated_bytes -= free_list[i]->size;
+    destroy(free_list[i]);
+  }
+
+  free_list.clear();
+  pool_width = width;
+  pool_height = height;
+  pool_format = format;
+}
+
+void H264_FramePool::getStats(H264_FramePoolStats& result) {
+  std::lock_guard<std::mutex> lock(mutex);
+  result = stats;
+}
+
+H264_PoolBuffer* H264_FramePool::allocate(size_t size) {
+
+  H264_PoolBuffer* buf = new H264_PoolBuffer();
+  buf->pool = this;
+  buf->data = NULL;
+  buf->size = size;
+  buf->mapped_size = 0;
+
+  if(huge_pages && size >= H264_FRAMEPOOL_HUGEPAGE_SIZE) {
+
+    size_t mapped_size = (size + H264_FRAMEPOOL_HUGEPAGE_SIZE - 1) & ~((size_t)H264_FRAMEPOOL_HUGEPAGE_SIZE - 1);
+    void* ptr = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+    ptr = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+    /* no reserved huge pages; ask for transparent huge pages instead */
+    if(ptr == MAP_FAILED) {
+      ptr = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined(MADV_HUGEPAGE)
+      if(ptr != MAP_FAILED) {
+        madvise(ptr, mapped_size, MADV_HUGEPAGE);
+      }
+#endif
+    }
+
+    if(ptr != MAP_FAILED) {
+      buf->data = (uint8_t*)ptr;
+      buf->mapped_size = mapped_size;
+    }
+  }
+
+  if(!buf->data) {
+    void* ptr = NULL;
+    if(posix_memalign(&ptr, H264_FRAMEPOOL_ALIGN, size) != 0) {
+      printf("Error: cannot allocate a picture buffer of %zu bytes.\n", size);
+      delete buf;
+      return NULL;
+    }
+    buf->data = (uint8_t*)ptr;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  stats.allocated_bytes += size;
+
+  return buf;
+}
+
+void H264_FramePool::destroy(H264_PoolBuffer* buf) {
+
+  if(buf->mapped_size) {
+    munmap(buf->data, buf->mapped_size);
+  }
+  else {
+    free(buf->data);
+  }
+
+  delete buf;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+int h264_framepool_get_buffer2(AVCodecContext* ctx, AVFrame* frame, int flags) {
+
+  H264_FramePool* pool = (H264_FramePool*)ctx->opaque;
+
+  if(!pool || !(ctx->codec->capabilities & CODEC_CAP_DR1)) {
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+  }
+
+  const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+  if(!desc) {
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+  }
+
+  /* the decoder writes past the visible area; use the dimensions it needs */
+  int w = frame->width;
+  int h = frame->height;
+  int linesize_align[AV_NUM_DATA_POINTERS];
+  int linesizes[4];
+
+  avcodec_align_dimensions2(ctx, &w, &h, linesize_align);
+  pool->setFormat(w, h, frame->format);
+
+  if(av_image_fill_linesizes(linesizes, (enum AVPixelFormat)frame->format, w) < 0) {
+    return AVERROR(EINVAL);
+  }
+
+  for(int i = 0; i < 4 && linesizes[i]; ++i) {
+
+    int linesize = FFALIGN(linesizes[i], H264_FRAMEPOOL_ALIGN);
+    int plane_h = (i == 1 || i == 2) ? -((-h) >> desc->log2_chroma_h) : h;
+
+    /* some of the SIMD code reads a bit past the last line */
+    size_t size = (size_t)linesize * (plane_h + 1) + H264_FRAMEPOOL_ALIGN;
+
+    frame->buf[i] = pool->get(size);
+    if(!frame->buf[i]) {
+      for(int j = 0; j < i; ++j) {
+        av_buffer_unref(&frame->buf[j]);
+      }
+      return AVERROR(ENOMEM);
+    }
+
+    frame->data[i] = frame->buf[i]->data;
+    frame->linesize[i] = linesize;
+  }
+
+  frame->extended_data = frame->data;
+
+  return 0;
+}
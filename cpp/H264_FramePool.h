@@ -0,0 +1,89 @@
+/*
+
+  H264_FramePool
+  ---------------------------------------
+
+  Picture buffer pool for the H264_Decoder. We install `h264_framepool_get_buffer2()`
+  as the `get_buffer2` callback of the codec context, so every decoded picture
+  lives in buffers that we allocated: 64 byte aligned and, when you ask for it,
+  backed by huge pages (MAP_HUGETLB when pages are reserved, transparent huge
+  pages otherwise) which saves TLB misses for large frames.
+
+  Every plane is an AVBufferRef; when the last reference to a plane is released
+  (by the decoder or by a consumer, on any thread) the buffer goes back to the
+  free list instead of to the allocator. So consumers can `av_frame_ref()` or
+  `av_frame_clone()` the frames they get, hold them as long as they want and
+  release them from another thread, without ever copying pixels.
+
+  The pool is reference counted: the decoder holds one reference and every
+  buffer that is handed out holds one, so the pool outlives the decoder while
+  consumers still hold frames. Use `release()` instead of delete.
+
+  `getStats()` returns how often a request was served from the free list
+  (hits) or needed an allocation (misses), and the current and peak number of
+  bytes in use by decoded pictures.
+
+ */
+#ifndef H264_FRAMEPOOL_H
+#define H264_FRAMEPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#define H264_FRAMEPOOL_ALIGN 64                                                         /* alignment of the planes and the linesizes */
+#define H264_FRAMEPOOL_HUGEPAGE_SIZE (2 * 1024 * 1024)                                  /* buffers smaller than this never use huge pages */
+
+struct H264_FramePoolStats {
+  uint64_t hits;                                                                         /* requests that were served from the free list */
+  uint64_t misses;                                                                       /* requests that needed a new allocation */
+  uint64_t allocated_bytes;                                                              /* bytes allocated by the pool (in use + free) */
+  uint64_t in_use_bytes;                                                                 /* bytes referenced by decoded pictures right now */
+  uint64_t peak_bytes;                                                                   /* max of in_use_bytes */
+};
+
+class H264_FramePool;
+
+struct H264_PoolBuffer {
+  H264_FramePool* pool;                                                                  /* the pool the buffer belongs to */
+  uint8_t* data;                                                                         /* the memory */
+  size_t size;                                                                           /* usable size */
+  size_t mapped_size;                                                                    /* size of the mapping when mmap()'d, 0 when allocated with posix_memalign() */
+};
+
+class H264_FramePool {
+
+ public:
+  H264_FramePool(bool hugePages);
+  void retain();                                                                         /* add a reference */
+  void release();                                                                        /* remove a reference; deletes the pool when it was the last one */
+  AVBufferRef* get(size_t size);                                                         /* returns a buffer of at least size bytes or NULL */
+  void setFormat(int width, int height, int format);                                     /* frees the unused buffers when the (aligned) frame size or format changed */
+  void getStats(H264_FramePoolStats& stats);                                             /* copy the statistics */
+  static void freeBuffer(void* opaque, uint8_t* data);                                   /* called by libav when the last reference to a buffer is gone */
+
+ private:
+  ~H264_FramePool();                                                                     /* use release() */
+  H264_PoolBuffer* allocate(size_t size);                                                /* allocate a new buffer */
+  void destroy(H264_PoolBuffer* buf);                                                    /* free the memory of a buffer */
+
+ public:
+  bool huge_pages;                                                                       /* try to use huge pages for large buffers */
+  std::atomic<int> refs;                                                                 /* references to the pool */
+  std::mutex mutex;                                                                      /* protects the free list and the statistics */
+  std::vector<H264_PoolBuffer*> free_list;                                               /* buffers that are not in use */
+  int pool_width;                                                                        /* aligned width of the pictures we allocate for */
+  int pool_height;                                                                       /* aligned height of the pictures we allocate for */
+  int pool_format;                                                                       /* pixel format of the pictures we allocate for */
+  H264_FramePoolStats stats;                                                             /* see getStats() */
+};
+
+int h264_framepool_get_buffer2(AVCodecContext* ctx, AVFrame* frame, int flags);           /* get_buffer2 callback; `ctx->opaque` must be the H264_FramePool */
+
+#endif
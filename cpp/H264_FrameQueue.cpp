@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <tinylib_trace.h>
+#include "H264_FrameQueue.h"
+
+static void h264_framequeue_wait(int& spins);
+
+H264_FrameQueue::H264_FrameQueue()
+  :frames(NULL)
+  ,capacity(0)
+  ,head(0)
+  ,tail(0)
+  ,producer_stalls(0)
+  ,consumer_stalls(0)
+{
+}
+
+H264_FrameQueue::~H264_FrameQueue() {
+
+  clear();
+
+  if(frames) {
+    free(frames);
+    frames = NULL;
+  }
+
+  capacity = 0;
+}
+
+bool H264_FrameQueue::allocate(size_t nframes) {
+
+  if(frames) {
+    printf("Error: frame queue already allocated.\n");
+    return false;
+  }
+
+  if(nframes == 0) {
+    printf("Error: invalid frame queue capacity.\n");
+    return false;
+  }
+
+  frames = (AVFrame**)calloc(nframes, sizeof(AVFrame*));
+  if(!frames) {
+    printf("Error: cannot allocate the frame queue.\n");
+    return false;
+  }
+
+  capacity = nframes;
+  head = 0;
+  tail = 0;
+
+  return true;
+}
+
+bool H264_FrameQueue::tryPush(AVFrame* frame) {
+
+  uint64_t t = tail.load(std::memory_order_relaxed);
+
+  if(t - head.load(std::memory_order_acquire) >= capacity) {
+    return false;
+  }
+
+  frames[t % capacity] = frame;
+  tail.store(t + 1, std::memory_order_release);
+
+  return true;
+}
+
+bool H264_FrameQueue::push(AVFrame* frame, const std::atomic<bool>& cancel) {
+
+  if(tryPush(frame)) {
+    return true;
+  }
+
+  producer_stalls++;
+
+  int spins = 0;
+
+  while(!cancel.load(std::memory_order_acquire)) {
+    h264_framequeue_wait(spins);
+    if(tryPush(frame)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+AVFrame* H264_FrameQueue::tryPop() {
+
+  uint64_t h = head.load(std::memory_order_relaxed);
+
+  if(h == tail.load(std::memory_order_acquire)) {
+    return NULL;
+  }
+
+  AVFrame* frame = frames[h % capacity];
+  frames[h % capacity] = NULL;
+  head.store(h + 1, std::memory_order_release);
+
+  return frame;
+}
+
+AVFrame* H264_FrameQueue::pop(uint64_t timeoutNs, const std::atomic<bool>& done) {
+
+  AVFrame* frame = tryPop();
+  if(frame) {
+    return frame;
+  }
+
+  consumer_stalls++;
+
+  /* Saturate so a huge timeout (e.g. UINT64_MAX) means "wait forever" and doesn't wrap. */
+  uint64_t now = rx_hrtime();
+  uint64_t deadline = (timeoutNs > UINT64_MAX - now) ? UINT64_MAX : now + timeoutNs;
+  int spins = 0;
+
+  while(rx_hrtime() < deadline) {
+
+    /* Read `done` before we try to pop; when it was set the producer won't push anymore, so an empty queue stays empty. */
+    bool finished = done.load(std::memory_order_acquire);
+
+    frame = tryPop();
+    if(frame) {
+      return frame;
+    }
+
+    if(finished) {
+      return NULL;
+    }
+
+    h264_framequeue_wait(spins);
+  }
+
+  return NULL;
+}
+
+void H264_FrameQueue::clear() {
+
+  AVFrame* frame = NULL;
+
+  while((frame = tryPop()) != NULL) {
+    av_frame_free(&frame);
+  }
+}
+
+/* ------------------------------------------------------------------------------ */
+
+static void h264_framequeue_wait(int& spins) {
+
+  if(spins < H264_FRAMEQUEUE_SPIN_COUNT) {
+    spins++;
+    sched_yield();
+    return;
+  }
+
+  struct timespec ts;
+  ts.tv_sec = 0;
+  ts.tv_nsec = H264_FRAMEQUEUE_SLEEP_NS;
+  nanosleep(&ts, NULL);
+}
@@ -0,0 +1,62 @@
+/*
+
+  H264_FrameQueue
+  ---------------------------------------
+
+  Bounded single producer / single consumer queue of AVFrame pointers. The
+  producer (the decoder thread) and the consumer (e.g. the thread that uploads
+  the frames to the GPU) never take a lock: each side only writes its own
+  cursor and reads the other one with acquire/release semantics.
+
+  The queue takes ownership of the frames you push; the consumer owns the
+  frames it pops and must release them with `av_frame_free()`. Because the
+  decoder uses reference counted frames, pushing a frame is only a reference,
+  never a copy of the pixels.
+
+  `push()` and `pop()` wait when the queue is full/empty. Waiting is done by
+  spinning a couple of times and then sleeping in small steps, so a blocked
+  side doesn't burn a core. We count how often each side had to wait
+  (`producer_stalls` / `consumer_stalls`), which tells you who is the bottleneck.
+
+ */
+#ifndef H264_FRAMEQUEUE_H
+#define H264_FRAMEQUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#define H264_FRAMEQUEUE_SLEEP_NS 100000                                                 /* how long we sleep between checks when we have to wait */
+#define H264_FRAMEQUEUE_SPIN_COUNT 64                                                   /* how often we yield before we start sleeping */
+
+class H264_FrameQueue {
+
+ public:
+  H264_FrameQueue();
+  ~H264_FrameQueue();
+  bool allocate(size_t capacity);                                                        /* allocate storage for `capacity` frames */
+  bool tryPush(AVFrame* frame);                                                          /* producer: add a frame, returns false when the queue is full */
+  bool push(AVFrame* frame, const std::atomic<bool>& cancel);                            /* producer: add a frame, waits while full; returns false when `cancel` was set */
+  AVFrame* tryPop();                                                                     /* consumer: returns the oldest frame or NULL when empty */
+  AVFrame* pop(uint64_t timeoutNs, const std::atomic<bool>& done);                       /* consumer: returns the oldest frame, waits max timeoutNs; NULL on timeout or when `done` was set and the queue is empty */
+  void clear();                                                                          /* frees all queued frames; only call this when the producer is not running */
+  size_t size();                                                                         /* number of queued frames */
+
+ public:
+  AVFrame** frames;                                                                      /* the slots */
+  size_t capacity;                                                                       /* number of slots */
+  std::atomic<uint64_t> head;                                                            /* number of popped frames; only written by the consumer */
+  std::atomic<uint64_t> tail;                                                            /* number of pushed frames; only written by the producer */
+  std::atomic<uint64_t> producer_stalls;                                                 /* how often the producer had to wait because the queue was full */
+  std::atomic<uint64_t> consumer_stalls;                                                 /* how often the consumer had to wait because the queue was empty */
+};
+
+inline size_t H264_FrameQueue::size() {
+  return (size_t)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+}
+
+#endif
@@ -0,0 +1,385 @@
+#include <string.h>
+#include <algorithm>
+#include "H264_GopDecoder.h"
+
+struct H264_GopWorkerContext {
+  H264_GopDecoder* decoder;
+  H264_GopRange* range;                                                                  /* the range the worker decodes */
+  size_t range_index;                                                                    /* index of `range` in the ranges of the decoder */
+};
+
+static void h264_gop_on_frame(AVFrame* frame, AVPacket* pkt, void* user);
+
+/* ------------------------------------------------------------------------------ */
+
+H264_GopRange::H264_GopRange()
+  :begin(0)
+  ,end(0)
+  ,first_frame(0)
+  ,num_frames(0)
+  ,decoded(false)
+  ,ok(true)
+{
+}
+
+/* ------------------------------------------------------------------------------ */
+
+H264_GopDecoder::H264_GopDecoder(h264_decoder_callback frameCallback, void* user)
+  :cb_frame(frameCallback)
+  ,cb_user(user)
+  ,stopping(false)
+  ,next_claim(0)
+  ,next_range(0)
+  ,max_frames(0)
+  ,buffered_frames(0)
+  ,peak_buffered_frames(0)
+  ,frame(0)
+  ,failed_ranges(0)
+  ,eof(true)
+{
+}
+
+H264_GopDecoder::~H264_GopDecoder() {
+  stop();
+  cb_frame = NULL;
+  cb_user = NULL;
+}
+
+bool H264_GopDecoder::load(std::string path, H264_DecoderSettings decoderSettings, int numThreads, size_t maxFrames) {
+
+  /* drops the previous file and sets eof, so readFrame() returns false when we fail below */
+  stop();
+
+  filepath = path;
+
+  if(!index.load(filepath)) {
+    printf("Error: cannot load or build the index for: %s\n", filepath.c_str());
+    return false;
+  }
+
+  if(!readParameterSets()) {
+    return false;
+  }
+
+  settings = decoderSettings;
+  settings.fps = -1.0f;
+  settings.input_mode = H264_INPUT_STREAM;
+  settings.use_index = false;
+  settings.async = false;
+  settings.skip_mode = H264_SKIP_NONE;
+  settings.read_ahead = 0;
+
+  splitRanges();
+
+  if(numThreads <= 0) {
+    numThreads = (int)std::thread::hardware_concurrency();
+  }
+
+  if(numThreads <= 0) {
+    numThreads = 1;
+  }
+
+  /* more workers than ranges would only wait */
+  numThreads = (int)std::min((size_t)numThreads, ranges.size());
+
+  stopping = false;
+  next_claim = 0;
+  next_range = 0;
+  max_frames = (maxFrames > 0) ? maxFrames : (size_t)numThreads * H264_GOP_RANGE_FRAMES;
+  buffered_frames = 0;
+  peak_buffered_frames = 0;
+  frame = 0;
+  failed_ranges = 0;
+  eof = ranges.empty();
+
+  for(int i = 0; i < numThreads; ++i) {
+    workers.push_back(std::thread(&H264_GopDecoder::runWorker, this));
+  }
+
+  return true;
+}
+
+void H264_GopDecoder::stop() {
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  work_cond.notify_all();
+
+  for(size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+
+  workers.clear();
+
+  for(size_t i = 0; i < ranges.size(); ++i) {
+    for(size_t j = 0; j < ranges[i]->frames.size(); ++j) {
+      av_frame_free(&ranges[i]->frames[j]);
+    }
+    delete ranges[i];
+  }
+
+  ranges.clear();
+  index.close();
+  eof = true;
+}
+
+bool H264_GopDecoder::readFrame() {
+
+  while(!eof) {
+
+    H264_GopRange* range = ranges[next_range];
+    AVFrame* picture = NULL;
+    bool was_full = false;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+
+      /* we deliver the frames of the range while it's being decoded */
+      while(range->frames.empty() && !range->decoded && !stopping) {
+        done_cond.wait(lock);
+      }
+
+      if(stopping) {
+        return false;
+      }
+
+      if(range->frames.size()) {
+        picture = range->frames.front();
+        range->frames.pop_front();
+        was_full = (buffered_frames >= max_frames);
+        buffered_frames--;
+      }
+    }
+
+    if(picture) {
+
+      /* a worker may wait for room */
+      if(was_full) {
+        work_cond.notify_all();
+      }
+
+      frame++;
+
+      if(cb_frame) {
+        cb_frame(picture, NULL, cb_user);
+      }
+
+      av_frame_free(&picture);
+
+      return true;
+    }
+
+    /* the range is decoded and all its frames have been delivered */
+    if(!range->ok) {
+      failed_ranges++;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      next_range++;
+      eof = (next_range == ranges.size());
+    }
+
+    /* the worker of the new next_range may not wait anymore */
+    work_cond.notify_all();
+  }
+
+  return false;
+}
+
+bool H264_GopDecoder::readParameterSets() {
+
+  FILE* fp = fopen(filepath.c_str(), "rb");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  std::vector<uint8_t> head((size_t)std::min(index.header.file_size, (uint64_t)H264_GOP_HEADER_SIZE));
+  size_t nbytes = (head.size()) ? fread(&head[0], 1, head.size(), fp) : 0;
+  fclose(fp);
+
+  const uint8_t* start_code = (const uint8_t*)"\x00\x00\x00\x01";
+  const uint8_t* p = (nbytes) ? &head[0] : NULL;
+  const uint8_t* end = p + nbytes;
+  H264_Nal nal;
+
+  parameter_sets.clear();
+
+  /* the parameter sets that come before the first slice */
+  while(p && h264_next_nal(p, end, nal)) {
+
+    if(h264_is_vcl(nal.type)) {
+      break;
+    }
+
+    if(nal.type == H264_NAL_SPS || nal.type == H264_NAL_PPS) {
+      parameter_sets.insert(parameter_sets.end(), start_code, start_code + 4);
+      parameter_sets.insert(parameter_sets.end(), nal.data, nal.data + nal.size);
+    }
+  }
+
+  if(parameter_sets.empty()) {
+    printf("Warning: no parameter sets at the start of: %s\n", filepath.c_str());
+  }
+
+  return true;
+}
+
+void H264_GopDecoder::splitRanges() {
+
+  uint64_t num_keyframes = index.header.num_keyframes;
+  uint64_t num_frames = index.size();
+  uint64_t file_size = index.header.file_size;
+
+  ranges.clear();
+
+  /* the first range also contains whatever comes before the first IDR */
+  H264_GopRange* range = new H264_GopRange();
+  range->begin = 0;
+  range->first_frame = 0;
+  ranges.push_back(range);
+
+  for(uint64_t i = 0; i < num_keyframes; ++i) {
+
+    const H264_IndexEntry* keyframe = index.entries + index.keyframes[i];
+
+    if(keyframe->frame - range->first_frame < H264_GOP_RANGE_FRAMES) {
+      continue;
+    }
+
+    range->end = keyframe->offset;
+    range->num_frames = keyframe->frame - range->first_frame;
+
+    range = new H264_GopRange();
+    range->begin = keyframe->offset;
+    range->first_frame = keyframe->frame;
+    ranges.push_back(range);
+  }
+
+  range->end = file_size;
+  range->num_frames = num_frames - range->first_frame;
+}
+
+void H264_GopDecoder::runWorker() {
+
+  H264_Decoder* decoder = new H264_Decoder(h264_gop_on_frame, NULL);
+
+  while(true) {
+
+    H264_GopRange* range = NULL;
+    size_t range_index = 0;
+
+    {
+      /* we don't limit the claims; addFrame() limits the memory */
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if(stopping || next_claim >= ranges.size()) {
+        break;
+      }
+
+      range_index = next_claim;
+      range = ranges[next_claim];
+      next_claim++;
+    }
+
+    range->ok = decodeRange(decoder, range, range_index);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      range->decoded = true;
+    }
+
+    done_cond.notify_all();
+  }
+
+  delete decoder;
+}
+
+bool H264_GopDecoder::decodeRange(H264_Decoder* decoder, H264_GopRange* range, size_t rangeIndex) {
+
+  H264_GopWorkerContext ctx;
+  H264_RangeSource* src = new H264_RangeSource();
+
+  /* the first range starts with the parameter sets already */
+  std::vector<uint8_t> prefix;
+  if(range->begin > 0) {
+    prefix = parameter_sets;
+  }
+
+  if(!src->open(filepath, range->begin, range->end, prefix)) {
+    delete src;
+    return false;
+  }
+
+  ctx.decoder = this;
+  ctx.range = range;
+  ctx.range_index = rangeIndex;
+
+  /* the decoder keeps its codec context between the ranges */
+  decoder->filepath = filepath;
+  decoder->cb_user = &ctx;
+
+  if(!decoder->load(src, settings)) {
+    printf("Error: cannot decode the range %llu - %llu of: %s\n",
+           (unsigned long long)range->begin, (unsigned long long)range->end, filepath.c_str());
+    return false;
+  }
+
+  /* the presentation times continue where the previous range stopped */
+  decoder->frame = (int)range->first_frame;
+
+  while(!stopping) {
+    if(!decoder->readFrame() && (decoder->eof || decoder->error)) {
+      break;
+    }
+  }
+
+  return !decoder->error;
+}
+
+void H264_GopDecoder::addFrame(H264_GopRange* range, size_t rangeIndex, AVFrame* picture) {
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    /* the range we're delivering never waits, otherwise the reader could wait for it while the others fill the memory */
+    while(!stopping && rangeIndex != next_range && buffered_frames >= max_frames) {
+      work_cond.wait(lock);
+    }
+
+    if(stopping) {
+      av_frame_free(&picture);
+      return;
+    }
+
+    range->frames.push_back(picture);
+    buffered_frames++;
+    peak_buffered_frames = std::max(peak_buffered_frames, buffered_frames);
+
+    if(rangeIndex != next_range) {
+      return;
+    }
+  }
+
+  /* only the reader waits for the frames of next_range */
+  done_cond.notify_all();
+}
+
+/* ------------------------------------------------------------------------------ */
+
+static void h264_gop_on_frame(AVFrame* frame, AVPacket* pkt, void* user) {
+
+  H264_GopWorkerContext* ctx = (H264_GopWorkerContext*)user;
+
+  AVFrame* ref = av_frame_clone(frame);
+  if(!ref) {
+    printf("Error: cannot reference the decoded frame.\n");
+    return;
+  }
+
+  ctx->decoder->addFrame(ctx->range, ctx->range_index, ref);
+}
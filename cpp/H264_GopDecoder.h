@@ -0,0 +1,115 @@
+/*
+
+  H264_GopDecoder
+  ---------------------------------------
+
+  Decodes one large Annex B file on many cores. Frame threading in libav stops
+  scaling after a couple of threads, so instead we split the file at IDR
+  pictures into ranges of whole GOPs (see H264_Index) and decode every range
+  with its own H264_Decoder on a separate worker thread. The frames of the
+  ranges are merged back into display order before we call the callback, so
+  from the outside it works like a H264_Decoder with a blocking readFrame().
+
+  The GOPs must be closed, which is always true for ranges that start at an
+  IDR. Every range gets the SPS and PPS from the start of the file in front of
+  it (see H264_RangeSource), so this also works for streams that don't repeat
+  their parameter sets; parameter sets that change in the middle of the stream
+  must be repeated at the IDRs (x264 does this by default).
+
+  A range holds at least H264_GOP_RANGE_FRAMES frames. The decoded frames
+  wait in memory (reference counted) until they are delivered; `maxFrames`
+  of `load()` limits their number. When the limit is reached, the workers
+  that decode ranges after the one we're delivering wait until frames have
+  been delivered. The worker of the range we're delivering never waits, so
+  it can't deadlock, and we deliver its frames while it's still decoding:
+  the first frame doesn't wait for a whole range. At most about `maxFrames`
+  pictures plus one range are in memory. Workers only decode ahead of the
+  reader while there is room for their frames, so N workers run at full
+  speed with a limit of about `N * H264_GOP_RANGE_FRAMES`, which is the
+  default. At 1080p a picture is ~3 MB, so pass a smaller `maxFrames` when
+  you run many workers on large pictures.
+
+  Callback contract: the callback is called from the thread that calls
+  `readFrame()`, `frame->pts` is the presentation time (ns) and `pkt` is
+  always NULL because the frames are decoded before they are delivered.
+  Pacing, async, the index, the skip modes and H264_INPUT_MMAP of the
+  settings are ignored; `thread_count` is the number of threads of each
+  range decoder (1 by default).
+
+  Usage:
+
+      H264_GopDecoder decoder(on_frame, user);
+      if(decoder.load("file.h264", settings)) {       // one worker per core
+        while(decoder.readFrame()) { }
+      }
+
+ */
+#ifndef H264_GOPDECODER_H
+#define H264_GOPDECODER_H
+
+#define H264_GOP_RANGE_FRAMES 250                                                       /* we group GOPs into ranges of at least this many frames */
+#define H264_GOP_HEADER_SIZE (1024 * 1024)                                              /* max number of bytes at the start of the file in which we look for the parameter sets */
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include "H264_Decoder.h"
+
+struct H264_GopRange {
+  H264_GopRange();
+  uint64_t begin;                                                                        /* file offset of the first access unit of the range */
+  uint64_t end;                                                                          /* file offset one past the last byte of the range */
+  uint64_t first_frame;                                                                  /* frame number of the first access unit */
+  uint64_t num_frames;                                                                   /* number of access units in the range */
+  std::deque<AVFrame*> frames;                                                           /* decoded frames in display order that haven't been delivered yet; protected by the mutex of the decoder */
+  bool decoded;                                                                          /* set when a worker decoded the whole range */
+  bool ok;                                                                               /* false when the range couldn't be loaded */
+};
+
+class H264_GopDecoder {
+
+ public:
+  H264_GopDecoder(h264_decoder_callback frameCallback, void* user);                      /* the callback receives the frames in display order, see above */
+  ~H264_GopDecoder();                                                                    /* stops the workers and frees the frames that haven't been delivered */
+  bool load(std::string filepath, H264_DecoderSettings settings, int numThreads = 0, size_t maxFrames = 0);  /* index and split the file and start the workers; 0 uses one per core and room for a range per worker. Stops a previous file */
+  bool readFrame();                                                                      /* calls the callback with the next frame, waits until it's decoded; returns false at the end */
+  void stop();                                                                           /* stops and joins the workers */
+
+ private:
+  bool readParameterSets();                                                              /* copies the SPS and PPS from the start of the file into `parameter_sets` */
+  void splitRanges();                                                                    /* groups the GOPs of the index into ranges */
+  void runWorker();                                                                      /* the function of the worker threads */
+  bool decodeRange(H264_Decoder* decoder, H264_GopRange* range, size_t rangeIndex);      /* decode all frames of a range */
+
+ public:
+  void addFrame(H264_GopRange* range, size_t rangeIndex, AVFrame* frame);                /* called by the workers for every decoded frame; waits while there is no room */
+
+ public:
+  h264_decoder_callback cb_frame;                                                        /* the callback that receives the frames */
+  void* cb_user;                                                                         /* passed into the callback */
+  std::string filepath;                                                                  /* the file we loaded */
+  H264_DecoderSettings settings;                                                         /* the settings of the range decoders */
+  H264_Index index;                                                                      /* access unit index of the file; used to find the IDRs */
+  std::vector<uint8_t> parameter_sets;                                                   /* the SPS and PPS NALs (with start codes) we put in front of every range */
+  std::vector<H264_GopRange*> ranges;                                                    /* the ranges in display order */
+  std::vector<std::thread> workers;                                                      /* the worker threads */
+  std::mutex mutex;                                                                      /* used with the condition variables; protects next_claim, next_range, buffered_frames and the frames and decoded flags of the ranges */
+  std::condition_variable work_cond;                                                     /* signalled when there is room for more frames or next_range changed */
+  std::condition_variable done_cond;                                                     /* signalled when a frame or a whole range has been decoded */
+  std::atomic<bool> stopping;                                                            /* set by stop() */
+  size_t next_claim;                                                                     /* the next range a worker will decode */
+  size_t next_range;                                                                     /* the range we're delivering */
+  size_t max_frames;                                                                     /* max number of decoded frames in memory; the range we're delivering may exceed it */
+  size_t buffered_frames;                                                                /* decoded frames in memory that haven't been delivered */
+  size_t peak_buffered_frames;                                                           /* the highest value of buffered_frames */
+  uint64_t frame;                                                                        /* number of frames we delivered */
+  uint64_t failed_ranges;                                                                /* number of ranges that couldn't be decoded */
+  bool eof;                                                                              /* set when all frames have been delivered, and before load() succeeded or after stop() */
+};
+
+#endif
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "H264_AnnexB.h"
+#include "H264_Index.h"
+
+H264_Index::H264_Index()
+  :entries(NULL)
+  ,keyframes(NULL)
+  ,map_data(NULL)
+  ,map_size(0)
+{
+  memset(&header, 0x00, sizeof(header));
+}
+
+H264_Index::~H264_Index() {
+  close();
+}
+
+void H264_Index::close() {
+
+  if(map_data) {
+    munmap(map_data, map_size);
+    map_data = NULL;
+  }
+
+  map_size = 0;
+  entries = NULL;
+  keyframes = NULL;
+  built_entries.clear();
+  built_keyframes.clear();
+  memset(&header, 0x00, sizeof(header));
+}
+
+bool H264_Index::load(std::string filepath) {
+
+  std::string index_path = filepath + ".idx";
+
+  if(open(index_path, filepath)) {
+    return true;
+  }
+
+  if(!build(filepath)) {
+    return false;
+  }
+
+  /* not being able to write the sidecar (e.g. read only media) is not fatal, we keep the index in memory */
+  if(!save(index_path)) {
+    printf("Warning: cannot write the index file: %s\n", index_path.c_str());
+  }
+
+  return true;
+}
+
+bool H264_Index::open(std::string indexPath, std::string filepath) {
+
+  uint64_t file_size = 0;
+  uint64_t file_mtime = 0;
+  uint64_t file_inode = 0;
+
+  close();
+
+  if(!statFile(filepath, file_size, file_mtime, file_inode)) {
+    return false;
+  }
+
+  int fd = ::open(indexPath.c_str(), O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(H264_IndexHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  void* ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if(ptr == MAP_FAILED) {
+    printf("Error: cannot mmap the index file: %s\n", indexPath.c_str());
+    return false;
+  }
+
+  map_data = (uint8_t*)ptr;
+  map_size = (size_t)st.st_size;
+
+  H264_IndexHeader* hdr = (H264_IndexHeader*)map_data;
+  uint64_t expected_size = sizeof(H264_IndexHeader)
+    + hdr->num_entries * sizeof(H264_IndexEntry)
+    + hdr->num_keyframes * sizeof(uint32_t);
+
+  if(memcmp(hdr->magic, H264_INDEX_MAGIC, sizeof(hdr->magic)) != 0
+     || hdr->version != H264_INDEX_VERSION
+     || hdr->entry_size != sizeof(H264_IndexEntry)
+     || hdr->file_size != file_size
+     || hdr->file_mtime != file_mtime
+     || hdr->file_inode != file_inode
+     || hdr->num_keyframes > hdr->num_entries
+     || expected_size != map_size)
+  {
+    /* outdated or invalid; the caller will rebuild it */
+    close();
+    return false;
+  }
+
+  header = *hdr;
+  entries = (const H264_IndexEntry*)(map_data + sizeof(H264_IndexHeader));
+  keyframes = (const uint32_t*)(map_data + sizeof(H264_IndexHeader) + header.num_entries * sizeof(H264_IndexEntry));
+
+  return true;
+}
+
+bool H264_Index::build(std::string filepath) {
+
+  uint64_t file_size = 0;
+  uint64_t file_mtime = 0;
+  uint64_t file_inode = 0;
+
+  close();
+
+  if(!statFile(filepath, file_size, file_mtime, file_inode)) {
+    printf("Error: cannot stat: %s\n", filepath.c_str());
+    return false;
+  }
+
+  if(file_size == 0) {
+    printf("Error: cannot index an empty file: %s\n", filepath.c_str());
+    return false;
+  }
+
+  int fd = ::open(filepath.c_str(), O_RDONLY);
+  if(fd < 0) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  void* ptr = mmap(NULL, (size_t)file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if(ptr == MAP_FAILED) {
+    printf("Error: cannot mmap: %s\n", filepath.c_str());
+    return false;
+  }
+
+  madvise(ptr, (size_t)file_size, MADV_SEQUENTIAL);
+
+  const uint8_t* data = (const uint8_t*)ptr;
+  size_t offset = 0;
+  H264_AnnexB au;
+
+  while(offset < file_size) {
+
+    size_t nbytes = au.findAccessUnit(data + offset, file_size - offset, true);
+    if(nbytes == 0) {
+      break;
+    }
+
+    /* access units without slices (e.g. a trailing end of stream NAL) are not frames */
+    if(au.vcl_type != 0) {
+
+      H264_IndexEntry entry;
+      entry.offset = offset;
+      entry.frame = (uint32_t)built_entries.size();
+      entry.nal_type = (uint8_t)au.vcl_type;
+      entry.flags = (au.is_idr ? H264_INDEX_FLAG_IDR : 0) | (au.ref_idc ? H264_INDEX_FLAG_REF : 0);
+      entry.nal_count = (uint16_t)std::min(au.nal_count, 0xFFFF);
+
+      if(au.is_idr) {
+        built_keyframes.push_back(entry.frame);
+      }
+
+      built_entries.push_back(entry);
+    }
+
+    offset += nbytes;
+  }
+
+  munmap(ptr, (size_t)file_size);
+
+  memcpy(header.magic, H264_INDEX_MAGIC, sizeof(header.magic));
+  header.version = H264_INDEX_VERSION;
+  header.entry_size = sizeof(H264_IndexEntry);
+  header.file_size = file_size;
+  header.file_mtime = file_mtime;
+  header.file_inode = file_inode;
+  header.num_entries = built_entries.size();
+  header.num_keyframes = built_keyframes.size();
+
+  entries = built_entries.size() ? &built_entries[0] : NULL;
+  keyframes = built_keyframes.size() ? &built_keyframes[0] : NULL;
+
+  return true;
+}
+
+bool H264_Index::save(std::string indexPath) {
+
+  if(!entries && header.num_entries) {
+    printf("Error: no index to save.\n");
+    return false;
+  }
+
+  /* write to a temporary file and rename it so readers never see a partial index */
+  std::string tmp_path = indexPath + ".tmp";
+  FILE* fp = fopen(tmp_path.c_str(), "wb");
+  if(!fp) {
+    return false;
+  }
+
+  bool ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+
+  if(ok && header.num_entries) {
+    ok = (fwrite(entries, sizeof(H264_IndexEntry), header.num_entries, fp) == header.num_entries);
+  }
+
+  if(ok && header.num_keyframes) {
+    ok = (fwrite(keyframes, sizeof(uint32_t), header.num_keyframes, fp) == header.num_keyframes);
+  }
+
+  if(fclose(fp) != 0) {
+    ok = false;
+  }
+
+  if(!ok || rename(tmp_path.c_str(), indexPath.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+const H264_IndexEntry* H264_Index::findKeyframe(uint64_t frame) {
+
+  if(!keyframes || header.num_keyframes == 0) {
+    return NULL;
+  }
+
+  /* first keyframe after `frame`; the one before it is the one we need */
+  const uint32_t* end = keyframes + header.num_keyframes;
+  const uint32_t* it = std::upper_bound(keyframes, end, (uint32_t)std::min(frame, (uint64_t)0xFFFFFFFF));
+
+  if(it == keyframes) {
+    return NULL;
+  }
+
+  return entries + *(it - 1);
+}
+
+const H264_IndexEntry* H264_Index::findNextKeyframe(uint64_t frame) {
+
+  if(!keyframes || header.num_keyframes == 0 || frame > 0xFFFFFFFF) {
+    return NULL;
+  }
+
+  const uint32_t* end = keyframes + header.num_keyframes;
+  const uint32_t* it = std::lower_bound(keyframes, end, (uint32_t)frame);
+
+  if(it == end) {
+    return NULL;
+  }
+
+  return entries + *it;
+}
+
+const H264_IndexEntry* H264_Index::findFrame(uint64_t frame) {
+
+  if(!entries || frame >= header.num_entries) {
+    return NULL;
+  }
+
+  return entries + frame;
+}
+
+bool H264_Index::statFile(std::string filepath, uint64_t& fileSize, uint64_t& fileMtime, uint64_t& fileInode) {
+
+  struct stat st;
+
+  if(stat(filepath.c_str(), &st) < 0) {
+    return false;
+  }
+
+  fileSize = (uint64_t)st.st_size;
+  fileMtime = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + (uint64_t)st.st_mtim.tv_nsec;
+  fileInode = (uint64_t)st.st_ino;
+
+  return true;
+}
@@ -0,0 +1,98 @@
+/*
+
+  H264_Index
+  ---------------------------------------
+
+  Access unit index for H264 Annex B files. We scan the file once with the
+  start code scanner (see H264_AnnexB) and store the byte offset, first slice
+  NAL type, frame number and IDR flag of every access unit (picture). The
+  index is written to a sidecar file (`file.h264.idx`) which is reused the
+  next time you load the same file, as long as its size, modification time
+  (in nanoseconds) and inode didn't change; a file that is rewritten within
+  the same second with the same size is still detected.
+
+  The sidecar is designed to be mapped directly: a fixed size header, followed
+  by `num_entries` H264_IndexEntry structs and `num_keyframes` uint32_t indices
+  of the entries that are IDR pictures. All values are stored in the native
+  byte order; a sidecar written on a host with a different byte order fails
+  the magic check and is rebuilt.
+
+  Frame numbers are the position of the access unit in decode order, starting
+  at 0. Use `findKeyframe(n)` to get the last IDR at or before frame `n` and
+  `findNextKeyframe(n)` for the first one at or after it; both are a binary
+  search over the keyframe table.
+
+  Usage:
+
+      H264_Index index;
+      if(index.load("file.h264")) {                  // opens or builds file.h264.idx
+        const H264_IndexEntry* idr = index.findKeyframe(1000);
+        // start decoding at idr->offset ...
+      }
+
+ */
+#ifndef H264_INDEX_H
+#define H264_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#define H264_INDEX_MAGIC "H264IDX\0"                                                    /* 8 bytes */
+#define H264_INDEX_VERSION 2
+#define H264_INDEX_FLAG_IDR 0x01                                                        /* the access unit is an IDR picture */
+#define H264_INDEX_FLAG_REF 0x02                                                        /* the access unit is a reference picture (nal_ref_idc > 0) */
+
+struct H264_IndexHeader {
+  char magic[8];                                                                         /* H264_INDEX_MAGIC */
+  uint32_t version;                                                                      /* H264_INDEX_VERSION */
+  uint32_t entry_size;                                                                   /* sizeof(H264_IndexEntry) */
+  uint64_t file_size;                                                                    /* size of the indexed file */
+  uint64_t file_mtime;                                                                   /* modification time of the indexed file, in nanoseconds */
+  uint64_t file_inode;                                                                   /* inode of the indexed file */
+  uint64_t num_entries;                                                                  /* number of access units */
+  uint64_t num_keyframes;                                                                /* number of IDR access units */
+};
+
+struct H264_IndexEntry {
+  uint64_t offset;                                                                       /* byte offset of the first byte of the access unit (including its start code) */
+  uint32_t frame;                                                                        /* frame number in decode order */
+  uint8_t nal_type;                                                                      /* nal_unit_type of the first slice */
+  uint8_t flags;                                                                         /* H264_INDEX_FLAG_* */
+  uint16_t nal_count;                                                                    /* number of NAL units in the access unit */
+};
+
+class H264_Index {
+
+ public:
+  H264_Index();
+  ~H264_Index();
+  bool load(std::string filepath);                                                       /* open `filepath`.idx when it's valid for `filepath`, otherwise build the index and save it */
+  bool open(std::string indexPath, std::string filepath);                                /* map an existing index file; fails when it doesn't match `filepath` */
+  bool build(std::string filepath);                                                      /* scan the file and build the index in memory */
+  bool save(std::string indexPath);                                                      /* write the index to the given path */
+  void close();                                                                          /* unmap/free the index */
+  const H264_IndexEntry* findKeyframe(uint64_t frame);                                   /* returns the last IDR access unit at or before `frame`, NULL when there is none */
+  const H264_IndexEntry* findNextKeyframe(uint64_t frame);                               /* returns the first IDR access unit at or after `frame`, NULL when there is none */
+  const H264_IndexEntry* findFrame(uint64_t frame);                                      /* returns the entry for `frame`, NULL when out of range */
+  uint64_t size();                                                                       /* returns the number of access units */
+
+ private:
+  bool statFile(std::string filepath, uint64_t& fileSize, uint64_t& fileMtime, uint64_t& fileInode); /* get the size, modification time (ns) and inode of a file */
+
+ public:
+  H264_IndexHeader header;                                                               /* header of the index; also used when we built the index in memory */
+  const H264_IndexEntry* entries;                                                        /* points into the mapping or into built_entries */
+  const uint32_t* keyframes;                                                             /* indices into entries of the IDR access units; points into the mapping or built_keyframes */
+  uint8_t* map_data;                                                                     /* the mapped index file */
+  size_t map_size;                                                                       /* size of the mapped index file */
+  std::vector<H264_IndexEntry> built_entries;                                            /* entries when we built the index ourself */
+  std::vector<uint32_t> built_keyframes;                                                 /* keyframes when we built the index ourself */
+};
+
+inline uint64_t H264_Index::size() {
+  return (entries) ? header.num_entries : 0;
+}
+
+#endif
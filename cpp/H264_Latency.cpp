@@ -0,0 +1,108 @@
+#include <string.h>
+#include <algorithm>
+#include "H264_Latency.h"
+
+H264_Latency::H264_Latency() {
+  reset();
+}
+
+void H264_Latency::reset() {
+
+  memset(packets, 0x00, sizeof(packets));
+
+  for(int i = 0; i < H264_LATENCY_STAGES; ++i) {
+    samples[i].clear();
+  }
+
+  /* 0 is what `reordered_opaque` is for packets we didn't stamp */
+  next_seq = 1;
+  next_sample = 0;
+  frames = 0;
+}
+
+int64_t H264_Latency::begin(uint64_t readTime, uint64_t parseTime) {
+
+  H264_PacketTimes& p = packets[next_seq % H264_LATENCY_PACKETS];
+
+  p.seq = next_seq;
+  p.read_time = readTime;
+  p.parse_time = parseTime;
+
+  return (int64_t)next_seq++;
+}
+
+void H264_Latency::end(int64_t seq, uint64_t decodeTime, uint64_t callbackTime) {
+
+  if(seq <= 0) {
+    return;
+  }
+
+  /* the slot was reused; the frame was delayed by more than H264_LATENCY_PACKETS packets */
+  const H264_PacketTimes& p = packets[seq % H264_LATENCY_PACKETS];
+  if(p.seq != (uint64_t)seq) {
+    return;
+  }
+
+  uint64_t values[H264_LATENCY_STAGES];
+  values[H264_LATENCY_PARSE] = (p.parse_time > p.read_time) ? p.parse_time - p.read_time : 0;
+  values[H264_LATENCY_DECODE] = (decodeTime > p.parse_time) ? decodeTime - p.parse_time : 0;
+  values[H264_LATENCY_CALLBACK] = (callbackTime > decodeTime) ? callbackTime - decodeTime : 0;
+  values[H264_LATENCY_TOTAL] = (callbackTime > p.read_time) ? callbackTime - p.read_time : 0;
+
+  for(int i = 0; i < H264_LATENCY_STAGES; ++i) {
+    if(samples[i].size() < H264_LATENCY_SAMPLES) {
+      samples[i].push_back(values[i]);
+    }
+    else {
+      samples[i][next_sample] = values[i];
+    }
+  }
+
+  next_sample = (next_sample + 1) % H264_LATENCY_SAMPLES;
+  frames++;
+}
+
+uint64_t H264_Latency::percentile(int stage, double p) {
+
+  if(stage < 0 || stage >= H264_LATENCY_STAGES || samples[stage].empty()) {
+    return 0;
+  }
+
+  std::vector<uint64_t> sorted = samples[stage];
+  size_t n = (size_t)(p * (sorted.size() - 1) + 0.5);
+
+  n = std::min(n, sorted.size() - 1);
+  std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+
+  return sorted[n];
+}
+
+size_t H264_Latency::size() {
+  return samples[H264_LATENCY_TOTAL].size();
+}
+
+void H264_Latency::print(FILE* fp) {
+
+  fprintf(fp, "latency over %zu frames (ms):\n", size());
+
+  for(int i = 0; i < H264_LATENCY_STAGES; ++i) {
+    fprintf(fp, "  %-10s p50: %8.3f, p99: %8.3f, max: %8.3f\n",
+            h264_latency_stage_name(i),
+            percentile(i, 0.50) / 1000000.0,
+            percentile(i, 0.99) / 1000000.0,
+            percentile(i, 1.0) / 1000000.0);
+  }
+}
+
+/* ------------------------------------------------------------------------------ */
+
+const char* h264_latency_stage_name(int stage) {
+
+  switch(stage) {
+    case H264_LATENCY_PARSE:    { return "parse";    }
+    case H264_LATENCY_DECODE:   { return "decode";   }
+    case H264_LATENCY_CALLBACK: { return "callback"; }
+    case H264_LATENCY_TOTAL:    { return "total";    }
+    default:                    { return "unknown";  }
+  }
+}
@@ -0,0 +1,69 @@
+/*
+
+  H264_Latency
+  ---------------------------------------
+
+  Measures how long a frame takes from the moment its bytes were read until
+  the callback returned. The decoder stamps every packet it feeds into the
+  codec with the time we read its last byte and the time the packet was split
+  off the input (`begin()`), and stamps the frame that comes out with the
+  time it was decoded and the time the callback returned (`end()`). The
+  sequence number that `begin()` returns travels through the codec in
+  `reordered_opaque`, so this also works when frames come out delayed (frame
+  threading) or reordered.
+
+  We keep the last H264_LATENCY_SAMPLES frames for each stage:
+
+      H264_LATENCY_PARSE     read -> the access unit was split off the input
+      H264_LATENCY_DECODE    split -> decoded (includes the codec delay)
+      H264_LATENCY_CALLBACK  decoded -> the callback returned
+      H264_LATENCY_TOTAL     read -> the callback returned
+
+  `percentile(stage, 0.99)` returns the p99 (ns) of a stage. For mapped
+  files there is no read, so the parse stage is 0.
+
+ */
+#ifndef H264_LATENCY_H
+#define H264_LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define H264_LATENCY_SAMPLES 4096                                                       /* number of frames we keep the latency of */
+#define H264_LATENCY_PACKETS 64                                                         /* max number of packets inside the codec; more than any thread count adds */
+#define H264_LATENCY_PARSE 0                                                            /* stage: read until the access unit was split off */
+#define H264_LATENCY_DECODE 1                                                           /* stage: split off until decoded */
+#define H264_LATENCY_CALLBACK 2                                                         /* stage: decoded until the callback returned */
+#define H264_LATENCY_TOTAL 3                                                            /* read until the callback returned */
+#define H264_LATENCY_STAGES 4
+
+struct H264_PacketTimes {
+  uint64_t seq;                                                                          /* sequence number returned by begin() */
+  uint64_t read_time;                                                                    /* rx_hrtime() when we read the last byte of the packet */
+  uint64_t parse_time;                                                                   /* rx_hrtime() when the packet was split off the input */
+};
+
+class H264_Latency {
+
+ public:
+  H264_Latency();
+  void reset();                                                                          /* drop all samples */
+  int64_t begin(uint64_t readTime, uint64_t parseTime);                                  /* call before a packet goes into the codec; returns the value for `reordered_opaque` */
+  void end(int64_t seq, uint64_t decodeTime, uint64_t callbackTime);                     /* call when the frame of packet `seq` has been delivered */
+  uint64_t percentile(int stage, double p);                                              /* latency (ns) of a stage that p (0..1) of the frames stay under */
+  size_t size();                                                                         /* number of samples we have */
+  void print(FILE* fp);                                                                  /* p50, p99 and max of every stage */
+
+ public:
+  H264_PacketTimes packets[H264_LATENCY_PACKETS];                                        /* the packets inside the codec, indexed by seq % H264_LATENCY_PACKETS */
+  uint64_t next_seq;                                                                     /* sequence number of the next packet */
+  std::vector<uint64_t> samples[H264_LATENCY_STAGES];                                    /* the last H264_LATENCY_SAMPLES latencies (ns) of every stage */
+  size_t next_sample;                                                                    /* where we store the next sample */
+  uint64_t frames;                                                                       /* number of frames we measured */
+};
+
+const char* h264_latency_stage_name(int stage);                                          /* "parse", "decode", "callback" or "total" */
+
+#endif
@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "H264_Probe.h"
+#include "H264_AnnexB.h"
+#include "H264_BitReader.h"
+
+static void h264_skip_scaling_list(H264_BitReader& br, int size);
+static void h264_parse_vui(H264_BitReader& br, H264_Sps& sps);
+static bool h264_is_high_profile(int profileIdc);
+static bool h264_read_ue(H264_BitReader& br, uint32_t maxValue, const char* name, int& result);
+
+/* ------------------------------------------------------------------------------ */
+
+H264_ProbeInfo::H264_ProbeInfo()
+  :has_sps(false)
+  ,has_pps(false)
+  ,width(0)
+  ,height(0)
+  ,fps(0.0)
+  ,bytes_read(0)
+{
+  memset(&sps, 0x00, sizeof(sps));
+  memset(&pps, 0x00, sizeof(pps));
+  memset(codec, 0x00, sizeof(codec));
+}
+
+/* ------------------------------------------------------------------------------ */
+
+bool h264_parse_sps(const uint8_t* rbsp, size_t size, H264_Sps& sps) {
+
+  H264_BitReader br(rbsp, size);
+
+  memset(&sps, 0x00, sizeof(sps));
+
+  sps.profile_idc = br.readBits(8);
+  sps.constraint_flags = br.readBits(8);
+  sps.level_idc = br.readBits(8);
+
+  if(!h264_read_ue(br, H264_MAX_SPS_COUNT - 1, "seq_parameter_set_id", sps.sps_id)) {
+    return false;
+  }
+
+  sps.chroma_format_idc = 1;
+  sps.bit_depth_luma = 8;
+  sps.bit_depth_chroma = 8;
+
+  if(h264_is_high_profile(sps.profile_idc)) {
+
+    if(!h264_read_ue(br, 3, "chroma_format_idc", sps.chroma_format_idc)) {
+      return false;
+    }
+
+    if(sps.chroma_format_idc == 3) {
+      sps.separate_colour_plane_flag = br.readBit();
+    }
+
+    if(!h264_read_ue(br, 6, "bit_depth_luma_minus8", sps.bit_depth_luma)
+       || !h264_read_ue(br, 6, "bit_depth_chroma_minus8", sps.bit_depth_chroma)) {
+      return false;
+    }
+
+    sps.bit_depth_luma += 8;
+    sps.bit_depth_chroma += 8;
+    br.readBit();                                                                        /* qpprime_y_zero_transform_bypass_flag */
+
+    if(br.readBit()) {                                                                   /* seq_scaling_matrix_present_flag */
+      int count = (sps.chroma_format_idc != 3) ? 8 : 12;
+      for(int i = 0; i < count; ++i) {
+        if(br.readBit()) {
+          h264_skip_scaling_list(br, (i < 6) ? 16 : 64);
+        }
+      }
+    }
+  }
+
+  if(!h264_read_ue(br, 12, "log2_max_frame_num_minus4", sps.log2_max_frame_num)
+     || !h264_read_ue(br, 2, "pic_order_cnt_type", sps.pic_order_cnt_type)) {
+    return false;
+  }
+
+  sps.log2_max_frame_num += 4;
+
+  if(sps.pic_order_cnt_type == 0) {
+    if(!h264_read_ue(br, 12, "log2_max_pic_order_cnt_lsb_minus4", sps.log2_max_pic_order_cnt_lsb)) {
+      return false;
+    }
+    sps.log2_max_pic_order_cnt_lsb += 4;
+  }
+  else if(sps.pic_order_cnt_type == 1) {
+    sps.delta_pic_order_always_zero_flag = br.readBit();
+    br.readSe();                                                                         /* offset_for_non_ref_pic */
+    br.readSe();                                                                         /* offset_for_top_to_bottom_field */
+    uint32_t cycle = br.readUe();
+    if(cycle > 255) {
+      printf("Error: invalid num_ref_frames_in_pic_order_cnt_cycle: %u\n", cycle);
+      return false;
+    }
+    for(uint32_t i = 0; i < cycle; ++i) {
+      br.readSe();                                                                       /* offset_for_ref_frame */
+    }
+  }
+
+  if(!h264_read_ue(br, 16, "max_num_ref_frames", sps.max_num_ref_frames)) {
+    return false;
+  }
+
+  br.readBit();                                                                          /* gaps_in_frame_num_value_allowed_flag */
+
+  if(!h264_read_ue(br, H264_MAX_MBS - 1, "pic_width_in_mbs_minus1", sps.pic_width_in_mbs)
+     || !h264_read_ue(br, H264_MAX_MBS - 1, "pic_height_in_map_units_minus1", sps.pic_height_in_map_units)) {
+    return false;
+  }
+
+  sps.pic_width_in_mbs += 1;
+  sps.pic_height_in_map_units += 1;
+  sps.frame_mbs_only_flag = br.readBit();
+
+  if(!sps.frame_mbs_only_flag) {
+    sps.mb_adaptive_frame_field_flag = br.readBit();
+  }
+
+  br.readBit();                                                                          /* direct_8x8_inference_flag */
+
+  uint32_t crop_left = 0;
+  uint32_t crop_right = 0;
+  uint32_t crop_top = 0;
+  uint32_t crop_bottom = 0;
+
+  if(br.readBit()) {                                                                     /* frame_cropping_flag */
+    crop_left = br.readUe();
+    crop_right = br.readUe();
+    crop_top = br.readUe();
+    crop_bottom = br.readUe();
+  }
+
+  sps.vui_parameters_present_flag = br.readBit();
+  sps.colour_primaries = 2;
+  sps.transfer_characteristics = 2;
+  sps.matrix_coefficients = 2;
+
+  if(sps.vui_parameters_present_flag) {
+    h264_parse_vui(br, sps);
+  }
+
+  if(br.error) {
+    printf("Error: the SPS is truncated.\n");
+    return false;
+  }
+
+  /* the cropping is given in chroma samples (7.4.2.1.1) */
+  int chroma_array_type = (sps.separate_colour_plane_flag) ? 0 : sps.chroma_format_idc;
+  int crop_unit_x = 1;
+  int crop_unit_y = 2 - sps.frame_mbs_only_flag;
+
+  if(chroma_array_type != 0) {
+    int sub_width_c = (sps.chroma_format_idc == 3) ? 1 : 2;
+    int sub_height_c = (sps.chroma_format_idc == 1) ? 2 : 1;
+    crop_unit_x = sub_width_c;
+    crop_unit_y = sub_height_c * (2 - sps.frame_mbs_only_flag);
+  }
+
+  int coded_width = sps.pic_width_in_mbs * 16;
+  int coded_height = sps.pic_height_in_map_units * 16 * (2 - sps.frame_mbs_only_flag);
+
+  if(crop_left > (uint32_t)coded_width || crop_right > (uint32_t)coded_width
+     || crop_top > (uint32_t)coded_height || crop_bottom > (uint32_t)coded_height) {
+    printf("Error: invalid cropping in the SPS.\n");
+    return false;
+  }
+
+  sps.crop_left = (int)crop_left * crop_unit_x;
+  sps.crop_right = (int)crop_right * crop_unit_x;
+  sps.crop_top = (int)crop_top * crop_unit_y;
+  sps.crop_bottom = (int)crop_bottom * crop_unit_y;
+
+  if(sps.crop_left + sps.crop_right >= coded_width || sps.crop_top + sps.crop_bottom >= coded_height) {
+    printf("Error: invalid cropping in the SPS.\n");
+    return false;
+  }
+
+  sps.width = coded_width - sps.crop_left - sps.crop_right;
+  sps.height = coded_height - sps.crop_top - sps.crop_bottom;
+
+  return true;
+}
+
+bool h264_parse_pps(const uint8_t* rbsp, size_t size, H264_Pps& pps) {
+
+  H264_BitReader br(rbsp, size);
+
+  memset(&pps, 0x00, sizeof(pps));
+
+  if(!h264_read_ue(br, H264_MAX_PPS_COUNT - 1, "pic_parameter_set_id", pps.pps_id)
+     || !h264_read_ue(br, H264_MAX_SPS_COUNT - 1, "seq_parameter_set_id", pps.sps_id)) {
+    return false;
+  }
+
+  pps.entropy_coding_mode_flag = br.readBit();
+  pps.bottom_field_pic_order_in_frame_present_flag = br.readBit();
+
+  if(!h264_read_ue(br, 7, "num_slice_groups_minus1", pps.num_slice_groups)) {
+    return false;
+  }
+
+  pps.num_slice_groups += 1;
+
+  if(pps.num_slice_groups > 1) {
+
+    uint32_t map_type = br.readUe();
+
+    if(map_type == 0) {
+      for(int i = 0; i < pps.num_slice_groups; ++i) {
+        br.readUe();                                                                     /* run_length_minus1 */
+      }
+    }
+    else if(map_type == 2) {
+      for(int i = 0; i < pps.num_slice_groups - 1; ++i) {
+        br.readUe();                                                                     /* top_left */
+        br.readUe();                                                                     /* bottom_right */
+      }
+    }
+    else if(map_type >= 3 && map_type <= 5) {
+      br.readBit();                                                                      /* slice_group_change_direction_flag */
+      br.readUe();                                                                       /* slice_group_change_rate_minus1 */
+    }
+    else if(map_type == 6) {
+      uint32_t map_units = br.readUe() + 1;
+      int bits = 0;
+      while((1 << bits) < pps.num_slice_groups) {
+        bits++;
+      }
+      br.skipBits((size_t)map_units * bits);                                             /* slice_group_id */
+    }
+  }
+
+  if(!h264_read_ue(br, 31, "num_ref_idx_l0_default_active_minus1", pps.num_ref_idx_l0_default_active)
+     || !h264_read_ue(br, 31, "num_ref_idx_l1_default_active_minus1", pps.num_ref_idx_l1_default_active)) {
+    return false;
+  }
+
+  pps.num_ref_idx_l0_default_active += 1;
+  pps.num_ref_idx_l1_default_active += 1;
+  pps.weighted_pred_flag = br.readBit();
+  pps.weighted_bipred_idc = br.readBits(2);
+  pps.pic_init_qp = 26 + br.readSe();
+  br.readSe();                                                                           /* pic_init_qs_minus26 */
+  pps.chroma_qp_index_offset = br.readSe();
+  pps.deblocking_filter_control_present_flag = br.readBit();
+  pps.constrained_intra_pred_flag = br.readBit();
+  pps.redundant_pic_cnt_present_flag = br.readBit();
+
+  /* the scaling matrix and second_chroma_qp_index_offset that follow are not needed */
+  if(br.moreRbspData()) {
+    pps.transform_8x8_mode_flag = br.readBit();
+  }
+
+  if(br.error) {
+    printf("Error: the PPS is truncated.\n");
+    return false;
+  }
+
+  return true;
+}
+
+bool h264_probe_data(const uint8_t* data, size_t size, H264_ProbeInfo& info) {
+
+  const uint8_t* p = data;
+  const uint8_t* end = data + size;
+  std::vector<uint8_t> rbsp;
+  H264_Nal nal;
+
+  info = H264_ProbeInfo();
+  info.bytes_read = size;
+
+  while(h264_next_nal(p, end, nal)) {
+
+    if(nal.type != H264_NAL_SPS && nal.type != H264_NAL_PPS) {
+      continue;
+    }
+
+    if(nal.type == H264_NAL_SPS && info.has_sps) {
+      continue;
+    }
+
+    if(nal.type == H264_NAL_PPS && info.has_pps) {
+      continue;
+    }
+
+    /* the last NAL in the buffer may be cut off; the parser notices that */
+    if(nal.size < 2) {
+      continue;
+    }
+
+    size_t rbsp_size = 0;
+    const uint8_t* rbsp_data = h264_rbsp(nal.data + 1, nal.size - 1, rbsp, rbsp_size);
+
+    if(nal.type == H264_NAL_SPS) {
+      info.has_sps = h264_parse_sps(rbsp_data, rbsp_size, info.sps);
+    }
+    else {
+      info.has_pps = h264_parse_pps(rbsp_data, rbsp_size, info.pps);
+    }
+
+    if(info.has_sps && info.has_pps) {
+      break;
+    }
+  }
+
+  if(!info.has_sps) {
+    return false;
+  }
+
+  info.width = info.sps.width;
+  info.height = info.sps.height;
+
+  /* a tick is a field, so a frame takes two ticks (E.2.1) */
+  if(info.sps.timing_info_present_flag && info.sps.num_units_in_tick > 0) {
+    info.fps = (double)info.sps.time_scale / (2.0 * info.sps.num_units_in_tick);
+  }
+
+  snprintf(info.codec, sizeof(info.codec), "avc1.%02x%02x%02x",
+           info.sps.profile_idc & 0xFF,
+           info.sps.constraint_flags & 0xFF,
+           info.sps.level_idc & 0xFF);
+
+  return true;
+}
+
+bool h264_probe(std::string filepath, H264_ProbeInfo& info) {
+
+  FILE* fp = fopen(filepath.c_str(), "rb");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", filepath.c_str());
+    return false;
+  }
+
+  std::vector<uint8_t> buffer(H264_PROBE_SIZE);
+  size_t nbytes = fread(&buffer[0], 1, buffer.size(), fp);
+  fclose(fp);
+
+  if(nbytes == 0) {
+    printf("Error: cannot read: %s\n", filepath.c_str());
+    return false;
+  }
+
+  if(!h264_probe_data(&buffer[0], nbytes, info)) {
+    printf("Error: no SPS in the first %zu bytes of: %s\n", nbytes, filepath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+static bool h264_is_high_profile(int profileIdc) {
+
+  switch(profileIdc) {
+    case 100: case 110: case 122: case 244: case 44:
+    case 83:  case 86:  case 118: case 128: case 138:
+    case 139: case 134: case 135: {
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+/* reads a ue(v) and checks it in the unsigned domain before we narrow it, so huge codes can't wrap into negative ids or sizes */
+static bool h264_read_ue(H264_BitReader& br, uint32_t maxValue, const char* name, int& result) {
+
+  uint32_t value = br.readUe();
+
+  if(value > maxValue) {
+    printf("Error: invalid %s: %u\n", name, value);
+    return false;
+  }
+
+  result = (int)value;
+
+  return true;
+}
+
+static void h264_skip_scaling_list(H264_BitReader& br, int size) {
+
+  int last_scale = 8;
+  int next_scale = 8;
+
+  for(int j = 0; j < size; ++j) {
+
+    if(next_scale != 0) {
+      int delta_scale = br.readSe();
+      next_scale = (last_scale + delta_scale + 256) % 256;
+    }
+
+    last_scale = (next_scale == 0) ? last_scale : next_scale;
+
+    if(br.error) {
+      return;
+    }
+  }
+}
+
+static void h264_parse_vui(H264_BitReader& br, H264_Sps& sps) {
+
+  if(br.readBit()) {                                                                     /* aspect_ratio_info_present_flag */
+
+    static const int sar_table[17][2] = {
+      { 0, 0 }, { 1, 1 }, { 12, 11 }, { 10, 11 }, { 16, 11 }, { 40, 33 }, { 24, 11 }, { 20, 11 },
+      { 32, 11 }, { 80, 33 }, { 18, 11 }, { 15, 11 }, { 64, 33 }, { 160, 99 }, { 4, 3 }, { 3, 2 }, { 2, 1 }
+    };
+
+    uint32_t idc = br.readBits(8);
+
+    if(idc == 255) {                                                                     /* Extended_SAR */
+      sps.sar_width = br.readBits(16);
+      sps.sar_height = br.readBits(16);
+    }
+    else if(idc < 17) {
+      sps.sar_width = sar_table[idc][0];
+      sps.sar_height = sar_table[idc][1];
+    }
+  }
+
+  if(br.readBit()) {                                                                     /* overscan_info_present_flag */
+    br.readBit();                                                                        /* overscan_appropriate_flag */
+  }
+
+  if(br.readBit()) {                                                                     /* video_signal_type_present_flag */
+    br.readBits(3);                                                                      /* video_format */
+    sps.video_full_range_flag = br.readBit();
+    if(br.readBit()) {                                                                   /* colour_description_present_flag */
+      sps.colour_primaries = br.readBits(8);
+      sps.transfer_characteristics = br.readBits(8);
+      sps.matrix_coefficients = br.readBits(8);
+    }
+  }
+
+  if(br.readBit()) {                                                                     /* chroma_loc_info_present_flag */
+    br.readUe();                                                                         /* chroma_sample_loc_type_top_field */
+    br.readUe();                                                                         /* chroma_sample_loc_type_bottom_field */
+  }
+
+  sps.timing_info_present_flag = br.readBit();
+
+  if(sps.timing_info_present_flag) {
+    sps.num_units_in_tick = br.readBits(32);
+    sps.time_scale = br.readBits(32);
+    sps.fixed_frame_rate_flag = br.readBit();
+  }
+}
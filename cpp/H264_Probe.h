@@ -0,0 +1,115 @@
+/*
+
+  H264_Probe
+  ---------------------------------------
+
+  Finds the resolution, profile, level, chroma format and framerate of an
+  Annex B stream without opening the decoder. `h264_probe()` reads the first
+  H264_PROBE_SIZE bytes of a file, looks for the first SPS and PPS with the
+  start code scanner (see H264_AnnexB) and parses them with H264_BitReader.
+  This is a lot cheaper than loading the file into a H264_Decoder and
+  decoding the first frame.
+
+  `h264_parse_sps()` and `h264_parse_pps()` parse the RBSP of a parameter set
+  (without the emulation prevention bytes and the nal header); they're also
+  used by the slice header parser. We don't keep the scaling lists and the
+  HRD parameters and we stop parsing the VUI after the timing info.
+
+  `H264_ProbeInfo::codec` is the codec string of RFC 6381 (`avc1.PPCCLL`,
+  profile_idc, the constraint flags byte and level_idc in hex), which you can
+  use in a MIME type or a DASH/HLS manifest.
+
+  Usage:
+
+      H264_ProbeInfo info;
+      if(h264_probe("file.h264", info)) {
+        printf("%dx%d %s\n", info.width, info.height, info.codec);
+      }
+
+ */
+#ifndef H264_PROBE_H
+#define H264_PROBE_H
+
+#define H264_PROBE_SIZE (64 * 1024)                                                      /* number of bytes h264_probe() reads from the start of the file */
+#define H264_MAX_SPS_COUNT 32                                                           /* seq_parameter_set_id is 0..31 */
+#define H264_MAX_PPS_COUNT 256                                                          /* pic_parameter_set_id is 0..255 */
+#define H264_MAX_MBS 4096                                                               /* max width/height in macroblocks we accept; level 6.2 allows max ~1055 */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+struct H264_Sps {
+  int sps_id;                                                                            /* seq_parameter_set_id */
+  int profile_idc;                                                                       /* profile_idc, e.g. 66 (baseline), 77 (main), 100 (high) */
+  int constraint_flags;                                                                  /* the byte with constraint_set0_flag .. constraint_set5_flag and the reserved bits */
+  int level_idc;                                                                         /* level_idc, 10 times the level number (e.g. 31 for level 3.1) */
+  int chroma_format_idc;                                                                 /* 0 = monochrome, 1 = 4:2:0, 2 = 4:2:2, 3 = 4:4:4 */
+  int separate_colour_plane_flag;                                                        /* 4:4:4 coded as three monochrome planes */
+  int bit_depth_luma;                                                                    /* bits per luma sample */
+  int bit_depth_chroma;                                                                  /* bits per chroma sample */
+  int log2_max_frame_num;                                                                /* number of bits of frame_num in the slice header */
+  int pic_order_cnt_type;                                                                /* 0, 1 or 2 */
+  int log2_max_pic_order_cnt_lsb;                                                        /* number of bits of pic_order_cnt_lsb, for pic_order_cnt_type 0 */
+  int delta_pic_order_always_zero_flag;                                                  /* for pic_order_cnt_type 1 */
+  int max_num_ref_frames;                                                                /* max_num_ref_frames */
+  int pic_width_in_mbs;                                                                  /* width in macroblocks */
+  int pic_height_in_map_units;                                                           /* height in map units (macroblocks or macroblock pairs) */
+  int frame_mbs_only_flag;                                                               /* 0 when the stream may contain fields */
+  int mb_adaptive_frame_field_flag;                                                      /* MBAFF */
+  int crop_left;                                                                         /* cropping in pixels */
+  int crop_right;
+  int crop_top;
+  int crop_bottom;
+  int width;                                                                             /* the display width in pixels, after cropping */
+  int height;                                                                            /* the display height in pixels, after cropping */
+  int vui_parameters_present_flag;                                                       /* the fields below are only set when this is set */
+  int sar_width;                                                                         /* sample aspect ratio; 0 when unknown */
+  int sar_height;
+  int video_full_range_flag;                                                             /* 1 for full range (0..255) samples */
+  int colour_primaries;                                                                  /* 2 (unspecified) when not present */
+  int transfer_characteristics;
+  int matrix_coefficients;
+  int timing_info_present_flag;                                                          /* num_units_in_tick and time_scale are set */
+  uint32_t num_units_in_tick;
+  uint32_t time_scale;
+  int fixed_frame_rate_flag;
+};
+
+struct H264_Pps {
+  int pps_id;                                                                            /* pic_parameter_set_id */
+  int sps_id;                                                                            /* the SPS this PPS refers to */
+  int entropy_coding_mode_flag;                                                          /* 0 = CAVLC, 1 = CABAC */
+  int bottom_field_pic_order_in_frame_present_flag;                                      /* the slice header has delta_pic_order_cnt_bottom */
+  int num_slice_groups;                                                                  /* 1 unless FMO is used */
+  int num_ref_idx_l0_default_active;                                                     /* default number of active references in list 0 */
+  int num_ref_idx_l1_default_active;                                                     /* default number of active references in list 1 */
+  int weighted_pred_flag;                                                                /* explicit weighted prediction for P slices */
+  int weighted_bipred_idc;                                                               /* weighted prediction for B slices */
+  int pic_init_qp;                                                                       /* 26 + pic_init_qp_minus26 */
+  int chroma_qp_index_offset;
+  int deblocking_filter_control_present_flag;                                            /* the slice header has the deblocking filter fields */
+  int constrained_intra_pred_flag;
+  int redundant_pic_cnt_present_flag;                                                    /* the slice header has redundant_pic_cnt */
+  int transform_8x8_mode_flag;                                                           /* 8x8 transform (high profile) */
+};
+
+struct H264_ProbeInfo {
+  H264_ProbeInfo();
+  bool has_sps;                                                                          /* we found and parsed a SPS */
+  bool has_pps;                                                                          /* we found and parsed a PPS */
+  H264_Sps sps;                                                                          /* the first SPS in the stream */
+  H264_Pps pps;                                                                          /* the first PPS in the stream */
+  int width;                                                                             /* display width, after cropping */
+  int height;                                                                            /* display height, after cropping */
+  double fps;                                                                            /* framerate from the VUI timing info; 0 when not present */
+  char codec[16];                                                                        /* RFC 6381 codec string, e.g. "avc1.64001f" */
+  size_t bytes_read;                                                                     /* number of bytes we scanned */
+};
+
+bool h264_parse_sps(const uint8_t* rbsp, size_t size, H264_Sps& sps);                    /* parse the RBSP of a SPS, without the nal header byte */
+bool h264_parse_pps(const uint8_t* rbsp, size_t size, H264_Pps& pps);                    /* parse the RBSP of a PPS, without the nal header byte */
+bool h264_probe_data(const uint8_t* data, size_t size, H264_ProbeInfo& info);            /* probe an Annex B buffer; true when we found a SPS */
+bool h264_probe(std::string filepath, H264_ProbeInfo& info);                             /* probe the first H264_PROBE_SIZE bytes of a file */
+
+#endif
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux)
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#endif
+#include "H264_RingBuffer.h"
+
+H264_RingBuffer::H264_RingBuffer()
+  :data(NULL)
+  ,capacity(0)
+  ,padding(0)
+  ,read_pos(0)
+  ,write_pos(0)
+  ,mirrored(false)
+  ,mapped_size(0)
+{
+}
+
+H264_RingBuffer::~H264_RingBuffer() {
+  release();
+}
+
+void H264_RingBuffer::release() {
+
+  if(data) {
+#if defined(__linux)
+    if(mirrored) {
+      munmap(data, mapped_size);
+    }
+    else {
+      free(data);
+    }
+#else
+    free(data);
+#endif
+    data = NULL;
+  }
+
+  mirrored = false;
+  mapped_size = 0;
+  capacity = 0;
+  padding = 0;
+  read_pos = 0;
+  write_pos = 0;
+}
+
+bool H264_RingBuffer::allocate(size_t nbytes, size_t pad, bool mirror) {
+
+  if(data) {
+    printf("Error: ring buffer already allocated.\n");
+    return false;
+  }
+
+  if(nbytes == 0) {
+    printf("Error: invalid ring buffer capacity.\n");
+    return false;
+  }
+
+  if(mirror) {
+    return allocateMirror(nbytes, pad);
+  }
+
+  data = (uint8_t*)malloc(nbytes + pad);
+  if(!data) {
+    printf("Error: cannot allocate the ring buffer: %zu bytes.\n", nbytes + pad);
+    return false;
+  }
+
+  memset(data + nbytes, 0x00, pad);
+
+  capacity = nbytes;
+  padding = pad;
+  read_pos = 0;
+  write_pos = 0;
+
+  return true;
+}
+
+#if defined(__linux)
+bool H264_RingBuffer::allocateMirror(size_t nbytes, size_t pad) {
+
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  size_t cap = ((nbytes + page_size - 1) / page_size) * page_size;
+  size_t pad_size = ((pad + page_size - 1) / page_size) * page_size;
+  size_t total = cap * 2 + pad_size;
+
+  int fd = (int)syscall(SYS_memfd_create, "h264_ringbuffer", 0);
+  if(fd < 0) {
+    printf("Error: cannot create the memory file for the mirrored ring buffer.\n");
+    return false;
+  }
+
+  if(ftruncate(fd, cap) < 0) {
+    printf("Error: cannot resize the memory file for the mirrored ring buffer.\n");
+    close(fd);
+    return false;
+  }
+
+  /* reserve the address range; the anonymous pages after the two mirrors are our zeroed padding */
+  uint8_t* base = (uint8_t*)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(base == MAP_FAILED) {
+    printf("Error: cannot reserve %zu bytes for the mirrored ring buffer.\n", total);
+    close(fd);
+    return false;
+  }
+
+  if(mmap(base, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+     || mmap(base + cap, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+  {
+    printf("Error: cannot map the mirrored ring buffer.\n");
+    munmap(base, total);
+    close(fd);
+    return false;
+  }
+
+  close(fd);
+
+  data = base;
+  capacity = cap;
+  padding = pad;
+  mirrored = true;
+  mapped_size = total;
+  read_pos = 0;
+  write_pos = 0;
+
+  return true;
+}
+#else
+bool H264_RingBuffer::allocateMirror(size_t nbytes, size_t pad) {
+  printf("Error: mirrored ring buffers are only supported on Linux.\n");
+  return false;
+}
+#endif
+
+void H264_RingBuffer::clear() {
+  read_pos = 0;
+  write_pos = 0;
+}
+
+uint8_t* H264_RingBuffer::writePtr(size_t& nbytes) {
+
+  size_t offset = (size_t)(write_pos % capacity);
+  size_t free_bytes = space();
+
+  nbytes = mirrored ? free_bytes : capacity - offset;
+  if(nbytes > free_bytes) {
+    nbytes = free_bytes;
+  }
+
+  return data + offset;
+}
+
+void H264_RingBuffer::commit(size_t nbytes) {
+
+  if(nbytes > space()) {
+    printf("Error: trying to commit more bytes than available in the ring buffer.\n");
+    nbytes = space();
+  }
+  write_pos += nbytes;
+}
+
+uint8_t* H264_RingBuffer::readPtr(size_t& nbytes) {
+
+  size_t offset = (size_t)(read_pos % capacity);
+  size_t used_bytes = size();
+
+  nbytes = mirrored ? used_bytes : capacity - offset;
+  if(nbytes > used_bytes) {
+    nbytes = used_bytes;
+  }
+
+  return data + offset;
+}
+
+void H264_RingBuffer::consume(size_t nbytes) {
+
+  if(nbytes > size()) {
+    printf("Error: trying to consume more bytes than available in the ring buffer.\n");
+    nbytes = size();
+  }
+
+  read_pos += nbytes;
+}
@@ -0,0 +1,71 @@
+/*
+
+  H264_RingBuffer
+  ---------------------------------------
+
+  Fixed capacity ring buffer that is used by the H264_Decoder to keep track of
+  the bitstream data that we read from file but which hasn't been parsed yet.
+  Instead of erasing parsed bytes from the front of a vector (which moves all
+  the remaining bytes), we only advance a read cursor. Bytes are never moved.
+
+  The buffer allocates `padding` extra bytes after the end of the storage.
+  Every region returned by `readPtr()` is therefore followed by at least
+  `padding` readable bytes, which is what the libav parser expects from its
+  input (FF_INPUT_BUFFER_PADDING_SIZE). Only the padding after the storage is
+  zeroed (we never write there); a region that ends before the end of the
+  storage is followed by older input, not by zeros.
+
+  Writing is done in place too: use `writePtr()` to get the contiguous free
+  region, fill it (e.g. with fread) and call `commit()` with the number of bytes
+  you wrote. Reading works the same way with `readPtr()` and `consume()`.
+
+  When you allocate a mirrored buffer (Linux only) the storage is mapped twice,
+  back to back, so the readable and writable regions never wrap: `readPtr()`
+  returns all unread bytes as one contiguous region. This is what you need when
+  you want to hand complete access units to the decoder without copying them.
+  The capacity is rounded up to the page size.
+
+ */
+#ifndef H264_RINGBUFFER_H
+#define H264_RINGBUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class H264_RingBuffer {
+
+ public:
+  H264_RingBuffer();
+  ~H264_RingBuffer();
+  bool allocate(size_t nbytes, size_t padding, bool mirror = false);                     /* allocate the storage; nbytes is the capacity, padding the number of readable bytes we keep after the storage */
+  void release();                                                                        /* free the storage; allocate() can be called again afterwards */
+  void clear();                                                                          /* reset the read and write cursors, keeps the storage */
+  uint8_t* writePtr(size_t& nbytes);                                                     /* returns the contiguous free region and sets nbytes to its size */
+  void commit(size_t nbytes);                                                            /* mark nbytes of the region returned by writePtr() as written */
+  uint8_t* readPtr(size_t& nbytes);                                                      /* returns the contiguous readable region and sets nbytes to its size */
+  void consume(size_t nbytes);                                                           /* mark nbytes of the region returned by readPtr() as used */
+  size_t size();                                                                         /* number of bytes that can be read */
+  size_t space();                                                                        /* number of bytes that can be written */
+
+ private:
+  bool allocateMirror(size_t nbytes, size_t padding);                                    /* maps a memory file twice; used by allocate() when mirror is true */
+
+ public:
+  uint8_t* data;                                                                         /* the storage + padding */
+  size_t capacity;                                                                       /* size of the storage, without padding */
+  size_t padding;                                                                        /* number of zeroed bytes after the end of the storage (not after every readable region) */
+  uint64_t read_pos;                                                                     /* total number of bytes consumed; read offset is read_pos % capacity */
+  uint64_t write_pos;                                                                    /* total number of bytes committed; write offset is write_pos % capacity */
+  bool mirrored;                                                                         /* true when the storage is mapped twice */
+  size_t mapped_size;                                                                    /* number of bytes we mapped for a mirrored buffer */
+};
+
+inline size_t H264_RingBuffer::size() {
+  return (size_t)(write_pos - read_pos);
+}
+
+inline size_t H264_RingBuffer::space() {
+  return capacity - size();
+}
+
+#endif
@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "H264_SliceHeader.h"
+#include "H264_BitReader.h"
+
+static void h264_skip_ref_pic_list_modification(H264_BitReader& br);
+static void h264_skip_pred_weight_table(H264_BitReader& br, int chromaArrayType, int numL0, int numL1, bool isB);
+static void h264_skip_dec_ref_pic_marking(H264_BitReader& br, bool isIdr);
+
+/* ------------------------------------------------------------------------------ */
+
+H264_SliceParser::H264_SliceParser() {
+  reset();
+}
+
+void H264_SliceParser::reset() {
+
+  memset(sps, 0x00, sizeof(sps));
+  memset(pps, 0x00, sizeof(pps));
+  memset(has_sps, 0x00, sizeof(has_sps));
+  memset(has_pps, 0x00, sizeof(has_pps));
+  memset(&slice, 0x00, sizeof(slice));
+
+  active_sps = -1;
+  prev_poc_msb = 0;
+  prev_poc_lsb = 0;
+  prev_frame_num = 0;
+  frame_num_offset = 0;
+  errors = 0;
+}
+
+const H264_Sps* H264_SliceParser::activeSps() {
+  return (active_sps >= 0) ? &sps[active_sps] : NULL;
+}
+
+bool H264_SliceParser::parseNal(const H264_Nal& nal) {
+
+  bool is_slice = (nal.type == H264_NAL_SLICE || nal.type == H264_NAL_IDR);
+
+  if(!is_slice && nal.type != H264_NAL_SPS && nal.type != H264_NAL_PPS) {
+    return false;
+  }
+
+  if(nal.size < 2) {
+    errors++;
+    return false;
+  }
+
+  /* parameter sets are small; of a slice we only need the header */
+  size_t nbytes = nal.size - 1;
+  if(is_slice) {
+    nbytes = std::min(nbytes, (size_t)H264_SLICE_HEADER_SIZE);
+  }
+
+  size_t rbsp_size = 0;
+  const uint8_t* rbsp_data = h264_rbsp(nal.data + 1, nbytes, rbsp, rbsp_size);
+
+  if(nal.type == H264_NAL_SPS) {
+    H264_Sps s;
+    /* h264_parse_sps() checks the id, but it's an index so we don't trust it blindly */
+    if(!h264_parse_sps(rbsp_data, rbsp_size, s) || (uint32_t)s.sps_id >= H264_MAX_SPS_COUNT) {
+      errors++;
+      return false;
+    }
+    sps[s.sps_id] = s;
+    has_sps[s.sps_id] = true;
+    return true;
+  }
+
+  if(nal.type == H264_NAL_PPS) {
+    H264_Pps p;
+    if(!h264_parse_pps(rbsp_data, rbsp_size, p)
+       || (uint32_t)p.pps_id >= H264_MAX_PPS_COUNT || (uint32_t)p.sps_id >= H264_MAX_SPS_COUNT) {
+      errors++;
+      return false;
+    }
+    pps[p.pps_id] = p;
+    has_pps[p.pps_id] = true;
+    return true;
+  }
+
+  if(!parseSlice(rbsp_data, rbsp_size, nal.type, nal.ref_idc)) {
+    errors++;
+    return false;
+  }
+
+  return true;
+}
+
+bool H264_SliceParser::parseSlice(const uint8_t* data, size_t size, int nalType, int nalRefIdc) {
+
+  H264_BitReader br(data, size);
+  H264_SliceHeader sh;
+  bool is_idr = (nalType == H264_NAL_IDR);
+
+  memset(&sh, 0x00, sizeof(sh));
+
+  sh.nal_type = nalType;
+  sh.nal_ref_idc = nalRefIdc;
+  sh.first_mb_in_slice = br.readUe();
+  sh.slice_type = (int)(br.readUe() % 5);
+
+  /* compare before the cast, a huge id would wrap into a negative index */
+  uint32_t pps_id = br.readUe();
+
+  if(pps_id >= H264_MAX_PPS_COUNT || !has_pps[pps_id]) {
+    return false;
+  }
+
+  sh.pps_id = (int)pps_id;
+
+  const H264_Pps& p = pps[sh.pps_id];
+
+  if(!has_sps[p.sps_id]) {
+    return false;
+  }
+
+  const H264_Sps& s = sps[p.sps_id];
+
+  if(s.separate_colour_plane_flag) {
+    br.readBits(2);                                                                      /* colour_plane_id */
+  }
+
+  sh.frame_num = br.readBits(s.log2_max_frame_num);
+
+  if(!s.frame_mbs_only_flag) {
+    sh.field_pic_flag = br.readBit();
+    if(sh.field_pic_flag) {
+      sh.bottom_field_flag = br.readBit();
+    }
+  }
+
+  if(is_idr) {
+    sh.idr_pic_id = br.readUe();
+  }
+
+  if(s.pic_order_cnt_type == 0) {
+    sh.pic_order_cnt_lsb = br.readBits(s.log2_max_pic_order_cnt_lsb);
+    if(p.bottom_field_pic_order_in_frame_present_flag && !sh.field_pic_flag) {
+      sh.delta_pic_order_cnt_bottom = br.readSe();
+    }
+  }
+  else if(s.pic_order_cnt_type == 1 && !s.delta_pic_order_always_zero_flag) {
+    br.readSe();                                                                         /* delta_pic_order_cnt[0] */
+    if(p.bottom_field_pic_order_in_frame_present_flag && !sh.field_pic_flag) {
+      br.readSe();                                                                       /* delta_pic_order_cnt[1] */
+    }
+  }
+
+  if(p.redundant_pic_cnt_present_flag) {
+    br.readUe();                                                                         /* redundant_pic_cnt */
+  }
+
+  bool is_b = (sh.slice_type == H264_SLICE_B);
+  bool is_p = (sh.slice_type == H264_SLICE_P || sh.slice_type == H264_SLICE_SP);
+
+  if(is_b) {
+    br.readBit();                                                                        /* direct_spatial_mv_pred_flag */
+  }
+
+  sh.num_ref_idx_l0_active = p.num_ref_idx_l0_default_active;
+  sh.num_ref_idx_l1_active = p.num_ref_idx_l1_default_active;
+
+  if(is_p || is_b) {
+    if(br.readBit()) {                                                                   /* num_ref_idx_active_override_flag */
+      uint32_t num_l0 = br.readUe();
+      uint32_t num_l1 = (is_b) ? br.readUe() : 0;
+      if(num_l0 > 31 || num_l1 > 31) {
+        return false;
+      }
+      sh.num_ref_idx_l0_active = (int)num_l0 + 1;
+      if(is_b) {
+        sh.num_ref_idx_l1_active = (int)num_l1 + 1;
+      }
+    }
+  }
+
+  /* ref_pic_list_modification(); slices of type 20/21 (MVC) never get here */
+  if(sh.slice_type != H264_SLICE_I && sh.slice_type != H264_SLICE_SI) {
+    h264_skip_ref_pic_list_modification(br);
+    if(is_b) {
+      h264_skip_ref_pic_list_modification(br);
+    }
+  }
+
+  if((p.weighted_pred_flag && is_p) || (p.weighted_bipred_idc == 1 && is_b)) {
+    int chroma_array_type = (s.separate_colour_plane_flag) ? 0 : s.chroma_format_idc;
+    h264_skip_pred_weight_table(br, chroma_array_type, sh.num_ref_idx_l0_active, sh.num_ref_idx_l1_active, is_b);
+  }
+
+  if(nalRefIdc != 0) {
+    h264_skip_dec_ref_pic_marking(br, is_idr);
+  }
+
+  if(p.entropy_coding_mode_flag && sh.slice_type != H264_SLICE_I && sh.slice_type != H264_SLICE_SI) {
+    br.readUe();                                                                         /* cabac_init_idc */
+  }
+
+  sh.qp = p.pic_init_qp + br.readSe();
+
+  if(br.error) {
+    return false;
+  }
+
+  slice = sh;
+  active_sps = p.sps_id;
+
+  computePoc();
+
+  return true;
+}
+
+void H264_SliceParser::computePoc() {
+
+  const H264_Sps& s = sps[active_sps];
+  bool is_idr = (slice.nal_type == H264_NAL_IDR);
+  int64_t max_frame_num = (int64_t)1 << s.log2_max_frame_num;
+
+  if(s.pic_order_cnt_type == 0) {
+
+    int32_t max_lsb = (int32_t)1 << s.log2_max_pic_order_cnt_lsb;
+    int32_t lsb = (int32_t)slice.pic_order_cnt_lsb;
+    int32_t msb = 0;
+
+    if(is_idr) {
+      prev_poc_msb = 0;
+      prev_poc_lsb = 0;
+    }
+
+    /* 8-3 */
+    if(lsb < (int32_t)prev_poc_lsb && ((int32_t)prev_poc_lsb - lsb) >= max_lsb / 2) {
+      msb = prev_poc_msb + max_lsb;
+    }
+    else if(lsb > (int32_t)prev_poc_lsb && (lsb - (int32_t)prev_poc_lsb) > max_lsb / 2) {
+      msb = prev_poc_msb - max_lsb;
+    }
+    else {
+      msb = prev_poc_msb;
+    }
+
+    slice.poc = msb + lsb;
+
+    if(!slice.field_pic_flag && slice.delta_pic_order_cnt_bottom < 0) {
+      slice.poc += slice.delta_pic_order_cnt_bottom;
+    }
+
+    if(slice.nal_ref_idc != 0) {
+      prev_poc_msb = msb;
+      prev_poc_lsb = slice.pic_order_cnt_lsb;
+    }
+  }
+  else if(s.pic_order_cnt_type == 2) {
+
+    if(is_idr) {
+      frame_num_offset = 0;
+    }
+    else if(prev_frame_num > slice.frame_num) {
+      frame_num_offset += max_frame_num;
+    }
+
+    if(is_idr) {
+      slice.poc = 0;
+    }
+    else if(slice.nal_ref_idc == 0) {
+      slice.poc = (int32_t)(2 * (frame_num_offset + slice.frame_num) - 1);
+    }
+    else {
+      slice.poc = (int32_t)(2 * (frame_num_offset + slice.frame_num));
+    }
+  }
+  else {
+    slice.poc = -1;
+  }
+
+  prev_frame_num = slice.frame_num;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+const char* h264_slice_type_name(int sliceType) {
+
+  switch(sliceType) {
+    case H264_SLICE_P:  { return "P";  }
+    case H264_SLICE_B:  { return "B";  }
+    case H264_SLICE_I:  { return "I";  }
+    case H264_SLICE_SP: { return "SP"; }
+    case H264_SLICE_SI: { return "SI"; }
+    default:            { return "?";  }
+  }
+}
+
+static void h264_skip_ref_pic_list_modification(H264_BitReader& br) {
+
+  if(!br.readBit()) {                                                                    /* ref_pic_list_modification_flag_lX */
+    return;
+  }
+
+  /* max 32 references, plus the terminating 3 */
+  for(int i = 0; i < 33 && !br.error; ++i) {
+
+    uint32_t idc = br.readUe();                                                          /* modification_of_pic_nums_idc */
+
+    if(idc == 3) {
+      return;
+    }
+
+    br.readUe();                                                                         /* abs_diff_pic_num_minus1 or long_term_pic_num */
+  }
+}
+
+static void h264_skip_pred_weight_table(H264_BitReader& br, int chromaArrayType, int numL0, int numL1, bool isB) {
+
+  br.readUe();                                                                           /* luma_log2_weight_denom */
+
+  if(chromaArrayType != 0) {
+    br.readUe();                                                                         /* chroma_log2_weight_denom */
+  }
+
+  for(int list = 0; list < (isB ? 2 : 1); ++list) {
+
+    int count = (list == 0) ? numL0 : numL1;
+
+    for(int i = 0; i < count && !br.error; ++i) {
+
+      if(br.readBit()) {                                                                 /* luma_weight_flag */
+        br.readSe();
+        br.readSe();
+      }
+
+      if(chromaArrayType != 0 && br.readBit()) {                                         /* chroma_weight_flag */
+        for(int j = 0; j < 2; ++j) {
+          br.readSe();
+          br.readSe();
+        }
+      }
+    }
+  }
+}
+
+static void h264_skip_dec_ref_pic_marking(H264_BitReader& br, bool isIdr) {
+
+  if(isIdr) {
+    br.readBit();                                                                        /* no_output_of_prior_pics_flag */
+    br.readBit();                                                                        /* long_term_reference_flag */
+    return;
+  }
+
+  if(!br.readBit()) {                                                                    /* adaptive_ref_pic_marking_mode_flag */
+    return;
+  }
+
+  /* the number of operations is not limited by the spec; the header size is */
+  while(!br.error) {
+
+    uint32_t mmco = br.readUe();
+
+    if(mmco == 0) {
+      return;
+    }
+
+    if(mmco == 1 || mmco == 3) {
+      br.readUe();                                                                       /* difference_of_pic_nums_minus1 */
+    }
+
+    if(mmco == 2) {
+      br.readUe();                                                                       /* long_term_pic_num */
+    }
+
+    if(mmco == 3 || mmco == 6) {
+      br.readUe();                                                                       /* long_term_frame_idx */
+    }
+
+    if(mmco == 4) {
+      br.readUe();                                                                       /* max_long_term_frame_idx_plus1 */
+    }
+  }
+}
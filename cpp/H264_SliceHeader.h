@@ -0,0 +1,93 @@
+/*
+
+  H264_SliceHeader
+  ---------------------------------------
+
+  Parses slice headers without decoding the slice data. `H264_SliceParser`
+  keeps the SPS and PPS it has seen (by id) and parses the header of every
+  slice NAL you pass to `parseNal()` up to and including slice_qp_delta, so
+  you get the slice type, frame_num, the picture order count and the QP of a
+  picture from the first couple of bytes of every slice.
+
+  Only the first H264_SLICE_HEADER_SIZE bytes of a slice are unescaped and
+  read, which is more than any slice header needs; the slice data is never
+  touched. The picture order count is computed for pic_order_cnt_type 0 and
+  2 (8.2.1); with type 1 `poc` is set to -1. Memory management control
+  operation 5 is not handled, which only matters for the POC of streams that
+  use it.
+
+  Usage:
+
+      H264_SliceParser parser;
+      H264_Nal nal;
+      while(h264_next_nal(p, end, nal)) {
+        if(parser.parseNal(nal) && h264_is_vcl(nal.type)) {
+          // parser.slice holds the header of this slice
+        }
+      }
+
+ */
+#ifndef H264_SLICEHEADER_H
+#define H264_SLICEHEADER_H
+
+#define H264_SLICE_HEADER_SIZE 512                                                      /* max number of bytes at the start of a slice we parse */
+#define H264_SLICE_P 0                                                                  /* slice_type % 5 */
+#define H264_SLICE_B 1
+#define H264_SLICE_I 2
+#define H264_SLICE_SP 3
+#define H264_SLICE_SI 4
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "H264_AnnexB.h"
+#include "H264_Probe.h"
+
+struct H264_SliceHeader {
+  int nal_type;                                                                          /* nal_unit_type of the slice */
+  int nal_ref_idc;                                                                       /* nal_ref_idc; 0 for non reference pictures */
+  uint32_t first_mb_in_slice;                                                            /* 0 for the first slice of a picture */
+  int slice_type;                                                                        /* H264_SLICE_P .. H264_SLICE_SI (slice_type % 5) */
+  int pps_id;                                                                            /* the PPS of the slice */
+  uint32_t frame_num;                                                                    /* frame_num */
+  int field_pic_flag;                                                                    /* the slice is part of a field */
+  int bottom_field_flag;                                                                 /* the field is the bottom field */
+  uint32_t idr_pic_id;                                                                   /* id of the IDR picture */
+  uint32_t pic_order_cnt_lsb;                                                            /* for pic_order_cnt_type 0 */
+  int32_t delta_pic_order_cnt_bottom;                                                    /* for pic_order_cnt_type 0 */
+  int num_ref_idx_l0_active;                                                             /* number of active references in list 0 */
+  int num_ref_idx_l1_active;                                                             /* number of active references in list 1 */
+  int qp;                                                                                /* pic_init_qp + slice_qp_delta */
+  int32_t poc;                                                                           /* picture order count, see above */
+};
+
+class H264_SliceParser {
+
+ public:
+  H264_SliceParser();
+  void reset();                                                                          /* forget the parameter sets and the POC state */
+  bool parseNal(const H264_Nal& nal);                                                    /* stores a SPS/PPS or parses a slice header into `slice`; false on error or for other NAL types */
+  const H264_Sps* activeSps();                                                           /* the SPS of the last parsed slice, NULL when there was none */
+
+ private:
+  bool parseSlice(const uint8_t* rbsp, size_t size, int nalType, int nalRefIdc);         /* parse the header into `slice` */
+  void computePoc();                                                                     /* set slice.poc from the header and the state of the previous pictures */
+
+ public:
+  H264_Sps sps[H264_MAX_SPS_COUNT];                                                      /* the parameter sets we've seen, by id */
+  H264_Pps pps[H264_MAX_PPS_COUNT];
+  bool has_sps[H264_MAX_SPS_COUNT];
+  bool has_pps[H264_MAX_PPS_COUNT];
+  H264_SliceHeader slice;                                                                /* the last parsed slice header */
+  std::vector<uint8_t> rbsp;                                                             /* unescaped copy of the start of the NAL, when it has emulation prevention bytes */
+  int active_sps;                                                                        /* id of the SPS of the last slice, -1 when none */
+  int32_t prev_poc_msb;                                                                  /* POC state of the previous reference picture (8.2.1.1) */
+  uint32_t prev_poc_lsb;
+  uint32_t prev_frame_num;                                                               /* frame_num of the previous picture (8.2.1.3) */
+  int64_t frame_num_offset;                                                              /* FrameNumOffset of the previous picture */
+  uint64_t errors;                                                                       /* number of NALs we couldn't parse */
+};
+
+const char* h264_slice_type_name(int sliceType);                                         /* "P", "B", "I", "SP" or "SI" */
+
+#endif
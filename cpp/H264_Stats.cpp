@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <tinylib_trace.h>
+#include "H264_Stats.h"
+
+#define H264_COUNTER_COUNT 8                                                            /* number of counters in H264_DecoderStats */
+
+static const char* h264_counter_names[] = {
+  "bytes_read", "reads", "packets", "frames", "read_errors", "parse_errors", "decode_errors", "dropped_frames"
+};
+
+static const char* h264_counter_help[] = {
+  "Bytes read from the input.",
+  "Reads that returned data.",
+  "Packets found in the input.",
+  "Decoded pictures.",
+  "Reads that failed.",
+  "Packets the parser could not handle.",
+  "Packets the decoder could not decode.",
+  "Access units that were not decoded.",
+};
+
+static void h264_stats_counters(const H264_DecoderStats& stats, uint64_t* result);
+static std::string h264_prometheus_escape(const std::string& str);
+
+/* ------------------------------------------------------------------------------ */
+
+uint64_t H264_Histogram::percentile(double p) const {
+
+  if(count == 0) {
+    return 0;
+  }
+
+  uint64_t target = (uint64_t)(p * count + 0.5);
+  uint64_t seen = 0;
+
+  if(target == 0) {
+    target = 1;
+  }
+
+  for(int i = 0; i < H264_HISTOGRAM_BUCKETS - 1; ++i) {
+    seen += buckets[i];
+    if(seen >= target) {
+      uint64_t upper = 2ull << i;
+      return (upper < max) ? upper : max;
+    }
+  }
+
+  return max;
+}
+
+/* ------------------------------------------------------------------------------ */
+
+H264_StatsRecorder::H264_StatsRecorder() {
+  reset();
+}
+
+void H264_StatsRecorder::reset() {
+
+  bytes_read = 0;
+  reads = 0;
+  packets = 0;
+  frames = 0;
+  read_errors = 0;
+  parse_errors = 0;
+  decode_errors = 0;
+  dropped_frames = 0;
+
+  for(int i = 0; i < H264_STAGE_COUNT; ++i) {
+    for(int j = 0; j < H264_HISTOGRAM_BUCKETS; ++j) {
+      buckets[i][j] = 0;
+    }
+    stage_count[i] = 0;
+    stage_sum[i] = 0;
+    stage_max[i] = 0;
+  }
+}
+
+void H264_StatsRecorder::snapshot(H264_DecoderStats& result) {
+
+  result.time = rx_hrtime();
+  result.bytes_read = bytes_read.load(std::memory_order_relaxed);
+  result.reads = reads.load(std::memory_order_relaxed);
+  result.packets = packets.load(std::memory_order_relaxed);
+  result.frames = frames.load(std::memory_order_relaxed);
+  result.read_errors = read_errors.load(std::memory_order_relaxed);
+  result.parse_errors = parse_errors.load(std::memory_order_relaxed);
+  result.decode_errors = decode_errors.load(std::memory_order_relaxed);
+  result.dropped_frames = dropped_frames.load(std::memory_order_relaxed);
+
+  for(int i = 0; i < H264_STAGE_COUNT; ++i) {
+
+    H264_Histogram& h = result.stages[i];
+
+    for(int j = 0; j < H264_HISTOGRAM_BUCKETS; ++j) {
+      h.buckets[j] = buckets[i][j].load(std::memory_order_relaxed);
+    }
+
+    h.count = stage_count[i].load(std::memory_order_relaxed);
+    h.sum = stage_sum[i].load(std::memory_order_relaxed);
+    h.max = stage_max[i].load(std::memory_order_relaxed);
+  }
+}
+
+/* ------------------------------------------------------------------------------ */
+
+const char* h264_stage_name(int stage) {
+
+  switch(stage) {
+    case H264_STAGE_READ:     { return "read";     }
+    case H264_STAGE_PARSE:    { return "parse";    }
+    case H264_STAGE_DECODE:   { return "decode";   }
+    case H264_STAGE_CALLBACK: { return "callback"; }
+    default:                  { return "unknown";  }
+  }
+}
+
+void h264_write_stats_json(FILE* fp, const H264_DecoderStats& stats) {
+
+  uint64_t counters[H264_COUNTER_COUNT];
+  h264_stats_counters(stats, counters);
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"time\": %llu,\n", (unsigned long long)stats.time);
+
+  for(size_t i = 0; i < H264_COUNTER_COUNT; ++i) {
+    fprintf(fp, "  \"%s\": %llu,\n", h264_counter_names[i], (unsigned long long)counters[i]);
+  }
+
+  fprintf(fp, "  \"stages\": {\n");
+
+  for(int i = 0; i < H264_STAGE_COUNT; ++i) {
+
+    const H264_Histogram& h = stats.stages[i];
+
+    /* the buckets up to the last one that is used; bucket i counts values < 2^(i + 1) ns */
+    int used = H264_HISTOGRAM_BUCKETS;
+    while(used > 0 && h.buckets[used - 1] == 0) {
+      used--;
+    }
+
+    fprintf(fp, "    \"%s\": { \"count\": %llu, \"sum_ns\": %llu, \"max_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, \"buckets\": [",
+            h264_stage_name(i),
+            (unsigned long long)h.count,
+            (unsigned long long)h.sum,
+            (unsigned long long)h.max,
+            (unsigned long long)h.percentile(0.50),
+            (unsigned long long)h.percentile(0.99));
+
+    for(int j = 0; j < used; ++j) {
+      fprintf(fp, "%s%llu", (j) ? ", " : "", (unsigned long long)h.buckets[j]);
+    }
+
+    fprintf(fp, "] }%s\n", (i + 1 < H264_STAGE_COUNT) ? "," : "");
+  }
+
+  fprintf(fp, "  }\n");
+  fprintf(fp, "}\n");
+}
+
+void h264_write_stats_prometheus(FILE* fp, const H264_DecoderStats& stats, const std::string& instance) {
+
+  std::string label = h264_prometheus_escape(instance);
+  uint64_t counters[H264_COUNTER_COUNT];
+
+  h264_stats_counters(stats, counters);
+
+  for(size_t i = 0; i < H264_COUNTER_COUNT; ++i) {
+    fprintf(fp, "# HELP h264_decoder_%s_total %s\n", h264_counter_names[i], h264_counter_help[i]);
+    fprintf(fp, "# TYPE h264_decoder_%s_total counter\n", h264_counter_names[i]);
+    fprintf(fp, "h264_decoder_%s_total{decoder=\"%s\"} %llu\n", h264_counter_names[i], label.c_str(), (unsigned long long)counters[i]);
+  }
+
+  fprintf(fp, "# HELP h264_decoder_stage_seconds Time per call of a decoder stage.\n");
+  fprintf(fp, "# TYPE h264_decoder_stage_seconds histogram\n");
+
+  for(int i = 0; i < H264_STAGE_COUNT; ++i) {
+
+    const H264_Histogram& h = stats.stages[i];
+    const char* stage = h264_stage_name(i);
+    uint64_t cumulative = 0;
+
+    /* the last bucket also counts everything larger, so it's the +Inf bucket */
+    for(int j = 0; j < H264_HISTOGRAM_BUCKETS - 1; ++j) {
+      cumulative += h.buckets[j];
+      fprintf(fp, "h264_decoder_stage_seconds_bucket{decoder=\"%s\",stage=\"%s\",le=\"%.9g\"} %llu\n",
+              label.c_str(), stage, (2ull << j) / 1000000000.0, (unsigned long long)cumulative);
+    }
+
+    fprintf(fp, "h264_decoder_stage_seconds_bucket{decoder=\"%s\",stage=\"%s\",le=\"+Inf\"} %llu\n", label.c_str(), stage, (unsigned long long)h.count);
+    fprintf(fp, "h264_decoder_stage_seconds_sum{decoder=\"%s\",stage=\"%s\"} %.9f\n", label.c_str(), stage, h.sum / 1000000000.0);
+    fprintf(fp, "h264_decoder_stage_seconds_count{decoder=\"%s\",stage=\"%s\"} %llu\n", label.c_str(), stage, (unsigned long long)h.count);
+  }
+}
+
+bool h264_dump_stats(const std::string& filepath, const H264_DecoderStats& stats, const std::string& instance) {
+
+  bool prometheus = filepath.size() >= 5 && filepath.compare(filepath.size() - 5, 5, ".prom") == 0;
+
+  /* write to a temporary file and rename it so scrapers never see a partial file */
+  std::string tmp_path = filepath + ".tmp";
+  FILE* fp = fopen(tmp_path.c_str(), "w");
+  if(!fp) {
+    printf("Error: cannot open: %s\n", tmp_path.c_str());
+    return false;
+  }
+
+  if(prometheus) {
+    h264_write_stats_prometheus(fp, stats, instance);
+  }
+  else {
+    h264_write_stats_json(fp, stats);
+  }
+
+  bool ok = !ferror(fp);
+
+  if(fclose(fp) != 0) {
+    ok = false;
+  }
+
+  if(!ok || rename(tmp_path.c_str(), filepath.c_str()) != 0) {
+    printf("Error: cannot write: %s\n", filepath.c_str());
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+/* in the order of h264_counter_names */
+static void h264_stats_counters(const H264_DecoderStats& stats, uint64_t* result) {
+  result[0] = stats.bytes_read;
+  result[1] = stats.reads;
+  result[2] = stats.packets;
+  result[3] = stats.frames;
+  result[4] = stats.read_errors;
+  result[5] = stats.parse_errors;
+  result[6] = stats.decode_errors;
+  result[7] = stats.dropped_frames;
+}
+
+static std::string h264_prometheus_escape(const std::string& str) {
+
+  std::string result;
+
+  for(size_t i = 0; i < str.size(); ++i) {
+    switch(str[i]) {
+      case '\\': { result += "\\\\"; break; }
+      case '"':  { result += "\\\""; break; }
+      case '\n': { result += "\\n";  break; }
+      default:   { result += str[i]; break; }
+    }
+  }
+
+  return result;
+}
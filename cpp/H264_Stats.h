@@ -0,0 +1,137 @@
+/*
+
+  H264_Stats
+  ---------------------------------------
+
+  Counters and per stage timing of a H264_Decoder. The decoder measures the
+  time it spends in every stage of readFrame() with rx_hrtime():
+
+      H264_STAGE_READ      reading from the H264_ByteSource (readBuffer())
+      H264_STAGE_PARSE     av_parser_parse2(), or our access unit splitter
+      H264_STAGE_DECODE    avcodec_decode_video2()
+      H264_STAGE_CALLBACK  your frame callback
+
+  Every stage has a histogram with log2 buckets: bucket `i` counts the calls
+  that took less than 2^(i + 1) ns (and at least 2^i ns), so 40 buckets cover
+  1 ns to 18 minutes with a resolution of a factor 2, without allocating or
+  sorting. The counters count the bytes read, packets, frames, errors and
+  dropped frames.
+
+  H264_StatsRecorder is what the decoder updates. Only one thread (the one
+  that decodes) writes to it, so an update is a relaxed load and store
+  instead of a locked instruction; any thread can take a snapshot with
+  `snapshot()` (or H264_Decoder::stats()) while the decoder runs. The
+  counters of a snapshot are not taken at exactly the same moment, which is
+  fine for monitoring.
+
+  A snapshot can be written as JSON or in the Prometheus text format; the
+  stage histograms become Prometheus histograms in seconds. `h264_dump_stats()`
+  writes a file atomically (a temporary file that is renamed), so you can
+  point the node_exporter textfile collector at a directory with a `.prom`
+  file per decoder. See `H264_DecoderSettings::stats_path`.
+
+ */
+#ifndef H264_STATS_H
+#define H264_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <atomic>
+
+#define H264_HISTOGRAM_BUCKETS 40                                                       /* log2 buckets of nanoseconds, the last one also counts everything larger */
+#define H264_STAGE_READ 0                                                               /* reading from the byte source */
+#define H264_STAGE_PARSE 1                                                              /* finding the next packet */
+#define H264_STAGE_DECODE 2                                                             /* avcodec_decode_video2() */
+#define H264_STAGE_CALLBACK 3                                                           /* the frame callback */
+#define H264_STAGE_COUNT 4
+
+struct H264_Histogram {
+  uint64_t buckets[H264_HISTOGRAM_BUCKETS];                                              /* number of values per log2 bucket, see above */
+  uint64_t count;                                                                        /* number of values */
+  uint64_t sum;                                                                          /* sum of the values (ns) */
+  uint64_t max;                                                                          /* largest value (ns) */
+  uint64_t percentile(double p) const;                                                   /* upper bound (ns) of the bucket that contains percentile p (0..1) */
+  void add(uint64_t ns);                                                                 /* add one value; not thread safe, see H264_StatsRecorder for the decoder */
+};
+
+struct H264_DecoderStats {
+  uint64_t time;                                                                         /* rx_hrtime() of the snapshot */
+  uint64_t bytes_read;                                                                   /* bytes we read from the source */
+  uint64_t reads;                                                                        /* number of reads that returned data */
+  uint64_t packets;                                                                      /* packets (access units) we found in the input */
+  uint64_t frames;                                                                       /* decoded pictures */
+  uint64_t read_errors;                                                                  /* reads that failed */
+  uint64_t parse_errors;                                                                 /* av_parser_parse2() failures, or access units that didn't fit in the ring buffer */
+  uint64_t decode_errors;                                                                /* avcodec_decode_video2() failures */
+  uint64_t dropped_frames;                                                               /* access units we didn't decode (skip mode or resyncing) */
+  H264_Histogram stages[H264_STAGE_COUNT];                                               /* time spent per call, per stage */
+};
+
+class H264_StatsRecorder {
+
+ public:
+  H264_StatsRecorder();
+  void reset();                                                                          /* set everything to zero; not while another thread takes a snapshot */
+  void addTime(int stage, uint64_t ns);                                                  /* add the duration of one call of a stage */
+  void add(std::atomic<uint64_t>& counter, uint64_t n);                                  /* add n to one of the counters below */
+  void snapshot(H264_DecoderStats& result);                                              /* copy the current values; any thread */
+
+ public:
+  std::atomic<uint64_t> bytes_read;
+  std::atomic<uint64_t> reads;
+  std::atomic<uint64_t> packets;
+  std::atomic<uint64_t> frames;
+  std::atomic<uint64_t> read_errors;
+  std::atomic<uint64_t> parse_errors;
+  std::atomic<uint64_t> decode_errors;
+  std::atomic<uint64_t> dropped_frames;
+  std::atomic<uint64_t> buckets[H264_STAGE_COUNT][H264_HISTOGRAM_BUCKETS];              /* the histograms of the stages */
+  std::atomic<uint64_t> stage_count[H264_STAGE_COUNT];
+  std::atomic<uint64_t> stage_sum[H264_STAGE_COUNT];
+  std::atomic<uint64_t> stage_max[H264_STAGE_COUNT];
+};
+
+const char* h264_stage_name(int stage);                                                  /* "read", "parse", "decode" or "callback" */
+void h264_write_stats_json(FILE* fp, const H264_DecoderStats& stats);                    /* one JSON object with the counters and the histograms */
+void h264_write_stats_prometheus(FILE* fp, const H264_DecoderStats& stats, const std::string& instance);  /* Prometheus text format; `instance` becomes the `decoder` label */
+bool h264_dump_stats(const std::string& filepath, const H264_DecoderStats& stats, const std::string& instance);  /* write to filepath through a temporary file; Prometheus when it ends with ".prom", JSON otherwise */
+
+inline int h264_histogram_bucket(uint64_t ns) {
+
+  int bucket = (ns > 1) ? 63 - __builtin_clzll(ns) : 0;
+
+  return (bucket < H264_HISTOGRAM_BUCKETS) ? bucket : H264_HISTOGRAM_BUCKETS - 1;
+}
+
+inline void H264_Histogram::add(uint64_t ns) {
+
+  buckets[h264_histogram_bucket(ns)]++;
+  count++;
+  sum += ns;
+
+  if(ns > max) {
+    max = ns;
+  }
+}
+
+/* single writer: a relaxed load and store is enough and doesn't lock the bus */
+inline void H264_StatsRecorder::add(std::atomic<uint64_t>& counter, uint64_t n) {
+  counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void H264_StatsRecorder::addTime(int stage, uint64_t ns) {
+
+  int bucket = h264_histogram_bucket(ns);
+
+  add(buckets[stage][bucket], 1);
+  add(stage_count[stage], 1);
+  add(stage_sum[stage], ns);
+
+  if(ns > stage_max[stage].load(std::memory_order_relaxed)) {
+    stage_max[stage].store(ns, std::memory_order_relaxed);
+  }
+}
+
+#endif
@@ -121,6 +121,8 @@ void YUV420P_Player::draw(int x, int y, int w, int h) {
     h = vid_h;
   }
  
+  RX_TRACE_SCOPE("draw");
+ 
   glBindVertexArray(vao);
   glUseProgram(prog);
  
@@ -154,6 +156,8 @@ void YUV420P_Player::resize(int winW, int winH) {
 void YUV420P_Player::setYPixels(uint8_t* pixels, int stride) {
   assert(textures_created == true);
  
+  RX_TRACE_SCOPE("upload Y");
+ 
   glBindTexture(GL_TEXTURE_2D, y_tex);
   glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vid_w, vid_h, GL_RED, GL_UNSIGNED_BYTE, pixels);
@@ -162,6 +166,8 @@ void YUV420P_Player::setYPixels(uint8_t* pixels, int stride) {
 void YUV420P_Player::setUPixels(uint8_t* pixels, int stride) {
   assert(textures_created == true);
  
+  RX_TRACE_SCOPE("upload U");
+ 
   glBindTexture(GL_TEXTURE_2D, u_tex);
   glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vid_w/2, vid_h/2, GL_RED, GL_UNSIGNED_BYTE, pixels);
@@ -170,6 +176,8 @@ void YUV420P_Player::setUPixels(uint8_t* pixels, int stride) {
 void YUV420P_Player::setVPixels(uint8_t* pixels, int stride) {
   assert(textures_created == true);
  
+  RX_TRACE_SCOPE("upload V");
+ 
   glBindTexture(GL_TEXTURE_2D, v_tex);
   glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vid_w/2, vid_h/2, GL_RED, GL_UNSIGNED_BYTE, pixels);
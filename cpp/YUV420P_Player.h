@@ -16,6 +16,10 @@
   If you resize your viewport, make sure to  call `resize()` so we can 
   adjust the projection matrix.
  
+  With -DROXLU_USE_TRACE the texture uploads and draw calls show up in the
+  trace (see tinylib.h); they measure the time to submit the GL commands,
+  not the time the GPU needs.
+ 
  */
 #ifndef ROXLU_YUV420P_PLAYER_H
 #define ROXLU_YUV420P_PLAYER_H
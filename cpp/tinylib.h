@@ -52,12 +52,30 @@
   -----------------------------------------------------------------------------------
   std::string path = rx_get_exe_path();                  - returns the path to the exe 
   std::string contents = rx_read_file("filepath.txt");   - returns the contents of the filepath.
+  uint64_t now = rx_hrtime();                            - returns a monotonic timestamp in nanoseconds
+
+  TRACE
+  -----------------------------------------------------------------------------------
+  RX_TRACE_BEGIN("decode");                              - start of a span on the timeline of this thread
+  RX_TRACE_END("decode");                                - end of the span that was started last on this thread
+  RX_TRACE_SCOPE("decode");                              - (C++) a span until the end of the current scope
+  RX_TRACE_INSTANT("keyframe");                          - a single point on the timeline of this thread
+  RX_TRACE_THREAD_NAME("decoder");                       - name of this thread in the trace viewer
+  RX_TRACE_FLUSH("trace.json");                          - write everything we recorded as a Chrome trace
+
+  rx_hrtime() and the TRACE part live in tinylib_trace.h, see there for the 
+  details. Include that file directly when you don't need OpenGL and libpng;
+  from C, including this file only gets you those.
 
  */
 
 #ifndef ROXLU_TINYLIB_H
 #define ROXLU_TINYLIB_H
 
+#include "tinylib_trace.h" /* rx_hrtime() and RX_TRACE_*; C and C++ */
+
+#if defined(__cplusplus)
+
 #include <cmath>
 #include <iostream>
 #include <assert.h>
@@ -65,6 +83,8 @@
 #include <algorithm>
 #include <string>
 #include <fstream>
+#include <stdint.h>
+#include <time.h>
 
 #if defined(__APPLE__)
 #  if !defined(__gl_h_)
@@ -81,7 +101,14 @@
 #  include <sys/stat.h> /* stat() */
 #  include <unistd.h>  /* sysconf */
 #else 
+#  ifndef GL_GLEXT_PROTOTYPES
+#    define GL_GLEXT_PROTOTYPES /* glCreateShader() etc. */
+#  endif
 #  include <GL/glx.h>
+#  include <limits.h> /* PATH_MAX */
+#  include <libgen.h> /* dirname */
+#  include <string.h>
+#  include <unistd.h> /* readlink */
 #endif
 
 #include <png.h>
@@ -356,8 +383,8 @@ static std::string rx_get_exe_path() {
 }
 #elif defined(__linux) // rx_get_exe_path()
 static std::string rx_get_exe_path() {
-  char buffer[MAX_PATH];
-  size_t size = MAX_PATH;
+  char buffer[PATH_MAX];
+  size_t size = PATH_MAX;
   ssize_t n = readlink("/proc/self/exe", buffer, size - 1);
   if (n <= 0) {
     return "";
@@ -631,4 +658,6 @@ static std::string rx_read_file(std::string filepath) {
   return str;
 }
 
+#endif // __cplusplus
+
 #endif
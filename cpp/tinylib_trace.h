@@ -0,0 +1,218 @@
+/*
+
+  tinylib_trace
+  ---------------------------------------
+
+  The TIME and TRACE parts of tinylib.h: rx_hrtime() and the Chrome trace 
+  event recorder. tinylib.h includes this file; include it directly when you
+  only need these, e.g. in the decoder modules and tools, so you don't need
+  OpenGL and libpng to build them. This file compiles as C (GCC or clang) and
+  C++; with -std=c99 define _POSIX_C_SOURCE 200809L before the first include
+  for clock_gettime().
+
+  TRACE
+  -----------------------------------------------------------------------------------
+  RX_TRACE_BEGIN("decode");                              - start of a span on the timeline of this thread
+  RX_TRACE_END("decode");                                - end of the span that was started last on this thread
+  RX_TRACE_SCOPE("decode");                              - (C++) a span until the end of the current scope
+  RX_TRACE_INSTANT("keyframe");                          - a single point on the timeline of this thread
+  RX_TRACE_THREAD_NAME("decoder");                       - name of this thread in the trace viewer
+  RX_TRACE_FLUSH("trace.json");                          - write everything we recorded as a Chrome trace
+
+  Records events for chrome://tracing or https://ui.perfetto.dev, so you 
+  can see on a timeline when every thread was busy and where it waited.
+  Compile with -DROXLU_USE_TRACE to enable it; otherwise the macros are 
+  empty and no code is generated. The names must be string literals (we 
+  store the pointer) without quotes or backslashes.
+
+  Every thread writes into its own ring buffer of RX_TRACE_CAPACITY events
+  (allocated on first use), so recording doesn't lock and costs one 
+  rx_hrtime() call; when a thread records more, its oldest events are
+  overwritten. RX_TRACE_FLUSH() may be called from any thread, but call
+  it when the other threads are quiet (e.g. at the end): events that are
+  written while we flush may be missing or out of order.
+
+ */
+
+#ifndef ROXLU_TINYLIB_TRACE_H
+#define ROXLU_TINYLIB_TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__APPLE__)
+#  include <mach/mach_time.h>
+#endif
+
+// TIME (C and C++)
+// ---------------------------------------------------------------------------
+#if defined(__APPLE__) // rx_hrtime()
+static inline uint64_t rx_hrtime(void) {
+  static mach_timebase_info_data_t info;
+  if(info.denom == 0) {
+    mach_timebase_info(&info);
+  }
+  return mach_absolute_time() * info.numer / info.denom;
+}
+#elif defined(__linux) // rx_hrtime()
+static inline uint64_t rx_hrtime(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+#endif // rx_hrtime()
+
+// TRACE (C and C++)
+// ---------------------------------------------------------------------------
+#if defined(ROXLU_USE_TRACE)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h> /* getpid() */
+
+#ifndef RX_TRACE_CAPACITY
+#define RX_TRACE_CAPACITY 65536                                          /* events per thread, must be a power of two */
+#endif
+
+typedef struct rx_trace_event {
+  const char* name;                                                      /* string literal */
+  uint64_t timestamp;                                                    /* rx_hrtime() */
+  char phase;                                                            /* 'B'egin, 'E'nd or 'i'nstant, as in the trace event format */
+} rx_trace_event;
+
+typedef struct rx_trace_buffer {
+  struct rx_trace_buffer* next;                                          /* the buffer of the thread that started tracing before this one */
+  uint32_t tid;                                                          /* 1, 2, ... in the order the threads started tracing */
+  const char* thread_name;                                               /* see RX_TRACE_THREAD_NAME() */
+  uint64_t head;                                                         /* number of events written; only the owner writes it */
+  rx_trace_event events[RX_TRACE_CAPACITY];
+} rx_trace_buffer;
+
+/* weak, so every translation unit (and C and C++ code) shares the same buffers */
+__attribute__((weak)) rx_trace_buffer* rx_trace_buffers = NULL;
+__attribute__((weak)) uint32_t rx_trace_thread_count = 0;
+__attribute__((weak)) __thread rx_trace_buffer* rx_trace_thread_buffer = NULL;
+
+static inline rx_trace_buffer* rx_trace_get_buffer(void) {
+
+  rx_trace_buffer* buf = rx_trace_thread_buffer;
+  if(buf) {
+    return buf;
+  }
+
+  buf = (rx_trace_buffer*)calloc(1, sizeof(rx_trace_buffer));
+  if(!buf) {
+    return NULL;
+  }
+
+  buf->tid = __atomic_add_fetch(&rx_trace_thread_count, 1, __ATOMIC_RELAXED);
+  buf->next = __atomic_load_n(&rx_trace_buffers, __ATOMIC_RELAXED);
+
+  /* lock free push; the buffers live until the process exits so we can flush the events of threads that are gone */
+  while(!__atomic_compare_exchange_n(&rx_trace_buffers, &buf->next, buf, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+
+  rx_trace_thread_buffer = buf;
+
+  return buf;
+}
+
+static inline void rx_trace_add(const char* name, char phase) {
+
+  rx_trace_buffer* buf = rx_trace_get_buffer();
+  if(!buf) {
+    return;
+  }
+
+  uint64_t head = buf->head;
+  rx_trace_event* ev = &buf->events[head & (RX_TRACE_CAPACITY - 1)];
+  ev->name = name;
+  ev->timestamp = rx_hrtime();
+  ev->phase = phase;
+
+  __atomic_store_n(&buf->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static inline void rx_trace_set_thread_name(const char* name) {
+
+  rx_trace_buffer* buf = rx_trace_get_buffer();
+  if(buf) {
+    buf->thread_name = name;
+  }
+}
+
+/* writes the Chrome trace event format (JSON); returns 0 when the file can't be written */
+static inline int rx_trace_flush(const char* filepath) {
+
+  FILE* fp = fopen(filepath, "wb");
+  if(!fp) {
+    printf("Error: cannot open the trace file: %s\n", filepath);
+    return 0;
+  }
+
+  int pid = (int)getpid();
+  const char* sep = "";
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+  rx_trace_buffer* buf = __atomic_load_n(&rx_trace_buffers, __ATOMIC_ACQUIRE);
+
+  for(; buf; buf = buf->next) {
+
+    uint64_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    uint64_t i = (head > RX_TRACE_CAPACITY) ? head - RX_TRACE_CAPACITY : 0;
+
+    if(buf->thread_name) {
+      fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+              sep, pid, buf->tid, buf->thread_name);
+      sep = ",\n";
+    }
+
+    for(; i < head; ++i) {
+      rx_trace_event* ev = &buf->events[i & (RX_TRACE_CAPACITY - 1)];
+      fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u%s}",
+              sep, ev->name, ev->phase, ev->timestamp / 1000.0, pid, buf->tid, 
+              (ev->phase == 'i') ? ",\"s\":\"t\"" : "");
+      sep = ",\n";
+    }
+  }
+
+  fprintf(fp, "\n]}\n");
+
+  if(fclose(fp) != 0) {
+    printf("Error: cannot write the trace file: %s\n", filepath);
+    return 0;
+  }
+
+  return 1;
+}
+
+#  define RX_TRACE_BEGIN(name) rx_trace_add(name, 'B')
+#  define RX_TRACE_END(name) rx_trace_add(name, 'E')
+#  define RX_TRACE_INSTANT(name) rx_trace_add(name, 'i')
+#  define RX_TRACE_THREAD_NAME(name) rx_trace_set_thread_name(name)
+#  define RX_TRACE_FLUSH(filepath) rx_trace_flush(filepath)
+
+#  if defined(__cplusplus)
+struct rx_trace_scope {
+  rx_trace_scope(const char* n):name(n) { rx_trace_add(name, 'B'); }
+  ~rx_trace_scope() { rx_trace_add(name, 'E'); }
+  const char* name;
+};
+#    define RX_TRACE_CONCAT_(a, b) a##b
+#    define RX_TRACE_CONCAT(a, b) RX_TRACE_CONCAT_(a, b)
+#    define RX_TRACE_SCOPE(name) rx_trace_scope RX_TRACE_CONCAT(rx_trace_scope_, __LINE__)(name)
+#  endif
+
+#else 
+
+#  define RX_TRACE_BEGIN(name) ((void)0)
+#  define RX_TRACE_END(name) ((void)0)
+#  define RX_TRACE_INSTANT(name) ((void)0)
+#  define RX_TRACE_THREAD_NAME(name) ((void)0)
+#  define RX_TRACE_FLUSH(filepath) (1)
+#  define RX_TRACE_SCOPE(name) ((void)0)
+
+#endif // ROXLU_USE_TRACE
+
+#endif // ROXLU_TINYLIB_TRACE_H
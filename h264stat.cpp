@@ -0,0 +1,83 @@
+/*
+
+  h264stat
+  ---------------------------------------
+
+  Prints bitstream statistics of an Annex B file without decoding it: the
+  size, slice type, frame_num, POC and QP of every picture, the IDR interval,
+  the GOP structure and the bitrate over time. See cpp/H264_Analyzer.h.
+
+  Usage: ./h264stat [-f summary|csv|json] [-r fps] [-w seconds] [-o output] file.h264
+
+    -f  output format; csv has a row per picture, json the GOPs, the
+        bitrate per window and an object per picture with the csv columns
+    -r  framerate, when the stream has no timing info (default 25)
+    -w  length of a bitrate window in seconds (default 1)
+    -o  write to this file instead of stdout
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "cpp/H264_Analyzer.h"
+
+static void print_usage(const char* name);
+
+int main(int argc, char **argv)
+{
+    std::string format = "summary";
+    const char* output = NULL;
+    H264_Analyzer analyzer;
+    int c;
+
+    while ((c = getopt(argc, argv, "f:r:w:o:h")) != -1) {
+        switch (c) {
+            case 'f': format = optarg;                  break;
+            case 'r': analyzer.fps = atof(optarg);      break;
+            case 'w': analyzer.window = atof(optarg);   break;
+            case 'o': output = optarg;                  break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (format != "summary" && format != "csv" && format != "json") {
+        printf("Error: unknown format: %s\n", format.c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (!analyzer.analyze(argv[optind]))
+        return EXIT_FAILURE;
+
+    FILE* fp = (output) ? fopen(output, "w") : stdout;
+    if (!fp) {
+        printf("Error: cannot open: %s\n", output);
+        return EXIT_FAILURE;
+    }
+
+    if (format == "csv")
+        analyzer.writeCsv(fp);
+    else if (format == "json")
+        analyzer.writeJson(fp);
+    else
+        analyzer.writeSummary(fp);
+
+    if (output)
+        fclose(fp);
+
+    return EXIT_SUCCESS;
+}
+
+
+static void print_usage(const char* name)
+{
+    printf("Usage: %s [-f summary|csv|json] [-r fps] [-w seconds] [-o output] file.h264\n", name);
+}
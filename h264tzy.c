@@ -1,68 +1,565 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime() for rx_hrtime(), getopt() */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <inttypes.h>
 #include <libswscale/swscale.h>
 #include <x264.h>
+#include <tinylib_trace.h>
 #include "h264tzy.h"
 
+
 int main(int argc, char **argv)
 {
-    create_raw_h264();
+    h264tzy_config_t cfg;
+    h264tzy_stats_t stats;
+
+    RX_TRACE_THREAD_NAME("h264tzy");
+
+    h264tzy_config_default(&cfg);
+    if (h264tzy_parse_args(argc, argv, &cfg))
+        return EXIT_FAILURE;
+
+    if (cfg.benchmark)
+        return run_benchmark(&cfg) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    if (create_raw_h264(&cfg, &stats))
+        return EXIT_FAILURE;
+
+    /* keep stdout clean when the stream goes there */
+    print_stats(strcmp(cfg.output, "-") ? stdout : stderr, &cfg, &stats);
+
+    if (!RX_TRACE_FLUSH("h264tzy_trace.json")) {
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
 
 
-void create_raw_h264()
+void h264tzy_config_default(h264tzy_config_t *cfg)
 {
-    vpfile = fopen("sample.h264", "wb");
-    
-    x264_param_t param;
-    x264_param_default_preset(&param, "veryfast", "zerolatency");
-    param.i_threads = 1;
-    param.i_width = H264TZY_DEFAULT_WIDTH;
-    param.i_height = H264TZY_DEFAULT_HEIGHT;
-    param.i_fps_num = 30;
-    param.i_fps_den = 1;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->input = NULL;
+    cfg->output = H264TZY_DEFAULT_OUTPUT;
+    cfg->format = H264TZY_FORMAT_RGB24;
+    cfg->width = H264TZY_DEFAULT_WIDTH;
+    cfg->height = H264TZY_DEFAULT_HEIGHT;
+    cfg->fps = H264TZY_DEFAULT_FPS;
+    cfg->frames = 0;
+    cfg->preset = H264TZY_DEFAULT_PRESET;
+    cfg->tune = H264TZY_DEFAULT_TUNE;
+    cfg->threads = 1;
+    cfg->sliced_threads = H264TZY_KEEP;
+    cfg->lookahead_threads = H264TZY_KEEP;
+    cfg->rc_lookahead = H264TZY_KEEP;
+    cfg->benchmark = 0;
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-i input|-] [-f rgb24|yuv420p] [-s WIDTHxHEIGHT] [-r fps] [-n frames] [-o output.h264|-]\n"
+            "          [-p preset] [-T tune|none] [-t threads] [-S 0|1] [-L lookahead_threads] [-l rc_lookahead] [-B]\n"
+            "  without -i we encode %d frames of a moving test pattern\n"
+            "  -p  x264 preset (default %s)         -T  x264 tune (default %s)\n"
+            "  -t  encoder threads, 0 = auto (default 1)  -S  1 = sliced threads, 0 = frame threads\n"
+            "  -L  lookahead threads, 0 = auto          -l  rate control lookahead in frames\n"
+            "  -B  sweep presets, tune (zerolatency, none), threads, sliced threads, lookahead and\n"
+            "      lookahead threads; print fps, bitrate and latency (-p, -T, -t, -S, -l and -L are ignored)\n",
+            name, H264TZY_DEFAULT_FRAMES, H264TZY_DEFAULT_PRESET, H264TZY_DEFAULT_TUNE);
+}
+
+
+int h264tzy_parse_args(int argc, char **argv, h264tzy_config_t *cfg)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "i:o:f:s:r:n:p:T:t:S:L:l:Bh")) != -1) {
+        switch (c) {
+        case 'i':
+            cfg->input = optarg;
+            break;
+        case 'o':
+            cfg->output = optarg;
+            break;
+        case 'f':
+            if (!strcmp(optarg, "rgb24")) {
+                cfg->format = H264TZY_FORMAT_RGB24;
+            } else if (!strcmp(optarg, "yuv420p")) {
+                cfg->format = H264TZY_FORMAT_YUV420P;
+            } else {
+                fprintf(stderr, "-E- unknown input format: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &cfg->width, &cfg->height) != 2) {
+                fprintf(stderr, "-E- invalid size: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'r':
+            cfg->fps = atoi(optarg);
+            break;
+        case 'n':
+            cfg->frames = atoi(optarg);
+            break;
+        case 'p':
+            cfg->preset = optarg;
+            break;
+        case 'T':
+            cfg->tune = strcmp(optarg, "none") ? optarg : NULL;
+            break;
+        case 't':
+            cfg->threads = atoi(optarg);
+            break;
+        case 'S':
+            cfg->sliced_threads = atoi(optarg) ? 1 : 0;
+            break;
+        case 'L':
+            cfg->lookahead_threads = atoi(optarg);
+            break;
+        case 'l':
+            cfg->rc_lookahead = atoi(optarg);
+            break;
+        case 'B':
+            cfg->benchmark = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    /* I420 has one chroma sample per 2x2 pixels */
+    if (cfg->width <= 0 || cfg->height <= 0 || (cfg->width & 1) || (cfg->height & 1)) {
+        fprintf(stderr, "-E- the size must be positive and even: %dx%d\n", cfg->width, cfg->height);
+        return -1;
+    }
+
+    if (cfg->fps <= 0 || cfg->frames < 0) {
+        fprintf(stderr, "-E- invalid framerate or frame count\n");
+        return -1;
+    }
+
+    if (cfg->threads < 0 || cfg->lookahead_threads < H264TZY_KEEP || cfg->rc_lookahead < H264TZY_KEEP) {
+        fprintf(stderr, "-E- invalid thread count or lookahead\n");
+        return -1;
+    }
+
+    if (!cfg->input && !cfg->frames)
+        cfg->frames = H264TZY_DEFAULT_FRAMES;
+
+    return 0;
+}
+
+
+int h264tzy_source_open(h264tzy_source_t *src, const h264tzy_config_t *cfg)
+{
+    memset(src, 0, sizeof(*src));
+    src->format = cfg->input ? cfg->format : H264TZY_FORMAT_RGB24;
+    src->width = cfg->width;
+    src->height = cfg->height;
+    src->frames = cfg->frames;
+
+    if (cfg->input) {
+        src->fp = strcmp(cfg->input, "-") ? fopen(cfg->input, "rb") : stdin;
+        if (!src->fp) {
+            fprintf(stderr, "-E- cannot open the input: %s\n", cfg->input);
+            return -1;
+        }
+    }
+
+    if (src->format == H264TZY_FORMAT_RGB24) {
+        src->rgb = malloc((size_t)src->width * src->height * 3);
+        src->convert_ctx = sws_getContext(src->width, src->height, PIX_FMT_RGB24,
+                                          src->width, src->height, PIX_FMT_YUV420P,
+                                          SWS_FAST_BILINEAR, NULL, NULL, NULL);
+        if (!src->rgb || !src->convert_ctx) {
+            fprintf(stderr, "-E- cannot set up the RGB to YUV conversion\n");
+            h264tzy_source_close(src);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* a pattern that changes every frame, so the encoder has motion to find */
+static void generate_rgb(h264tzy_source_t *src)
+{
+    int x, y;
+    int t = src->index;
+    uint8_t *p = src->rgb;
+
+    for (y = 0; y < src->height; y++) {
+        for (x = 0; x < src->width; x++) {
+            *p++ = (uint8_t)(x + t * 4);
+            *p++ = (uint8_t)(y + t * 2);
+            *p++ = (uint8_t)((x ^ y) + t);
+        }
+    }
+}
+
+
+/* reads `rows` rows of `width` bytes into a plane with the given stride */
+static int read_plane(FILE *fp, uint8_t *dest, int stride, int width, int rows)
+{
+    int y;
+
+    for (y = 0; y < rows; y++) {
+        if (fread(dest + (size_t)y * stride, 1, width, fp) != (size_t)width)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* returns 1 when pic holds the next frame, 0 at the end of the input, -1 on error */
+int h264tzy_source_read(h264tzy_source_t *src, x264_picture_t *pic)
+{
+    size_t nbytes = (size_t)src->width * src->height * 3;
+    int src_stride = src->width * 3;
+    const uint8_t *data;
+
+    if (src->frames && src->index >= src->frames)
+        return 0;
+
+    RX_TRACE_BEGIN("read frame");
+
+    if (src->format == H264TZY_FORMAT_YUV420P) {
+        /* a partial frame at the end is not an error, just the end */
+        if (read_plane(src->fp, pic->img.plane[0], pic->img.i_stride[0], src->width, src->height)
+            || read_plane(src->fp, pic->img.plane[1], pic->img.i_stride[1], src->width / 2, src->height / 2)
+            || read_plane(src->fp, pic->img.plane[2], pic->img.i_stride[2], src->width / 2, src->height / 2)) {
+            RX_TRACE_END("read frame");
+            return ferror(src->fp) ? -1 : 0;
+        }
+        RX_TRACE_END("read frame");
+        src->index++;
+        return 1;
+    }
+
+    if (!src->fp) {
+        generate_rgb(src);
+    } else if (fread(src->rgb, 1, nbytes, src->fp) != nbytes) {
+        RX_TRACE_END("read frame");
+        return ferror(src->fp) ? -1 : 0;
+    }
+
+    RX_TRACE_END("read frame");
+
+    /* x264 expects YUV420P data; libswscale converts the RGB frame into the planes of the picture */
+    data = src->rgb;
+    RX_TRACE_BEGIN("sws_scale");
+    sws_scale(src->convert_ctx, &data, &src_stride, 0, src->height, pic->img.plane, pic->img.i_stride);
+    RX_TRACE_END("sws_scale");
+
+    src->index++;
+    return 1;
+}
+
+
+void h264tzy_source_close(h264tzy_source_t *src)
+{
+    if (src->fp && src->fp != stdin)
+        fclose(src->fp);
+    if (src->convert_ctx)
+        sws_freeContext(src->convert_ctx);
+    free(src->rgb);
+    memset(src, 0, sizeof(*src));
+}
+
+
+/* with b_annexb every NAL already starts with a start code; returns the number of bytes written, -1 on error */
+int write_nals(x264_nal_t *nals, int i_nals)
+{
+    int i;
+    int total = 0;
+
+    RX_TRACE_BEGIN("write");
+
+    for (i = 0; i < i_nals; i++) {
+        if (fwrite(nals[i].p_payload, 1, nals[i].i_payload, vpfile) != (size_t)nals[i].i_payload) {
+            RX_TRACE_END("write");
+            fprintf(stderr, "-E- cannot write the output\n");
+            return -1;
+        }
+        total += nals[i].i_payload;
+    }
+
+    RX_TRACE_END("write");
+
+    return total;
+}
+
+
+/* encodes one picture (or flushes a delayed one when pic_in is NULL) and writes what the encoder returns */
+static int encode_frame(x264_t *encoder, x264_picture_t *pic_in, h264tzy_stats_t *stats)
+{
+    x264_picture_t pic_out;
+    x264_nal_t *nals;
+    int i_nals;
+    int frame_size;
+    int written;
+    int delayed;
+    uint64_t start = rx_hrtime();
+    uint64_t latency;
+
+    if (pic_in)
+        stats->input_time[pic_in->i_pts % H264TZY_LATENCY_SLOTS] = start;
+
+    RX_TRACE_BEGIN("x264_encoder_encode");
+    frame_size = x264_encoder_encode(encoder, &nals, &i_nals, pic_in, &pic_out);
+    RX_TRACE_END("x264_encoder_encode");
+
+    stats->encode_ns += rx_hrtime() - start;
+
+    if (frame_size < 0) {
+        fprintf(stderr, "-E- x264_encoder_encode() failed: %d\n", frame_size);
+        return -1;
+    }
+
+    delayed = x264_encoder_delayed_frames(encoder);
+    if (delayed > stats->max_delay)
+        stats->max_delay = delayed;
+
+    /* the encoder may hold frames back (lookahead, B frames, frame threads) */
+    if (frame_size == 0)
+        return 0;
+
+    written = write_nals(nals, i_nals);
+    if (written < 0)
+        return -1;
+
+    stats->frames_out++;
+    stats->bytes += written;
+
+    /* pic_out.i_pts is the pts of the input picture this frame was made of */
+    latency = rx_hrtime() - stats->input_time[pic_out.i_pts % H264TZY_LATENCY_SLOTS];
+    stats->latency_sum_ns += latency;
+    if (latency > stats->latency_max_ns)
+        stats->latency_max_ns = latency;
+
+    return 0;
+}
+
+
+int h264tzy_setup_param(const h264tzy_config_t *cfg, x264_param_t *param)
+{
+    if (x264_param_default_preset(param, cfg->preset, cfg->tune) < 0) {
+        fprintf(stderr, "-E- invalid preset or tune: %s / %s\n", cfg->preset, cfg->tune ? cfg->tune : "none");
+        return -1;
+    }
+
+    /* what we set here overrides the preset and tune */
+    param->i_threads = cfg->threads;
+    if (cfg->sliced_threads != H264TZY_KEEP)
+        param->b_sliced_threads = cfg->sliced_threads;
+    if (cfg->lookahead_threads != H264TZY_KEEP)
+        param->i_lookahead_threads = cfg->lookahead_threads;
+    if (cfg->rc_lookahead != H264TZY_KEEP)
+        param->rc.i_lookahead = cfg->rc_lookahead;
+
+    param->i_width = cfg->width;
+    param->i_height = cfg->height;
+    param->i_fps_num = cfg->fps;
+    param->i_fps_den = 1;
     /* intra refres: */
-    param.i_keyint_max = 30;
-    param.b_intra_refresh = 1;
+    param->i_keyint_max = 30;
+    param->b_intra_refresh = 1;
     /* rate control: */
-    param.rc.i_rc_method = X264_RC_CRF;
-    param.rc.f_rf_constant = 25;
-    param.rc.f_rf_constant_max = 35;
+    param->rc.i_rc_method = X264_RC_CRF;
+    param->rc.f_rf_constant = 25;
+    param->rc.f_rf_constant_max = 35;
     /* a .264 uses annexB with headers prepended to IDR frames.  */
-    param.b_annexb = 1;
+    param->b_annexb = 1;
     /* for streaming: */
-    param.b_repeat_headers = 1;
-    param.i_log_level = X264_LOG_DEBUG;
-    x264_param_apply_profile(&param, "baseline");
+    param->b_repeat_headers = 1;
+    /* DEBUG logs every frame, which costs more than encoding small frames */
+    param->i_log_level = cfg->benchmark ? X264_LOG_WARNING : X264_LOG_INFO;
+
+    if (x264_param_apply_profile(param, "baseline") < 0) {
+        fprintf(stderr, "-E- the settings don't fit the baseline profile\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int create_raw_h264(const h264tzy_config_t *cfg, h264tzy_stats_t *stats)
+{
+    h264tzy_source_t src;
+    x264_param_t param;
+    x264_picture_t pic_in;
+    x264_t *encoder = NULL;
+    int have_picture = 0;
+    int ret = -1;
+    int r;
+    uint64_t start = rx_hrtime();
+
+    memset(stats, 0, sizeof(*stats));
+
+    if (h264tzy_source_open(&src, cfg))
+        return -1;
+
+    vpfile = strcmp(cfg->output, "-") ? fopen(cfg->output, "wb") : stdout;
+    if (!vpfile) {
+        fprintf(stderr, "-E- cannot open the output: %s\n", cfg->output);
+        h264tzy_source_close(&src);
+        return -1;
+    }
+
+    if (h264tzy_setup_param(cfg, &param))
+        goto done;
 
     /* initialize the encoder */
-    x264_t *encoder = x264_encoder_open(&param);
-    x264_picture_t pic_in, pic_out;
-    x264_picture_alloc(&pic_in, X264_CSP_I420, H264TZY_DEFAULT_WIDTH, H264TZY_DEFAULT_HEIGHT);
-
-    /* x264 expects YUV420P data; we could use libswscale to convert images to the right format.
-       initialize as following (assuming RGB data with 24bpp) */
-    struct SwsContext *convert_ctx = sws_getContext(
-            H264TZY_DEFAULT_WIDTH, H264TZY_DEFAULT_HEIGHT,
-            PIX_FMT_RGB24, H264TZY_DEFAULT_WIDTH, H264TZY_DEFAULT_HEIGHT,
-            PIX_FMT_YUV420P, SWS_FAST_BILINEAR, NULL, NULL, NULL);
-
-    /* data is a pointer to the RGB structure */
-    int src_stride = H264TZY_DEFAULT_WIDTH * 3;
-    /* scales image slice in `&data' and puts the resulting scaled slice in the image `pic_in.img.plane' */
-    const uint8_t *data;
-    sws_scale(convert_ctx, &data, &src_stride, 0, H264TZY_DEFAULT_HEIGHT, pic_in.img.plane, pic_in.img.i_stride);
-    x264_nal_t *nals;
-    int i_nals;
-    int frame_size = x264_encoder_encode(encoder, &nals, &i_nals, &pic_in, &pic_out);
-    if (frame_size >= 0) {
-        printf("(%d) %d\n", __LINE__, frame_size);
+    RX_TRACE_BEGIN("x264_encoder_open");
+    encoder = x264_encoder_open(&param);
+    RX_TRACE_END("x264_encoder_open");
+    if (!encoder) {
+        fprintf(stderr, "-E- cannot open the encoder\n");
+        goto done;
+    }
+
+    if (x264_picture_alloc(&pic_in, X264_CSP_I420, cfg->width, cfg->height) < 0) {
+        fprintf(stderr, "-E- cannot allocate the input picture\n");
+        goto done;
+    }
+    have_picture = 1;
+
+    while ((r = h264tzy_source_read(&src, &pic_in)) > 0) {
+        pic_in.i_pts = stats->frames_in++;
+        if (encode_frame(encoder, &pic_in, stats))
+            goto done;
+    }
+
+    if (r < 0) {
+        fprintf(stderr, "-E- cannot read frame %d of the input\n", stats->frames_in);
+        goto done;
+    }
+
+    /* end of the input: drain the frames the encoder still holds */
+    while (x264_encoder_delayed_frames(encoder) > 0) {
+        if (encode_frame(encoder, NULL, stats))
+            goto done;
+    }
+
+    ret = 0;
+
+done:
+    if (have_picture)
+        x264_picture_clean(&pic_in);
+    if (encoder)
+        x264_encoder_close(encoder);
+    if (vpfile != stdout && fclose(vpfile) != 0) {
+        fprintf(stderr, "-E- cannot write the output: %s\n", cfg->output);
+        ret = -1;
+    }
+    vpfile = NULL;
+    h264tzy_source_close(&src);
+
+    stats->total_ns = rx_hrtime() - start;
+
+    return ret;
+}
+
+
+void print_stats(FILE *fp, const h264tzy_config_t *cfg, const h264tzy_stats_t *stats)
+{
+    double total_s = stats->total_ns / 1e9;
+    double encode_s = stats->encode_ns / 1e9;
+    double bytes_per_frame = stats->frames_out ? (double)stats->bytes / stats->frames_out : 0.0;
+
+    fprintf(fp, "-I- preset: %s, tune: %s, threads: %d, sliced threads: %d, lookahead threads: %d, rc lookahead: %d\n",
+            cfg->preset, cfg->tune ? cfg->tune : "none", cfg->threads,
+            cfg->sliced_threads, cfg->lookahead_threads, cfg->rc_lookahead);
+    fprintf(fp, "-I- %s: %d frames in, %d frames out, %" PRIu64 " bytes\n",
+            cfg->output, stats->frames_in, stats->frames_out, stats->bytes);
+    fprintf(fp, "-I- %.2f fps (%.2f fps in x264_encoder_encode), %.0f bytes per frame, %.1f kbit/s at %d fps\n",
+            total_s > 0.0 ? stats->frames_out / total_s : 0.0,
+            encode_s > 0.0 ? stats->frames_out / encode_s : 0.0,
+            bytes_per_frame,
+            bytes_per_frame * 8.0 * cfg->fps / 1000.0,
+            cfg->fps);
+    fprintf(fp, "-I- latency avg: %.2f ms, max: %.2f ms, up to %d frames held by the encoder\n",
+            stats->frames_out ? stats->latency_sum_ns / 1e6 / stats->frames_out : 0.0,
+            stats->latency_max_ns / 1e6,
+            stats->max_delay);
+}
+
+
+/* one encode per combination; the output goes to /dev/null */
+int run_benchmark(const h264tzy_config_t *base)
+{
+    static const char *presets[] = { "ultrafast", "veryfast", "medium" };
+    static const char *tunes[] = { "zerolatency", NULL };
+    static const int lookaheads[] = { 0, 40 };
+    static const int lookahead_threads[] = { 1, 0 };
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int threads[2];
+    int p, u, t, sliced, l, lt;
+    h264tzy_config_t cfg;
+    h264tzy_stats_t stats;
+
+    if (base->input && !strcmp(base->input, "-")) {
+        fprintf(stderr, "-E- the benchmark reads the input more than once; use a file or the test pattern\n");
+        return -1;
+    }
+
+    threads[0] = 1;
+    threads[1] = cores > 1 ? cores : 0;
+
+    /* the tune of the config is one of the things we sweep, so it's not used */
+    printf("-I- %dx%d, %d fps, %d frames, %d cores\n",
+           base->width, base->height, base->fps, base->frames, cores);
+    printf("%-10s %-11s %7s %6s %9s %6s %9s %10s %12s %12s %7s\n",
+           "preset", "tune", "threads", "sliced", "lookahead", "la thr", "fps", "kbit/s", "latency avg", "latency max", "delay");
+
+    for (p = 0; p < (int)(sizeof(presets) / sizeof(presets[0])); p++) {
+        for (u = 0; u < (int)(sizeof(tunes) / sizeof(tunes[0])); u++) {
+            for (t = 0; t < 2; t++) {
+                for (sliced = 0; sliced < 2; sliced++) {
+                    for (l = 0; l < (int)(sizeof(lookaheads) / sizeof(lookaheads[0])); l++) {
+                        for (lt = 0; lt < (int)(sizeof(lookahead_threads) / sizeof(lookahead_threads[0])); lt++) {
+
+                            /* one thread has nothing to slice and auto gives it one lookahead thread; threads[1] is 0 (auto) on a single core */
+                            if (threads[t] == 1 && (sliced || lookahead_threads[lt] != 1))
+                                continue;
+
+                            cfg = *base;
+                            cfg.output = "/dev/null";
+                            cfg.preset = presets[p];
+                            cfg.tune = tunes[u];
+                            cfg.threads = threads[t];
+                            cfg.sliced_threads = sliced;
+                            cfg.rc_lookahead = lookaheads[l];
+                            cfg.lookahead_threads = lookahead_threads[lt];
+
+                            if (create_raw_h264(&cfg, &stats))
+                                return -1;
+
+                            printf("%-10s %-11s %7d %6d %9d %6d %9.2f %10.1f %9.2f ms %9.2f ms %7d\n",
+                                   cfg.preset, cfg.tune ? cfg.tune : "none", cfg.threads, cfg.sliced_threads,
+                                   cfg.rc_lookahead, cfg.lookahead_threads,
+                                   stats.total_ns ? stats.frames_out / (stats.total_ns / 1e9) : 0.0,
+                                   stats.frames_out ? (double)stats.bytes * 8.0 * cfg.fps / stats.frames_out / 1000.0 : 0.0,
+                                   stats.frames_out ? stats.latency_sum_ns / 1e6 / stats.frames_out : 0.0,
+                                   stats.latency_max_ns / 1e6,
+                                   stats.max_delay);
+                            fflush(stdout);
+                        }
+                    }
+                }
+            }
+        }
     }
 
-    //x264_encoder_parameters(encoder, &param);
-    //x264_encoder_headers(encoder, &headers, &i_nal);
-    //int size = headers[0].i_payload + headers[1].i_payload + headers[2].i_payload;
-    //fwrite(headers[0].p_payload, 1, size, vpfile);
+    return 0;
 }
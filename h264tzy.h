@@ -3,12 +3,77 @@
 
 #define H264TZY_DEFAULT_WIDTH  1280
 #define H264TZY_DEFAULT_HEIGHT  800
+#define H264TZY_DEFAULT_FPS      30
+#define H264TZY_DEFAULT_FRAMES  300   /* frames of the test pattern when there is no input */
+#define H264TZY_DEFAULT_OUTPUT  "sample.h264"
+#define H264TZY_DEFAULT_PRESET  "veryfast"
+#define H264TZY_DEFAULT_TUNE    "zerolatency"
+#define H264TZY_KEEP             -1   /* leave the value of the preset/tune */
+#define H264TZY_LATENCY_SLOTS  1024   /* more frames than x264 can hold back (lookahead + B frames + threads) */
+
+
+typedef enum {
+    H264TZY_FORMAT_RGB24,      /* packed 24 bit RGB, converted with libswscale */
+    H264TZY_FORMAT_YUV420P     /* planar I420, passed to x264 as is */
+} H264TZY_format_enum;
+
+
+typedef struct {
+    const char  *input;        /* raw frames; NULL for the test pattern, "-" for stdin */
+    const char  *output;       /* the Annex B stream we write */
+    int         format;        /* H264TZY_FORMAT_* of the input */
+    int         width;
+    int         height;
+    int         fps;
+    int         frames;        /* stop after this many frames; 0 = until the end of the input */
+    const char  *preset;       /* x264 preset: ultrafast .. placebo */
+    const char  *tune;         /* x264 tune, NULL for none; zerolatency turns off lookahead and B frames and uses sliced threads */
+    int         threads;       /* encoder threads, 0 = auto (x264 picks ~1.5x the cores) */
+    int         sliced_threads;     /* 1 = split each frame in slices (no extra latency), 0 = frame threads; H264TZY_KEEP */
+    int         lookahead_threads;  /* threads for the lookahead, 0 = auto; H264TZY_KEEP */
+    int         rc_lookahead;       /* frames the rate control looks ahead; adds that many frames of latency; H264TZY_KEEP */
+    int         benchmark;     /* sweep the preset, tune, thread and lookahead settings instead of one encode */
+} h264tzy_config_t;
+
+
+typedef struct {
+    FILE        *fp;           /* the input, NULL for the test pattern */
+    int         format;        /* H264TZY_FORMAT_* */
+    int         width;
+    int         height;
+    int         frames;        /* see h264tzy_config_t */
+    int         index;         /* number of frames we returned */
+    uint8_t     *rgb;          /* one RGB24 frame, read or generated */
+    struct SwsContext *convert_ctx;  /* RGB24 -> I420 */
+} h264tzy_source_t;
+
+
+typedef struct {
+    int         frames_in;     /* frames we passed to the encoder */
+    int         frames_out;    /* frames the encoder returned (delayed ones included) */
+    uint64_t    bytes;         /* size of all NALs we wrote */
+    uint64_t    encode_ns;     /* time spent in x264_encoder_encode() */
+    uint64_t    total_ns;      /* wall clock time of the whole encode, reading and converting included */
+    uint64_t    latency_sum_ns;     /* sum of the time between passing a frame in and getting it out */
+    uint64_t    latency_max_ns;
+    int         max_delay;     /* most frames the encoder held at once */
+    uint64_t    input_time[H264TZY_LATENCY_SLOTS];  /* rx_hrtime() when we passed in the frame with pts % slots */
+} h264tzy_stats_t;
 
 
 x264_nal_t *headers;
 int i_nal;
 FILE *vpfile;
 
-void create_raw_h264();
+void h264tzy_config_default(h264tzy_config_t *);
+int h264tzy_parse_args(int, char **, h264tzy_config_t *);
+int h264tzy_setup_param(const h264tzy_config_t *, x264_param_t *);
+int h264tzy_source_open(h264tzy_source_t *, const h264tzy_config_t *);
+int h264tzy_source_read(h264tzy_source_t *, x264_picture_t *);
+void h264tzy_source_close(h264tzy_source_t *);
+int write_nals(x264_nal_t *, int);
+int create_raw_h264(const h264tzy_config_t *, h264tzy_stats_t *);
+void print_stats(FILE *, const h264tzy_config_t *, const h264tzy_stats_t *);
+int run_benchmark(const h264tzy_config_t *);
 
 #endif
@@ -0,0 +1,846 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "ioring.h"
+
+#define IORING_SLOT_IDLE 0
+#define IORING_SLOT_BUSY 1
+#define IORING_SLOT_DONE 2
+
+typedef struct ioring_block {
+    uint8_t             *data;
+    int                  buf_index;    /* registered buffer index; -1 when not registered */
+    int                  pooled;       /* 0 when we malloc'd it because the pool was empty */
+    struct ioring_block *next;         /* free list */
+} ioring_block_t;
+
+typedef struct ioring_slot {
+    ioring_stream_t     *stream;
+    ioring_block_t      *block;
+    uint64_t             offset;       /* file offset of the read */
+    int                  state;        /* IORING_SLOT_* */
+    ssize_t              result;       /* bytes read or -errno */
+    size_t               pos;          /* bytes of the result the reader consumed */
+    struct iovec         iov;          /* used for READV when the block is not registered */
+    struct ioring_slot  *next;         /* work queue of the thread backend */
+} ioring_slot_t;
+
+struct ioring_stream {
+    ioring_engine_t     *engine;
+    int                  fd;
+    int                  own_fd;
+    unsigned             depth;
+    ioring_slot_t       *slots;        /* ring of `depth` slots */
+    unsigned             head;         /* the slot the reader consumes */
+    unsigned             issued;       /* slots from head that have a read */
+    uint64_t             next_offset;  /* offset of the next read we issue */
+    uint64_t             position;     /* offset of the next byte ioring_stream_read() returns */
+    int                  eof;          /* a read returned 0 bytes or failed; we stop issuing */
+};
+
+struct ioring_engine {
+    int                  backend;
+    ioring_config_t      cfg;
+    pthread_mutex_t      lock;
+    pthread_cond_t       cond;         /* signalled when reads complete */
+    uint8_t             *pool;
+    ioring_block_t      *blocks;
+    ioring_block_t      *free_blocks;
+    unsigned             inflight;     /* reads submitted and not yet completed */
+    unsigned             max_inflight;
+
+    /* IORING_BACKEND_URING */
+    int                  ring_fd;
+    void                *sq_ptr;
+    size_t               sq_size;
+    void                *cq_ptr;
+    size_t               cq_size;
+    struct io_uring_sqe *sqes;
+    size_t               sqes_size;
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_entries;
+    unsigned            *sq_array;
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_cqe *cqes;
+    int                  reaping;      /* a thread is blocked in io_uring_enter() */
+
+    /* IORING_BACKEND_THREADS */
+    pthread_t           *workers;
+    unsigned             nworkers;
+    pthread_cond_t       work_cond;
+    ioring_slot_t       *queue_head;
+    ioring_slot_t       *queue_tail;
+    int                  stop;
+};
+
+static ioring_config_t  shared_cfg;
+static int              shared_cfg_set = 0;
+static ioring_engine_t *shared_engine = NULL;
+static pthread_mutex_t  shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int uring_setup(ioring_engine_t *e);
+static void uring_teardown(ioring_engine_t *e);
+static void *worker_main(void *arg);
+
+
+void ioring_config_default(ioring_config_t *cfg)
+{
+    cfg->backend = IORING_BACKEND_AUTO;
+    cfg->queue_depth = IORING_DEFAULT_QUEUE_DEPTH;
+    cfg->block_size = IORING_DEFAULT_BLOCK_SIZE;
+    cfg->pool_blocks = IORING_DEFAULT_POOL_BLOCKS;
+    cfg->threads = IORING_DEFAULT_THREADS;
+}
+
+
+const char *ioring_backend_name(int backend)
+{
+    switch (backend) {
+        case IORING_BACKEND_URING:   return "io_uring";
+        case IORING_BACKEND_THREADS: return "threads";
+        default:                     return "auto";
+    }
+}
+
+
+ioring_engine_t *ioring_engine_create(const ioring_config_t *cfg)
+{
+    unsigned i;
+    ioring_engine_t *e = calloc(1, sizeof(ioring_engine_t));
+    if (!e)
+        return NULL;
+
+    if (cfg)
+        e->cfg = *cfg;
+    else
+        ioring_config_default(&e->cfg);
+
+    if (e->cfg.queue_depth == 0)
+        e->cfg.queue_depth = IORING_DEFAULT_QUEUE_DEPTH;
+    if (e->cfg.block_size == 0)
+        e->cfg.block_size = IORING_DEFAULT_BLOCK_SIZE;
+    if (e->cfg.threads == 0)
+        e->cfg.threads = IORING_DEFAULT_THREADS;
+
+    e->ring_fd = -1;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->cond, NULL);
+    pthread_cond_init(&e->work_cond, NULL);
+
+    /* the shared buffers; page aligned so the kernel can pin them */
+    if (e->cfg.pool_blocks) {
+        size_t pool_size = (size_t)e->cfg.pool_blocks * e->cfg.block_size;
+        e->pool = mmap(NULL, pool_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        e->blocks = calloc(e->cfg.pool_blocks, sizeof(ioring_block_t));
+        if (e->pool == MAP_FAILED || !e->blocks) {
+            fprintf(stderr, "-E- ioring: cannot allocate %zu bytes of buffers\n", pool_size);
+            if (e->pool == MAP_FAILED)
+                e->pool = NULL;
+            ioring_engine_destroy(e);
+            return NULL;
+        }
+
+        for (i = 0; i < e->cfg.pool_blocks; ++i) {
+            e->blocks[i].data = e->pool + (size_t)i * e->cfg.block_size;
+            e->blocks[i].buf_index = -1;
+            e->blocks[i].pooled = 1;
+            e->blocks[i].next = e->free_blocks;
+            e->free_blocks = &e->blocks[i];
+        }
+    }
+
+    if (e->cfg.backend != IORING_BACKEND_THREADS && uring_setup(e) == 0) {
+        e->backend = IORING_BACKEND_URING;
+        return e;
+    }
+
+    if (e->cfg.backend == IORING_BACKEND_URING) {
+        fprintf(stderr, "-E- ioring: io_uring is not available\n");
+        ioring_engine_destroy(e);
+        return NULL;
+    }
+
+    e->backend = IORING_BACKEND_THREADS;
+    e->max_inflight = (unsigned)-1;
+    e->workers = calloc(e->cfg.threads, sizeof(pthread_t));
+    if (!e->workers) {
+        ioring_engine_destroy(e);
+        return NULL;
+    }
+
+    for (i = 0; i < e->cfg.threads; ++i) {
+        if (pthread_create(&e->workers[i], NULL, worker_main, e) != 0)
+            break;
+        e->nworkers++;
+    }
+
+    if (e->nworkers == 0) {
+        fprintf(stderr, "-E- ioring: cannot start the read threads\n");
+        ioring_engine_destroy(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+
+void ioring_engine_destroy(ioring_engine_t *e)
+{
+    unsigned i;
+
+    if (!e)
+        return;
+
+    if (e->nworkers) {
+        pthread_mutex_lock(&e->lock);
+        e->stop = 1;
+        pthread_cond_broadcast(&e->work_cond);
+        pthread_mutex_unlock(&e->lock);
+        for (i = 0; i < e->nworkers; ++i)
+            pthread_join(e->workers[i], NULL);
+    }
+
+    uring_teardown(e);
+
+    if (e->pool)
+        munmap(e->pool, (size_t)e->cfg.pool_blocks * e->cfg.block_size);
+
+    free(e->workers);
+    free(e->blocks);
+    pthread_cond_destroy(&e->work_cond);
+    pthread_cond_destroy(&e->cond);
+    pthread_mutex_destroy(&e->lock);
+    free(e);
+}
+
+
+int ioring_engine_backend(ioring_engine_t *e)
+{
+    return e->backend;
+}
+
+
+int ioring_shared_init(const ioring_config_t *cfg)
+{
+    int r = -1;
+
+    pthread_mutex_lock(&shared_lock);
+    if (!shared_engine) {
+        shared_cfg = *cfg;
+        shared_cfg_set = 1;
+        r = 0;
+    }
+    pthread_mutex_unlock(&shared_lock);
+
+    return r;
+}
+
+
+ioring_engine_t *ioring_shared(void)
+{
+    ioring_engine_t *e;
+
+    pthread_mutex_lock(&shared_lock);
+    if (!shared_engine)
+        shared_engine = ioring_engine_create(shared_cfg_set ? &shared_cfg : NULL);
+    e = shared_engine;
+    pthread_mutex_unlock(&shared_lock);
+
+    return e;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* io_uring backend                                                            */
+/* -------------------------------------------------------------------------- */
+
+static int uring_setup(ioring_engine_t *e)
+{
+    struct io_uring_params p;
+    unsigned entries = 32;
+    int fd;
+
+    while (entries < e->cfg.pool_blocks * 2 && entries < 4096)
+        entries <<= 1;
+
+    memset(&p, 0, sizeof(p));
+    fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0)
+        return -1;
+
+    e->ring_fd = fd;
+    e->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    e->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (e->cq_size > e->sq_size)
+            e->sq_size = e->cq_size;
+        e->cq_size = e->sq_size;
+    }
+
+    e->sq_ptr = mmap(NULL, e->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (e->sq_ptr == MAP_FAILED) {
+        e->sq_ptr = NULL;
+        uring_teardown(e);
+        return -1;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        e->cq_ptr = e->sq_ptr;
+    } else {
+        e->cq_ptr = mmap(NULL, e->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (e->cq_ptr == MAP_FAILED) {
+            e->cq_ptr = NULL;
+            uring_teardown(e);
+            return -1;
+        }
+    }
+
+    e->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    e->sqes = mmap(NULL, e->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (e->sqes == MAP_FAILED) {
+        e->sqes = NULL;
+        uring_teardown(e);
+        return -1;
+    }
+
+    e->sq_head = (unsigned *)((uint8_t *)e->sq_ptr + p.sq_off.head);
+    e->sq_tail = (unsigned *)((uint8_t *)e->sq_ptr + p.sq_off.tail);
+    e->sq_mask = (unsigned *)((uint8_t *)e->sq_ptr + p.sq_off.ring_mask);
+    e->sq_entries = (unsigned *)((uint8_t *)e->sq_ptr + p.sq_off.ring_entries);
+    e->sq_array = (unsigned *)((uint8_t *)e->sq_ptr + p.sq_off.array);
+    e->cq_head = (unsigned *)((uint8_t *)e->cq_ptr + p.cq_off.head);
+    e->cq_tail = (unsigned *)((uint8_t *)e->cq_ptr + p.cq_off.tail);
+    e->cq_mask = (unsigned *)((uint8_t *)e->cq_ptr + p.cq_off.ring_mask);
+    e->cqes = (struct io_uring_cqe *)((uint8_t *)e->cq_ptr + p.cq_off.cqes);
+
+    /* we never have more reads in flight than completions fit in the ring */
+    e->max_inflight = p.cq_entries;
+
+    /* registered buffers save the page pinning per read; RLIMIT_MEMLOCK may not allow it */
+    if (e->pool) {
+        unsigned i;
+        struct iovec *iov = calloc(e->cfg.pool_blocks, sizeof(struct iovec));
+        if (iov) {
+            for (i = 0; i < e->cfg.pool_blocks; ++i) {
+                iov[i].iov_base = e->blocks[i].data;
+                iov[i].iov_len = e->cfg.block_size;
+            }
+            if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, e->cfg.pool_blocks) == 0) {
+                for (i = 0; i < e->cfg.pool_blocks; ++i)
+                    e->blocks[i].buf_index = (int)i;
+            }
+            free(iov);
+        }
+    }
+
+    return 0;
+}
+
+
+static void uring_teardown(ioring_engine_t *e)
+{
+    if (e->sqes)
+        munmap(e->sqes, e->sqes_size);
+    if (e->cq_ptr && e->cq_ptr != e->sq_ptr)
+        munmap(e->cq_ptr, e->cq_size);
+    if (e->sq_ptr)
+        munmap(e->sq_ptr, e->sq_size);
+    if (e->ring_fd >= 0)
+        close(e->ring_fd);
+
+    e->sqes = NULL;
+    e->cq_ptr = NULL;
+    e->sq_ptr = NULL;
+    e->ring_fd = -1;
+}
+
+
+static int uring_enter(ioring_engine_t *e, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    int r;
+
+    do {
+        r = (int)syscall(__NR_io_uring_enter, e->ring_fd, to_submit, min_complete, flags, NULL, 0);
+    } while (r < 0 && errno == EINTR);
+
+    return r;
+}
+
+
+/* called with the lock held */
+static void uring_submit(ioring_engine_t *e, ioring_slot_t *slot)
+{
+    unsigned tail = *e->sq_tail;
+    unsigned head = __atomic_load_n(e->sq_head, __ATOMIC_ACQUIRE);
+    unsigned index;
+    struct io_uring_sqe *sqe;
+
+    if (tail - head >= *e->sq_entries) {
+        uring_enter(e, tail - head, 0, 0);
+        head = __atomic_load_n(e->sq_head, __ATOMIC_ACQUIRE);
+    }
+
+    index = tail & *e->sq_mask;
+    sqe = &e->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+
+    sqe->fd = slot->stream->fd;
+    sqe->off = slot->offset;
+    sqe->user_data = (uint64_t)(uintptr_t)slot;
+
+    if (slot->block->buf_index >= 0) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = (uint64_t)(uintptr_t)slot->block->data;
+        sqe->len = (unsigned)e->cfg.block_size;
+        sqe->buf_index = (uint16_t)slot->block->buf_index;
+    } else {
+        slot->iov.iov_base = slot->block->data;
+        slot->iov.iov_len = e->cfg.block_size;
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = (uint64_t)(uintptr_t)&slot->iov;
+        sqe->len = 1;
+    }
+
+    e->sq_array[index] = index;
+    __atomic_store_n(e->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    /* when this fails the entry stays in the ring and is submitted by the next enter */
+    uring_enter(e, 1, 0, 0);
+}
+
+
+/* called with the lock held; returns the number of completions */
+static int uring_reap(ioring_engine_t *e)
+{
+    unsigned head = *e->cq_head;
+    unsigned tail = __atomic_load_n(e->cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &e->cqes[head & *e->cq_mask];
+        ioring_slot_t *slot = (ioring_slot_t *)(uintptr_t)cqe->user_data;
+        slot->result = cqe->res;
+        slot->state = IORING_SLOT_DONE;
+        e->inflight--;
+        head++;
+        n++;
+    }
+
+    __atomic_store_n(e->cq_head, head, __ATOMIC_RELEASE);
+
+    if (n)
+        pthread_cond_broadcast(&e->cond);
+
+    return n;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* thread backend                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void *worker_main(void *arg)
+{
+    ioring_engine_t *e = arg;
+    ioring_slot_t *slot;
+    ssize_t r;
+
+    pthread_mutex_lock(&e->lock);
+
+    while (!e->stop) {
+        if (!e->queue_head) {
+            pthread_cond_wait(&e->work_cond, &e->lock);
+            continue;
+        }
+
+        slot = e->queue_head;
+        e->queue_head = slot->next;
+        if (!e->queue_head)
+            e->queue_tail = NULL;
+
+        pthread_mutex_unlock(&e->lock);
+
+        do {
+            r = pread(slot->stream->fd, slot->block->data, e->cfg.block_size, (off_t)slot->offset);
+        } while (r < 0 && errno == EINTR);
+
+        pthread_mutex_lock(&e->lock);
+        slot->result = (r < 0) ? -errno : r;
+        slot->state = IORING_SLOT_DONE;
+        e->inflight--;
+        pthread_cond_broadcast(&e->cond);
+    }
+
+    pthread_mutex_unlock(&e->lock);
+
+    return NULL;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* streams                                                                     */
+/* -------------------------------------------------------------------------- */
+
+/* called with the lock held; waits until a read completed (or something else changed) */
+static void engine_wait(ioring_engine_t *e)
+{
+    unsigned to_submit;
+
+    if (e->backend == IORING_BACKEND_THREADS) {
+        pthread_cond_wait(&e->cond, &e->lock);
+        return;
+    }
+
+    if (uring_reap(e))
+        return;
+
+    /* only one thread blocks in the kernel; the others wait for its broadcast */
+    if (e->reaping) {
+        pthread_cond_wait(&e->cond, &e->lock);
+        return;
+    }
+
+    to_submit = *e->sq_tail - __atomic_load_n(e->sq_head, __ATOMIC_ACQUIRE);
+    e->reaping = 1;
+    pthread_mutex_unlock(&e->lock);
+    uring_enter(e, to_submit, 1, IORING_ENTER_GETEVENTS);
+    pthread_mutex_lock(&e->lock);
+    e->reaping = 0;
+
+    uring_reap(e);
+    pthread_cond_broadcast(&e->cond);
+}
+
+
+/* called with the lock held */
+static void stream_issue(ioring_stream_t *s)
+{
+    ioring_engine_t *e = s->engine;
+
+    while (!s->eof && s->issued < s->depth && e->inflight < e->max_inflight) {
+        ioring_slot_t *slot = &s->slots[(s->head + s->issued) % s->depth];
+        ioring_block_t *block = e->free_blocks;
+
+        if (block) {
+            e->free_blocks = block->next;
+        } else {
+            /* the pool is shared by all streams; when it's empty we use a private buffer */
+            block = malloc(sizeof(ioring_block_t) + e->cfg.block_size);
+            if (!block)
+                break;
+            block->data = (uint8_t *)(block + 1);
+            block->buf_index = -1;
+            block->pooled = 0;
+        }
+
+        slot->block = block;
+        slot->offset = s->next_offset;
+        slot->state = IORING_SLOT_BUSY;
+        slot->result = 0;
+        slot->pos = 0;
+        slot->next = NULL;
+
+        s->next_offset += e->cfg.block_size;
+        s->issued++;
+        e->inflight++;
+
+        if (e->backend == IORING_BACKEND_URING) {
+            uring_submit(e, slot);
+        } else {
+            if (e->queue_tail)
+                e->queue_tail->next = slot;
+            else
+                e->queue_head = slot;
+            e->queue_tail = slot;
+            pthread_cond_signal(&e->work_cond);
+        }
+    }
+}
+
+
+/* called with the lock held; the head slot must be done */
+static void stream_release_head(ioring_stream_t *s)
+{
+    ioring_engine_t *e = s->engine;
+    ioring_slot_t *slot = &s->slots[s->head];
+
+    if (slot->block->pooled) {
+        slot->block->next = e->free_blocks;
+        e->free_blocks = slot->block;
+    } else {
+        free(slot->block);
+    }
+
+    slot->block = NULL;
+    slot->state = IORING_SLOT_IDLE;
+    s->head = (s->head + 1) % s->depth;
+    s->issued--;
+}
+
+
+/* called with the lock held; waits for all reads of the stream and drops them */
+static void stream_drain(ioring_stream_t *s)
+{
+    while (s->issued) {
+        while (s->slots[s->head].state != IORING_SLOT_DONE)
+            engine_wait(s->engine);
+        stream_release_head(s);
+    }
+}
+
+
+ioring_stream_t *ioring_stream_open(ioring_engine_t *e, int fd, int own_fd, unsigned queue_depth)
+{
+    ioring_stream_t *s;
+
+    if (!e || fd < 0)
+        return NULL;
+
+    s = calloc(1, sizeof(ioring_stream_t));
+    if (!s)
+        return NULL;
+
+    s->engine = e;
+    s->fd = fd;
+    s->own_fd = own_fd;
+    s->depth = queue_depth ? queue_depth : e->cfg.queue_depth;
+    s->slots = calloc(s->depth, sizeof(ioring_slot_t));
+    if (!s->slots) {
+        free(s);
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < s->depth; ++i)
+        s->slots[i].stream = s;
+
+    pthread_mutex_lock(&e->lock);
+    stream_issue(s);
+    pthread_mutex_unlock(&e->lock);
+
+    return s;
+}
+
+
+ioring_stream_t *ioring_stream_open_path(ioring_engine_t *e, const char *path, unsigned queue_depth)
+{
+    ioring_stream_t *s;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return NULL;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    s = ioring_stream_open(e, fd, 1, queue_depth);
+    if (!s)
+        close(fd);
+
+    return s;
+}
+
+
+ssize_t ioring_stream_read(ioring_stream_t *s, void *dst, size_t nbytes)
+{
+    ioring_engine_t *e = s->engine;
+    uint8_t *out = dst;
+    size_t total = 0;
+    ssize_t error = 0;
+
+    pthread_mutex_lock(&e->lock);
+
+    while (total < nbytes) {
+        ioring_slot_t *slot;
+        size_t avail;
+
+        /* all reads of the engine are in flight; wait until one comes back */
+        while (s->issued == 0 && !s->eof) {
+            stream_issue(s);
+            if (s->issued == 0)
+                engine_wait(e);
+        }
+
+        if (s->issued == 0)
+            break;
+
+        slot = &s->slots[s->head];
+
+        /* return what we have instead of blocking on the next read */
+        if (slot->state != IORING_SLOT_DONE && total > 0)
+            break;
+
+        while (slot->state != IORING_SLOT_DONE)
+            engine_wait(e);
+
+        if (slot->result < 0) {
+            error = slot->result;
+            s->eof = 1;
+            stream_drain(s);
+            break;
+        }
+
+        /* the slot belongs to this stream, we copy without holding the lock */
+        avail = (size_t)slot->result - slot->pos;
+        if (avail > nbytes - total)
+            avail = nbytes - total;
+
+        pthread_mutex_unlock(&e->lock);
+        memcpy(out + total, slot->block->data + slot->pos, avail);
+        pthread_mutex_lock(&e->lock);
+
+        slot->pos += avail;
+        total += avail;
+        s->position += avail;
+
+        if (slot->pos == (size_t)slot->result) {
+            size_t result = (size_t)slot->result;
+
+            stream_release_head(s);
+
+            if (result == 0) {
+                s->eof = 1;
+            } else if (result < e->cfg.block_size) {
+                /* short, but not necessarily at the end of the file: drop the reads
+                   we issued after it and continue right after the bytes we got;
+                   at the end of the file that read returns 0 */
+                stream_drain(s);
+                s->next_offset = s->position;
+            }
+
+            stream_issue(s);
+        }
+    }
+
+    pthread_mutex_unlock(&e->lock);
+
+    if (total == 0 && error < 0) {
+        errno = (int)-error;
+        return -1;
+    }
+
+    return (ssize_t)total;
+}
+
+
+int ioring_stream_seek(ioring_stream_t *s, uint64_t offset)
+{
+    ioring_engine_t *e = s->engine;
+
+    pthread_mutex_lock(&e->lock);
+    stream_drain(s);
+    s->head = 0;
+    s->next_offset = offset;
+    s->position = offset;
+    s->eof = 0;
+    stream_issue(s);
+    pthread_mutex_unlock(&e->lock);
+
+    return 0;
+}
+
+
+uint64_t ioring_stream_tell(ioring_stream_t *s)
+{
+    return s->position;
+}
+
+
+void ioring_stream_close(ioring_stream_t *s)
+{
+    if (!s)
+        return;
+
+    pthread_mutex_lock(&s->engine->lock);
+    stream_drain(s);
+    pthread_mutex_unlock(&s->engine->lock);
+
+    if (s->own_fd)
+        close(s->fd);
+
+    free(s->slots);
+    free(s);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* stdio                                                                       */
+/* -------------------------------------------------------------------------- */
+
+static ssize_t cookie_read(void *cookie, char *buf, size_t size)
+{
+    return ioring_stream_read(cookie, buf, size);
+}
+
+
+static int cookie_seek(void *cookie, off64_t *offset, int whence)
+{
+    ioring_stream_t *s = cookie;
+    int64_t base = 0;
+    struct stat st;
+
+    switch (whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = (int64_t)s->position;
+            break;
+        case SEEK_END:
+            if (fstat(s->fd, &st) < 0)
+                return -1;
+            base = (int64_t)st.st_size;
+            break;
+        default:
+            return -1;
+    }
+
+    if (base + *offset < 0)
+        return -1;
+
+    *offset += base;
+    return ioring_stream_seek(s, (uint64_t)*offset);
+}
+
+
+static int cookie_close(void *cookie)
+{
+    ioring_stream_close(cookie);
+    return 0;
+}
+
+
+FILE *ioring_fopen(const char *path, ioring_engine_t *engine)
+{
+    cookie_io_functions_t io = { cookie_read, NULL, cookie_seek, cookie_close };
+    ioring_stream_t *s;
+    FILE *f;
+
+    if (!engine)
+        engine = ioring_shared();
+    if (!engine)
+        return NULL;
+
+    s = ioring_stream_open_path(engine, path, 0);
+    if (!s)
+        return NULL;
+
+    f = fopencookie(s, "r", io);
+    if (!f)
+        ioring_stream_close(s);
+
+    return f;
+}
@@ -0,0 +1,80 @@
+#ifndef IORING_H_
+#define IORING_H_
+
+/*
+ * ioring: read-ahead engine for sequential file input.
+ *
+ * One engine serves many streams (decoders, the mp3 scanner, ...). Every
+ * stream keeps `queue_depth` reads of `block_size` bytes in flight ahead of
+ * the reader, so a stream only waits on I/O latency when it consumes faster
+ * than the disk delivers.
+ *
+ * Backends:
+ *    IORING_BACKEND_URING:   one io_uring instance (raw syscalls, no liburing)
+ *                            with a pool of registered buffers (READ_FIXED).
+ *    IORING_BACKEND_THREADS: a small pool of pread() worker threads; used when
+ *                            io_uring is not available (old kernel, seccomp).
+ *    IORING_BACKEND_AUTO:    io_uring when possible, threads otherwise.
+ *
+ * The engine is thread safe; a stream must only be used by one thread at a
+ * time. `ioring_shared()` returns a process wide engine which is created on
+ * first use, with the config given to `ioring_shared_init()` (optional).
+ *
+ * For code that uses stdio (mp3.c) `ioring_fopen()` returns a read only
+ * FILE* on top of a stream.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IORING_BACKEND_AUTO      0
+#define IORING_BACKEND_URING     1
+#define IORING_BACKEND_THREADS   2
+
+#define IORING_DEFAULT_QUEUE_DEPTH   4           /* reads in flight per stream */
+#define IORING_DEFAULT_BLOCK_SIZE    (256 * 1024)  /* bytes per read */
+#define IORING_DEFAULT_POOL_BLOCKS   64          /* registered buffers shared by all streams */
+#define IORING_DEFAULT_THREADS       4           /* workers of the thread backend */
+
+typedef struct {
+    int      backend;       /* IORING_BACKEND_* */
+    unsigned queue_depth;   /* default reads in flight per stream */
+    size_t   block_size;    /* size of one read; also the size of the pooled buffers */
+    unsigned pool_blocks;   /* number of pooled (registered) buffers */
+    unsigned threads;       /* number of workers for IORING_BACKEND_THREADS */
+} ioring_config_t;
+
+typedef struct ioring_engine ioring_engine_t;
+typedef struct ioring_stream ioring_stream_t;
+
+void ioring_config_default(ioring_config_t *cfg);
+
+ioring_engine_t *ioring_engine_create(const ioring_config_t *cfg);
+void ioring_engine_destroy(ioring_engine_t *engine);   /* all streams must be closed */
+int ioring_engine_backend(ioring_engine_t *engine);    /* IORING_BACKEND_URING or IORING_BACKEND_THREADS */
+const char *ioring_backend_name(int backend);
+
+int ioring_shared_init(const ioring_config_t *cfg);    /* configure the shared engine; fails when it already exists */
+ioring_engine_t *ioring_shared(void);
+
+/* queue_depth 0 uses the engine default; the stream does not own fd unless own_fd is set */
+ioring_stream_t *ioring_stream_open(ioring_engine_t *engine, int fd, int own_fd, unsigned queue_depth);
+ioring_stream_t *ioring_stream_open_path(ioring_engine_t *engine, const char *path, unsigned queue_depth);
+ssize_t ioring_stream_read(ioring_stream_t *s, void *dst, size_t nbytes);   /* blocks until data is ready; 0 at the end, -1 on error */
+int ioring_stream_seek(ioring_stream_t *s, uint64_t offset);                /* drops the read-ahead and continues at offset */
+uint64_t ioring_stream_tell(ioring_stream_t *s);
+void ioring_stream_close(ioring_stream_t *s);
+
+FILE *ioring_fopen(const char *path, ioring_engine_t *engine);   /* NULL engine uses ioring_shared() */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
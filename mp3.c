@@ -5,11 +5,15 @@
 #include <string.h>
 #include <inttypes.h>
 #include "mp3.h"
+#include "ioring.h"
 
 
 int main(int argc, char **argv)
 {
-    FILE *f = fopen(argv[1], "r");
+    /* read through the shared read-ahead engine; falls back to plain stdio */
+    FILE *f = ioring_fopen(argv[1], NULL);
+    if (!f)
+        f = fopen(argv[1], "r");
     printf("-I- %s\n", argv[1]);
 
     if (read_header(f))